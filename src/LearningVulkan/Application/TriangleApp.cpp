@@ -1,17 +1,51 @@
 
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
 #include <iostream>
 #include <limits>
 #include <optional>
 #include <tuple>
 #include <set>
+#include <string>
 #include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "LearningVulkan/Bridges/GLFW.hpp"
 #include "LearningVulkan/Bridges/glm.hpp"
 #include "LearningVulkan/Bridges/vulkan.hpp"
-#include "LearningVulkan/Bridges/shaderc.hpp"
+#include "LearningVulkan/Graphics/BindlessHeap.hpp"
+#include "LearningVulkan/Graphics/Buffer.hpp"
+#include "LearningVulkan/Graphics/DebugMessageSink.hpp"
+#include "LearningVulkan/Graphics/DeletionQueue.hpp"
+#include "LearningVulkan/Graphics/FrameCommandPools.hpp"
+#include "LearningVulkan/Graphics/FrameScheduler.hpp"
+#include "LearningVulkan/Graphics/GraphicsPipelines.hpp"
+#include "LearningVulkan/Graphics/MemoryAllocator.hpp"
+#include "LearningVulkan/Graphics/PipelineCache.hpp"
+#include "LearningVulkan/Graphics/PipelineVariantCache.hpp"
+#include "LearningVulkan/Graphics/RenderGraph.hpp"
+#include "LearningVulkan/Graphics/ShaderCompiler.hpp"
+#include "LearningVulkan/Graphics/UniformRing.hpp"
+#include "LearningVulkan/Graphics/UploadQueue.hpp"
+#include "LearningVulkan/Profiling/Benchmark.hpp"
+#include "LearningVulkan/Profiling/CullingBenchmark.hpp"
+#include "LearningVulkan/Profiling/FrameProfiler.hpp"
+#include "LearningVulkan/Profiling/GpuProfiler.hpp"
+#include "LearningVulkan/Profiling/Trace.hpp"
+#include "LearningVulkan/Shaders/EmbeddedShaders.hpp"
+#include "LearningVulkan/Utility/CommandLine.hpp"
+#include "LearningVulkan/Utility/FileWatcher.hpp"
+#include "LearningVulkan/Utility/ThreadPool.hpp"
 
 #include "TriangleApp.hpp"
 
@@ -19,72 +53,345 @@ namespace TriangleApp_NS
 {
 	using namespace std::string_view_literals;
 
-	constexpr glm::ivec2 window_size{ 800, 600 };
+	constexpr glm::ivec2 window_size{ 800, 600 }; // default, see --width/--height
 	constexpr std::string_view window_title{ "Vulkan window" };
 
-	constexpr std::size_t max_frames_in_flight{ 2 };
+	constexpr uint32_t default_frames_in_flight{ 2 };
 	constexpr std::array required_device_extensions{ VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+	constexpr std::array dynamic_rendering_extensions{ VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME }; // its dependencies are core in 1.2
+	constexpr std::array calibrated_timestamp_extensions{ VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME };
+	constexpr vk::Format headless_format{ vk::Format::eR8G8B8A8Unorm };
 	constexpr std::array validation_layers{ "VK_LAYER_KHRONOS_validation" };
 #ifdef _DEBUG
-	constexpr bool use_validation_layers{ true };
+	constexpr bool validation_by_default{ true };
 #else
-	constexpr bool use_validation_layers{ false };
+	constexpr bool validation_by_default{ false };
 #endif
 
-	constexpr std::string_view vertex_shader_src
-	{
-		"#version 450\n"
-		"#extension GL_ARB_separate_shader_objects : enable\n"
-		"\n"
-		"layout(location = 0) out vec3 fragColor;\n"
-		"\n"
-		"vec2 positions[3] = vec2[](\n"
-		"	vec2(0.0, -0.5),\n"
-		"	vec2(0.5, 0.5),\n"
-		"	vec2(-0.5, 0.5)\n"
-		" );\n"
-		"\n"
-		"vec3 colors[3] = vec3[](\n"
-		"	vec3(1.0, 0.0, 0.0),\n"
-		"	vec3(0.0, 1.0, 0.0),\n"
-		"	vec3(0.0, 0.0, 1.0)\n"
-		");\n"
-		"\n"
-		"void main()\n"
-		"{\n"
-		"	gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);\n"
-		"	fragColor = colors[gl_VertexIndex];\n"
-		"}\n"
+	struct Vertex
+	{
+		glm::vec2 position{};
+		glm::vec3 colour{};
+	};
+
+	constexpr std::array triangle_vertices{
+		Vertex{ { 0.f, -.5f }, { 1.f, 0.f, 0.f } },
+		Vertex{ { .5f, .5f }, { 0.f, 1.f, 0.f } },
+		Vertex{ { -.5f, .5f }, { 0.f, 0.f, 1.f } },
+	};
+	constexpr std::array<uint16_t, 3> triangle_indices{ 0, 1, 2 };
+
+	/// Per instance attributes packed into 16 bytes, so 10M instances are 160MB a frame rather than the 400MB+ of a mat4 and vec4 each.
+	/// Array of structs as every attribute is read for every instance anyway.
+	struct InstanceData
+	{
+		glm::vec2 offset{};
+		uint32_t scale_rotation{}; // two halfs, glm::packHalf2x16
+		uint32_t colour{}; // RGBA8 unorm, glm::packUnorm4x8
+	};
+	static_assert(sizeof(InstanceData) == 16);
+
+	constexpr std::size_t instances_per_fill_job{ 16 * 1024 };
+
+	/// World to clip space, a 2D camera. Pushed to the vertex shader and what the culling frustum is built from
+	struct View
+	{
+		glm::vec2 scale{ 1.f, 1.f };
+		glm::vec2 translation{};
+	};
+
+	/// Per frame constants, written to the uniform ring once a frame. Must match Frame in triangle.vert and triangle_bindless.vert
+	struct FrameUniforms
+	{
+		View view{};
+	};
+
+	constexpr vk::DeviceSize uniform_bytes_per_frame{ 64 * 1024 };
+
+	/// draw_index of indirect draws. Their first instance is draw * instances_per_draw like that of recorded ones, so the shaders work the index out from gl_InstanceIndex
+	constexpr uint32_t indirect_draw_index{ ~0u };
+
+	/// Must match the push constants in triangle_bindless.vert, triangle.vert only has the first two
+	struct DrawConstants
+	{
+		uint32_t draw_index{ indirect_draw_index }; // pushed for every recorded draw
+		uint32_t instances_per_draw{ 1 }; // the rest once per command buffer
+		uint32_t instance_buffer{}; // storage buffer slot in the bindless heap
+		uint32_t instance_first{};
+	};
+	static_assert(sizeof(DrawConstants) == 16);
+
+	/// Size of the push constant range, the attribute variant stops short of the bindless heap's words
+	[[nodiscard]] constexpr uint32_t GetDrawConstantsSize(bool bindless)
+	{
+		return static_cast<uint32_t>(bindless ? sizeof(DrawConstants) : offsetof(DrawConstants, instance_buffer));
+	}
+
+	/// Must match the push constants in cull_instances.comp and compact_draws.comp
+	struct CullPushConstants
+	{
+		std::array<glm::vec4, 4> frustum_planes{};
+		uint32_t source_first{};
+		uint32_t culled_first{};
+		uint32_t counters_first{};
+		uint32_t commands_first{};
+		uint32_t instance_count{};
+		uint32_t instances_per_draw{};
+		uint32_t draw_count{};
+		uint32_t index_count{};
+		float mesh_radius{};
 	};
+	static_assert(sizeof(CullPushConstants) <= 128, "Only 128 bytes of push constants are guaranteed");
+
+	constexpr uint32_t cull_group_size{ 64 }; // local_size_x of the culling shaders
+	constexpr uint32_t max_dispatch_groups{ 65535 }; // lowest maxComputeWorkGroupCount allowed
+
+	/// Left, right, top and bottom planes of what the view shows, in world space with the normals pointing inwards
+	[[nodiscard]] std::array<glm::vec4, 4> GetFrustumPlanes(const View& view)
+	{
+		// -1 <= p * scale + translation <= 1 on each axis
+		return {
+			glm::vec4{ 1.f, 0.f, 0.f, (1.f + view.translation.x) / view.scale.x },
+			glm::vec4{ -1.f, 0.f, 0.f, (1.f - view.translation.x) / view.scale.x },
+			glm::vec4{ 0.f, 1.f, 0.f, (1.f + view.translation.y) / view.scale.y },
+			glm::vec4{ 0.f, -1.f, 0.f, (1.f - view.translation.y) / view.scale.y },
+		};
+	}
+
+	[[nodiscard]] float GetBoundingRadius(std::span<const Vertex> vertices)
+	{
+		float radius{ 0.f };
+		for (const auto& vertex : vertices) {
+			radius = std::max(radius, std::hypot(vertex.position.x, vertex.position.y));
+		}
+		return radius;
+	}
+
+	/// Covers group_count groups in rows of at most max_dispatch_groups, the shaders turn the 2D group id back into a linear one
+	void DispatchLinear(vk::CommandBuffer& cmd, uint32_t group_count)
+	{
+		const uint32_t rows{ (group_count + max_dispatch_groups - 1) / max_dispatch_groups };
+		cmd.dispatch(std::min(group_count, max_dispatch_groups), std::max(rows, 1u), 1);
+	}
+
+	/// Instances laid out on a square grid covering the screen, each rotating a little further every frame
+	void FillInstances(std::span<InstanceData> instances, std::size_t first_instance, std::size_t total_instances, uint64_t frame_number)
+	{
+		const auto side{ static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(total_instances)))) };
+		const float cell{ 2.f / static_cast<float>(side) };
+		const float spin{ static_cast<float>(frame_number % 3600) * 0.01f };
+
+		for (std::size_t idx{ 0 }; idx < instances.size(); ++idx)
+		{
+			const std::size_t instance{ first_instance + idx };
+			const auto column{ static_cast<float>(instance % side) };
+			const auto row{ static_cast<float>(instance / side) };
 
-	constexpr std::string_view fragment_shader_src
-	{
-		"#version 450\n"
-		"#extension GL_ARB_separate_shader_objects : enable\n"
-		"\n"
-		"layout(location = 0) in vec3 fragColor;\n"
-		"\n"
-		"layout(location = 0) out vec4 outColor;\n"
-		"\n"
-		"void main()\n"
-		"{\n"
-		"   outColor = vec4(fragColor, 1.0);\n"
-		"}\n"
+			// cheap integer hash for a stable colour per instance
+			auto hash{ static_cast<uint32_t>(instance) * 2654435761u };
+			hash ^= hash >> 16;
+
+			instances[idx].offset = { -1.f + cell * (column + .5f), -1.f + cell * (row + .5f) };
+			instances[idx].scale_rotation = glm::packHalf2x16({ cell * .5f, static_cast<float>(hash % 628) * 0.01f + spin });
+			instances[idx].colour = glm::packUnorm4x8({ .5f + static_cast<float>(hash & 0xFF) / 510.f, .5f + static_cast<float>((hash >> 8) & 0xFF) / 510.f, .5f + static_cast<float>((hash >> 16) & 0xFF) / 510.f, 1.f });
+		}
+	}
+
+	struct Settings
+	{
+		// Render into offscreen images instead of a window, no surface/swap chain/present queue is created.
+		bool headless{ false };
+		std::size_t headless_frame_count{ 1 };
+		std::string headless_output_path{}; // optional, last rendered frame is written here as a binary PPM
+
+		uint32_t frames_in_flight{ default_frames_in_flight }; // how far the CPU may get ahead of the GPU
+		bool dedicated_queues{ true }; // use a transfer only queue family for uploads when the device has one
+		bool reuse_command_buffers{ false }; // resubmit the previous recording for an image while nothing has changed, instead of recording every frame
+		std::size_t thread_count{ 0 }; // threads used for parallel work (pipeline creation, command recording) including the main thread, 0 for one per hardware thread
+		bool secondary_command_buffers{ false }; // split the render pass into jobs recorded into secondary command buffers over the thread pool
+		uint32_t draws_per_job{ 256 };
+		bool dynamic_rendering{ true }; // begin rendering straight on the image views with VK_KHR_dynamic_rendering when the device has it, no render pass or framebuffers
+		float render_scale{ 1.f }; // draw into a transient image of the render graph at this fraction of the target's size and blit it over, dynamic rendering only
+
+		// Validation layers, whose messages are printed by a logger thread of their own so the reporting thread never waits on the console
+		bool validation{ validation_by_default };
+		Graphics::DebugMessageSink::Settings debug_messages{};
+
+		// Workload
+		uint32_t width{ static_cast<uint32_t>(window_size.x) };
+		uint32_t height{ static_cast<uint32_t>(window_size.y) };
+		uint32_t instance_count{ 1 };
+		uint32_t draw_count{ 1 }; // draw calls per frame, each drawing instance_count instances
+		bool stream_geometry{ false }; // re-upload the vertices every frame through the staging ring
+		bool static_instances{ false }; // upload the per instance attributes once instead of every frame
+		bool instance_stress{ false }; // benchmark 1k, 10k, ... instances up to max_instances in one draw
+		uint32_t max_instances{ 10'000'000 };
+		bool gpu_culling{ false }; // frustum cull instances in a compute pass and draw the survivors with one indirect draw
+		float zoom{ 1.f }; // > 1 zooms in, pushing instances off screen for culling to throw away
+		bool bindless{ false }; // the vertex shader reads instances out of the bindless heap instead of vertex attributes
+		uint32_t staging_size_mib{ 8 };
+
+		// Fixed length run which reports per-frame CPU timings, overrides headless_frame_count
+		bool bench{ false };
+		std::size_t bench_warmup_frames{ 60 };
+		std::size_t bench_frames{ 600 };
+		std::filesystem::path bench_output_path{ "bench.json" };
+		bool bench_thread_sweep{ false }; // repeat the benchmark recording on 1, 2, 4, ... threads up to thread_count
+
+		// CPU frustum culling/LOD selection micro-benchmark, run instead of rendering
+		bool cull_bench{ false };
+		std::size_t cull_bench_objects{ 1'000'000 };
+
+		// Directory the on-disk caches (pipeline cache etc.) live in
+		std::filesystem::path cache_directory{ "cache" };
+		bool use_pipeline_cache{ true };
+		bool serial_pipeline_creation{ false }; // compile shaders and create pipelines on the main thread instead of the worker pool
+		bool single_pipeline_create_call{ false }; // create all pipelines with one vkCreateGraphicsPipelines call
+		bool async_pipelines{ false }; // build the bindless variant on the thread pool, drawing with vertex attributes until it is ready
+
+		// GPU/CPU frame timings, dumped every profile_interval to stdout and appended to profile_json_path if set
+		bool profile{ false };
+		double profile_interval{ 1. }; // seconds
+		std::filesystem::path profile_json_path{};
+		bool memory_stats{ false }; // print device memory usage/fragmentation and allocation latency on exit
+		std::filesystem::path trace_path{}; // timeline of the startup phases and frame stages, written on exit as Chrome trace event JSON
+		std::size_t trace_events{ std::size_t{ 1 } << 16 }; // most recent events kept per thread
+
+#ifdef RUNTIME_SHADER_COMPILATION
+		// Development path, compile the GLSL sources with shaderc at startup instead of using the SPIR-V embedded at build time
+		bool compile_shaders_at_runtime{ true };
+		bool use_shader_cache{ true }; // on-disk compile cache, under cache_directory
+		std::filesystem::path shader_directory{ "Shaders" };
+		bool watch_shaders{ false }; // recompile edited shaders in the background and swap the pipelines built from them in between frames
+#endif
 	};
 
-	VKAPI_ATTR VkBool32 VKAPI_CALL OnVulkanDebugCallback(
-		[[maybe_unused]] VkDebugUtilsMessageSeverityFlagBitsEXT severity,
-		[[maybe_unused]] VkDebugUtilsMessageTypeFlagsEXT type,
-		const VkDebugUtilsMessengerCallbackDataEXT* callback_data,
-		[[maybe_unused]] void* user_data)
+	/// "warning" keeps warnings and errors and so on, nullopt for an unknown name
+	[[nodiscard]] std::optional<vk::DebugUtilsMessageSeverityFlagsEXT> ParseMinimumSeverity(std::string_view name)
+	{
+		using Severity = vk::DebugUtilsMessageSeverityFlagBitsEXT;
+		constexpr std::array<std::pair<std::string_view, Severity>, 4> severities{ { { "verbose", Severity::eVerbose }, { "info", Severity::eInfo }, { "warning", Severity::eWarning }, { "error", Severity::eError } } };
+
+		const auto it{ std::find_if(std::begin(severities), std::end(severities), [name](const auto& severity) { return severity.first == name; }) };
+		if (it == std::end(severities)) {
+			return std::nullopt;
+		}
+
+		vk::DebugUtilsMessageSeverityFlagsEXT kept{};
+		std::for_each(it, std::end(severities), [&kept](const auto& severity) { kept |= severity.second; });
+		return kept;
+	}
+
+	/// Comma separated, e.g. "validation,performance". nullopt if any of them is unknown
+	[[nodiscard]] std::optional<vk::DebugUtilsMessageTypeFlagsEXT> ParseMessageTypes(std::string_view names)
+	{
+		using Type = vk::DebugUtilsMessageTypeFlagBitsEXT;
+		constexpr std::array<std::pair<std::string_view, Type>, 3> types{ { { "general", Type::eGeneral }, { "validation", Type::eValidation }, { "performance", Type::ePerformance } } };
+
+		vk::DebugUtilsMessageTypeFlagsEXT kept{};
+		while (!names.empty())
+		{
+			const auto comma{ names.find(',') };
+			const auto name{ names.substr(0, comma) };
+			names.remove_prefix(comma == std::string_view::npos ? names.size() : comma + 1);
+
+			const auto it{ std::find_if(std::begin(types), std::end(types), [name](const auto& type) { return type.first == name; }) };
+			if (it == std::end(types)) {
+				return std::nullopt;
+			}
+			kept |= it->second;
+		}
+		return kept;
+	}
+
+	[[nodiscard]] Settings ParseSettings(std::span<const std::string_view> cli)
+	{
+		Settings settings{};
+		settings.headless = CommandLine::HasFlag(cli, "--headless");
+		settings.headless_frame_count = CommandLine::GetNumber<std::size_t>(cli, "--frames").value_or(settings.headless_frame_count);
+		settings.headless_output_path = CommandLine::GetValue(cli, "--output").value_or(""sv);
+		settings.frames_in_flight = std::max(CommandLine::GetNumber<uint32_t>(cli, "--frames-in-flight").value_or(settings.frames_in_flight), 1u);
+		settings.reuse_command_buffers = CommandLine::HasFlag(cli, "--reuse-command-buffers");
+		settings.dedicated_queues = !CommandLine::HasFlag(cli, "--no-dedicated-queues");
+		settings.thread_count = CommandLine::GetNumber<std::size_t>(cli, "--threads").value_or(settings.thread_count);
+		settings.draws_per_job = std::max(CommandLine::GetNumber<uint32_t>(cli, "--draws-per-job").value_or(settings.draws_per_job), 1u);
+		settings.dynamic_rendering = !CommandLine::HasFlag(cli, "--no-dynamic-rendering");
+		settings.render_scale = std::clamp(CommandLine::GetNumber<float>(cli, "--render-scale").value_or(settings.render_scale), 0.1f, 2.f);
+		settings.validation = (validation_by_default || CommandLine::HasFlag(cli, "--validation")) && !CommandLine::HasFlag(cli, "--no-validation");
+		if (const auto severity{ CommandLine::GetValue(cli, "--validation-severity") })
+		{
+			if (const auto severities{ ParseMinimumSeverity(*severity) }) {
+				settings.debug_messages.severities = *severities;
+			}
+			else {
+				std::cerr << "Unknown --validation-severity '" << *severity << "', expected verbose, info, warning or error\n";
+			}
+		}
+		if (const auto names{ CommandLine::GetValue(cli, "--validation-types") })
+		{
+			if (const auto types{ ParseMessageTypes(*names) }) {
+				settings.debug_messages.types = *types;
+			}
+			else {
+				std::cerr << "Unknown --validation-types '" << *names << "', expected a comma separated list of general, validation and performance\n";
+			}
+		}
+		settings.debug_messages.max_lines_per_second = CommandLine::GetNumber<uint32_t>(cli, "--validation-rate").value_or(settings.debug_messages.max_lines_per_second);
+		settings.width = std::max(CommandLine::GetNumber<uint32_t>(cli, "--width").value_or(settings.width), 1u);
+		settings.height = std::max(CommandLine::GetNumber<uint32_t>(cli, "--height").value_or(settings.height), 1u);
+		settings.instance_count = CommandLine::GetNumber<uint32_t>(cli, "--instances").value_or(settings.instance_count);
+		settings.draw_count = CommandLine::GetNumber<uint32_t>(cli, "--draws").value_or(settings.draw_count);
+		settings.stream_geometry = CommandLine::HasFlag(cli, "--stream-geometry");
+		settings.static_instances = CommandLine::HasFlag(cli, "--static-instances");
+		settings.instance_stress = CommandLine::HasFlag(cli, "--instance-stress");
+		settings.gpu_culling = CommandLine::HasFlag(cli, "--gpu-culling");
+		settings.bindless = CommandLine::HasFlag(cli, "--bindless");
+		settings.zoom = std::max(CommandLine::GetNumber<float>(cli, "--zoom").value_or(settings.zoom), 0.001f);
+		settings.max_instances = std::max(CommandLine::GetNumber<uint32_t>(cli, "--max-instances").value_or(settings.max_instances), 1u);
+		settings.staging_size_mib = std::max(CommandLine::GetNumber<uint32_t>(cli, "--staging-size").value_or(settings.staging_size_mib), 1u);
+		settings.bench = CommandLine::HasFlag(cli, "--bench");
+		settings.bench_warmup_frames = CommandLine::GetNumber<std::size_t>(cli, "--warmup-frames").value_or(settings.bench_warmup_frames);
+		settings.bench_frames = CommandLine::GetNumber<std::size_t>(cli, "--bench-frames").value_or(settings.bench_frames);
+		settings.bench_output_path = CommandLine::GetValue(cli, "--bench-output").value_or("bench.json"sv);
+		settings.bench_thread_sweep = CommandLine::HasFlag(cli, "--bench-thread-sweep");
+		settings.bench |= settings.bench_thread_sweep || settings.instance_stress;
+		settings.cull_bench = CommandLine::HasFlag(cli, "--cull-bench");
+		settings.cull_bench_objects = std::max<std::size_t>(CommandLine::GetNumber<std::size_t>(cli, "--cull-objects").value_or(settings.cull_bench_objects), 1);
+		settings.secondary_command_buffers = CommandLine::HasFlag(cli, "--secondary-command-buffers") || settings.bench_thread_sweep;
+		if (settings.thread_count == 0) {
+			settings.thread_count = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+		}
+		settings.cache_directory = CommandLine::GetValue(cli, "--cache-dir").value_or("cache"sv);
+		settings.use_pipeline_cache = !CommandLine::HasFlag(cli, "--no-pipeline-cache");
+		settings.serial_pipeline_creation = CommandLine::HasFlag(cli, "--serial-pipelines");
+		settings.single_pipeline_create_call = CommandLine::HasFlag(cli, "--pipelines-single-call");
+		settings.async_pipelines = CommandLine::HasFlag(cli, "--async-pipelines");
+		settings.profile_json_path = CommandLine::GetValue(cli, "--profile-json").value_or(""sv);
+		settings.profile = CommandLine::HasFlag(cli, "--profile") || !settings.profile_json_path.empty();
+		settings.profile_interval = CommandLine::GetNumber<double>(cli, "--profile-interval").value_or(settings.profile_interval);
+		settings.memory_stats = CommandLine::HasFlag(cli, "--memory-stats");
+		settings.trace_path = CommandLine::GetValue(cli, "--trace").value_or(""sv);
+		settings.trace_events = std::max<std::size_t>(CommandLine::GetNumber<std::size_t>(cli, "--trace-events").value_or(settings.trace_events), 1);
+#ifdef RUNTIME_SHADER_COMPILATION
+		settings.compile_shaders_at_runtime = !CommandLine::HasFlag(cli, "--embedded-shaders");
+		settings.use_shader_cache = !CommandLine::HasFlag(cli, "--no-shader-cache");
+		settings.shader_directory = CommandLine::GetValue(cli, "--shader-dir").value_or("Shaders"sv);
+		settings.watch_shaders = CommandLine::HasFlag(cli, "--watch-shaders");
+#endif
+		return settings;
+	}
+
+	[[nodiscard]] double MillisecondsSince(std::chrono::steady_clock::time_point begin)
 	{
-		std::cerr << "[Validation-layer]"
-			<< '[' << vk::to_string(static_cast<vk::DebugUtilsMessageTypeFlagBitsEXT>(type)) << ']'
-			<< '[' << vk::to_string(static_cast<vk::DebugUtilsMessageSeverityFlagBitsEXT>(severity)) << ']'
-			<< ' ' << callback_data->pMessage
-			<< '\n';
+		return std::chrono::duration<double, std::milli>{ std::chrono::steady_clock::now() - begin }.count();
+	}
 
-		return VK_FALSE;
+	/// Also records the span as a trace event, ending at the same clock reading
+	[[nodiscard]] double MillisecondsSince(std::chrono::steady_clock::time_point begin, const char* trace_name)
+	{
+		const auto end{ std::chrono::steady_clock::now() };
+		Profiling::RecordTraceEvent(trace_name, begin, end);
+		return std::chrono::duration<double, std::milli>{ end - begin }.count();
 	}
 
 	[[nodiscard]] bool CheckValidationLayerSupport()
@@ -103,33 +410,47 @@ namespace TriangleApp_NS
 		return true;
 	}
 
-	[[nodiscard]] std::vector<const char*> GetRequiredExtensions()
+	[[nodiscard]] std::vector<const char*> GetRequiredExtensions(const bool headless, const bool validation)
 	{
-		uint32_t glfw_extension_count{ 0 };
-		const char** glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+		std::vector<const char*> extensions;
 
-		if (glfw_extensions == NULL)
+		if (!headless)
 		{
-			const char* msg{};
-			const auto error = glfwGetError(&msg);
-			throw std::runtime_error("GLFW reports it does not support vulkan. glfwGetError code=" + std::to_string(error) + ", message='" + msg + "'");
-		}
+			uint32_t glfw_extension_count{ 0 };
+			const char** glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
 
-		std::vector<const char*> extensions(glfw_extensions, glfw_extensions + glfw_extension_count);
+			if (glfw_extensions == NULL)
+			{
+				const char* msg{};
+				const auto error = glfwGetError(&msg);
+				throw std::runtime_error("GLFW reports it does not support vulkan. glfwGetError code=" + std::to_string(error) + ", message='" + msg + "'");
+			}
+
+			extensions.assign(glfw_extensions, glfw_extensions + glfw_extension_count);
+		}
 
-		if (use_validation_layers) {
+		if (validation) {
 			extensions.emplace_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 		}
 
 		return extensions;
 	}
 
-	[[nodiscard]] bool CheckDeviceExtensionSupport(const vk::PhysicalDevice& device)
+	[[nodiscard]] std::vector<const char*> GetRequiredDeviceExtensions(const bool headless)
+	{
+		if (headless) {
+			return {}; // nothing to present to
+		}
+
+		return { std::begin(required_device_extensions), std::end(required_device_extensions) };
+	}
+
+	[[nodiscard]] bool CheckDeviceExtensionSupport(const vk::PhysicalDevice& device, std::span<const char* const> extensions)
 	{
 		const auto available_extensions{ device.enumerateDeviceExtensionProperties() };
 
 		// using this as a "checklist" of extensions still needing to be found.
-		std::set<std::string_view> required_extensions{ std::begin(required_device_extensions), std::end(required_device_extensions) };
+		std::set<std::string_view> required_extensions{ std::begin(extensions), std::end(extensions) };
 
 		for (const auto& extension : available_extensions) {
 			required_extensions.erase(std::string_view{ extension.extensionName });
@@ -142,11 +463,12 @@ namespace TriangleApp_NS
 	{
 		std::optional<uint32_t> graphics_family{};
 		std::optional<uint32_t> present_family{};
+		std::optional<uint32_t> transfer_family{}; // transfer only family, runs alongside graphics. Uploads go through the graphics queue without one
 
-		bool IsComplete() const noexcept
+		bool IsComplete(const bool needs_present = true) const noexcept
 		{
 			return graphics_family.has_value()
-				&& present_family.has_value();
+				&& (present_family.has_value() || !needs_present);
 		}
 	};
 
@@ -164,23 +486,26 @@ namespace TriangleApp_NS
 		std::vector<vk::PresentModeKHR> present_modes;
 	};
 
-	[[nodiscard]] QueueFamilyIndices FindQueueFamilies(const vk::PhysicalDevice& device, const vk::SurfaceKHR& surface)
+	/// dedicated_queues looks for a transfer family separate from the graphics one
+	[[nodiscard]] QueueFamilyIndices FindQueueFamilies(const vk::PhysicalDevice& device, const vk::SurfaceKHR& surface, const bool dedicated_queues = false)
 	{
 		QueueFamilyIndices indices{};
 
 		const auto queue_families = device.getQueueFamilyProperties();
 		for (uint32_t idx{0}; const auto & properties : queue_families)
 		{
-			if (properties.queueFlags & vk::QueueFlagBits::eGraphics) {
+			const auto flags{ properties.queueFlags };
+			if (!indices.graphics_family && (flags & vk::QueueFlagBits::eGraphics)) {
 				indices.graphics_family = idx;
 			}
 
-			if (device.getSurfaceSupportKHR(idx, surface)) {
+			if (!indices.present_family && surface && device.getSurfaceSupportKHR(idx, surface)) {
 				indices.present_family = idx;
 			}
 
-			if (indices.IsComplete()) {
-				break;
+			// Transfer only families are the ones backed by separate DMA engines
+			if (dedicated_queues && !indices.transfer_family && (flags & vk::QueueFlagBits::eTransfer) && !(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute))) {
+				indices.transfer_family = idx;
 			}
 			++idx;
 		}
@@ -235,14 +560,19 @@ namespace TriangleApp_NS
 		}
 	}
 
+	/// A null surface means we are running headless and do not need to present.
 	[[nodiscard]] bool IsSuitableDevice(const vk::PhysicalDevice& device, const vk::SurfaceKHR& surface)
 	{
 		[[maybe_unused]] const auto& properties{ device.getProperties() };
 		[[maybe_unused]] const auto& features{ device.getFeatures() };
+		const bool headless{ !surface };
 		const auto family_indices{ FindQueueFamilies(device, surface) };
 
-		const bool supports_required_extensions{ CheckDeviceExtensionSupport(device) };
+		const bool supports_required_extensions{ CheckDeviceExtensionSupport(device, GetRequiredDeviceExtensions(headless)) };
 		const bool swap_chain_adequite = [&](){
+			if (headless) {
+				return true;
+			}
 			if (supports_required_extensions) {
 				const SwapChainSupportDetails swap_chain_details{ device, surface };
 				return !swap_chain_details.formats.empty() && !swap_chain_details.present_modes.empty();
@@ -255,14 +585,25 @@ namespace TriangleApp_NS
 
 		// could also rank all the devices and pick the best one by default.
 
-		return family_indices.IsComplete()
+		// frame pacing is built on timeline semaphores (core in 1.2)
+		const bool supports_timeline_semaphores = [&]() {
+			if (properties.apiVersion < VK_API_VERSION_1_2) {
+				return false;
+			}
+			const auto features_chain{ device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>() };
+			return features_chain.get<vk::PhysicalDeviceVulkan12Features>().timelineSemaphore == VK_TRUE;
+		}();
+
+		return family_indices.IsComplete(!headless)
 			&& supports_required_extensions
-			&& swap_chain_adequite;
+			&& swap_chain_adequite
+			&& supports_timeline_semaphores;
 	}
 
-	[[nodiscard]] vk::UniqueInstance CreateInstance()
+	/// Validation layers are enabled when there is a debug_sink to send their messages to
+	[[nodiscard]] vk::UniqueInstance CreateInstance(const bool headless, Graphics::DebugMessageSink* debug_sink)
 	{
-		if constexpr (use_validation_layers)
+		if (debug_sink)
 		{
 			if (!CheckValidationLayerSupport()) {
 				throw std::runtime_error("At least one of the validation layers requested is not available");
@@ -276,20 +617,17 @@ namespace TriangleApp_NS
 			VK_API_VERSION_1_2
 		};
 
-		const auto required_extensions{ GetRequiredExtensions() };
+		const auto required_extensions{ GetRequiredExtensions(headless, debug_sink != nullptr) };
 
-		vk::DebugUtilsMessengerCreateInfoEXT debug_messenger_info
-		{
-			{},
-			vk::DebugUtilsMessageSeverityFlagBitsEXT::eVerbose | vk::DebugUtilsMessageSeverityFlagBitsEXT::eInfo | vk::DebugUtilsMessageSeverityFlagBitsEXT::eWarning | vk::DebugUtilsMessageSeverityFlagBitsEXT::eError,
-			vk::DebugUtilsMessageTypeFlagBitsEXT::eGeneral | vk::DebugUtilsMessageTypeFlagBitsEXT::ePerformance | vk::DebugUtilsMessageTypeFlagBitsEXT::eValidation,
-			TriangleApp_NS::OnVulkanDebugCallback
-		};
+		// Only covers creating and destroying the instance, the messenger for everything in between is created once it exists
+		vk::DebugUtilsMessengerCreateInfoEXT debug_messenger_info{};
 
 		vk::InstanceCreateInfo create_info{};
 		create_info.setPApplicationInfo(&app_info);
 		create_info.setPEnabledExtensionNames(required_extensions);
-		if (use_validation_layers) {
+		if (debug_sink)
+		{
+			debug_messenger_info = debug_sink->GetMessengerCreateInfo();
 			create_info.setPEnabledLayerNames(validation_layers);
 			assert(create_info.pNext == nullptr);
 			create_info.setPNext(&debug_messenger_info);
@@ -298,7 +636,9 @@ namespace TriangleApp_NS
 		return vk::createInstanceUnique(create_info);
 	}
 
-	[[nodiscard]] auto CreateSwapChain(vk::Device& device, const vk::PhysicalDevice& physical_device, const vk::SurfaceKHR& surface, GLFWwindow* window = nullptr)
+	/// old_swap_chain is handed to the driver when recreating (e.g. the window was resized) so it can reuse resources and keep presenting in the meantime.
+	/// extra_usage is on top of being a colour attachment, whatever of it the surface doesn't support is left out.
+	[[nodiscard]] auto CreateSwapChain(vk::Device& device, const vk::PhysicalDevice& physical_device, const vk::SurfaceKHR& surface, GLFWwindow* window = nullptr, vk::SwapchainKHR old_swap_chain = {}, vk::ImageUsageFlags extra_usage = {})
 	{
 		SwapChainSupportDetails swap_chain_support_details{ physical_device, surface };
 		const auto surface_format{ ChooseSwapSurfaceFormat(swap_chain_support_details.formats) };
@@ -315,7 +655,7 @@ namespace TriangleApp_NS
 		create_info.setImageColorSpace(surface_format.colorSpace);
 		create_info.setImageExtent(extent);
 		create_info.setImageArrayLayers(1);
-		create_info.setImageUsage(vk::ImageUsageFlagBits::eColorAttachment);
+		create_info.setImageUsage(vk::ImageUsageFlagBits::eColorAttachment | (extra_usage & swap_chain_support_details.capabilities.supportedUsageFlags));
 		if (indices.graphics_family.value() != indices.present_family.value())
 		{
 			create_info.setImageSharingMode(vk::SharingMode::eConcurrent);
@@ -330,12 +670,13 @@ namespace TriangleApp_NS
 		create_info.setCompositeAlpha(vk::CompositeAlphaFlagBitsKHR::eOpaque);
 		create_info.setPresentMode(present_mode);
 		create_info.setClipped(VK_TRUE);
-		create_info.setOldSwapchain(VK_NULL_HANDLE); // Previous swap chain which became invalidated (e.g. via window being resized). TODO
+		create_info.setOldSwapchain(old_swap_chain); // Previous swap chain which became invalidated (e.g. via window being resized)
 
 		return std::make_tuple(device.createSwapchainKHRUnique(create_info), surface_format.format, extent);
 	}
 
-	[[nodiscard]] std::tuple<vk::UniqueDevice, vk::PhysicalDevice, QueueFamilyIndices> CreateDevice(vk::Instance& instance, const vk::SurfaceKHR& surface)
+	/// The last elements are whether dynamic rendering and calibrated timestamps got enabled, each only tried when asked for
+	[[nodiscard]] std::tuple<vk::UniqueDevice, vk::PhysicalDevice, QueueFamilyIndices, bool, bool> CreateDevice(vk::Instance& instance, const vk::SurfaceKHR& surface, const bool dedicated_queues, const bool dynamic_rendering, const bool calibrated_timestamps, const bool validation)
 	{
 		const auto physical_devices = instance.enumeratePhysicalDevices();
 		if (physical_devices.empty()) {
@@ -347,62 +688,112 @@ namespace TriangleApp_NS
 			throw std::runtime_error("No suitable physical devices available");
 		}
 
-		const auto indices{ FindQueueFamilies(*best_device, surface) };
-		assert(indices.IsComplete());
+		const bool headless{ !surface };
+		const auto indices{ FindQueueFamilies(*best_device, surface, dedicated_queues) };
+		assert(indices.IsComplete(!headless));
 
 		const float priority{ 1.f };
 		std::vector<vk::DeviceQueueCreateInfo> queues_info;
-		const std::set<uint32_t> unique_families{ indices.graphics_family.value(), indices.present_family.value() };
+		std::set<uint32_t> unique_families{ indices.graphics_family.value() };
+		for (const auto& family : { indices.present_family, indices.transfer_family })
+		{
+			if (family) {
+				unique_families.insert(family.value());
+			}
+		}
 		for (uint32_t family : unique_families) {
 			queues_info.emplace_back(vk::DeviceQueueCreateFlags{}, family, 1U, &priority);
 		}
 
+		// Optional features, only enabled when there
+		const auto supported_features{ best_device->getFeatures() };
 		vk::PhysicalDeviceFeatures features{};
+		features.setPipelineStatisticsQuery(supported_features.pipelineStatisticsQuery);
+		features.setInheritedQueries(supported_features.inheritedQueries); // queries active across secondary command buffers
+		features.setMultiDrawIndirect(supported_features.multiDrawIndirect); // GPU culling, more than one indirect draw per call
+		features.setDrawIndirectFirstInstance(supported_features.drawIndirectFirstInstance); // and each of them starting at its own instance
+		features.setShaderStorageBufferArrayDynamicIndexing(supported_features.shaderStorageBufferArrayDynamicIndexing); // bindless heap, buffer slot from a push constant
+
+		auto device_extensions{ GetRequiredDeviceExtensions(headless) };
+
+		// host query reset lets queues that can't reset queries in a command buffer (transfer only) still take timestamps.
+		// drawIndirectCount and descriptor indexing (for the bindless heap) are core in 1.2 but still optional
+		const auto supported_features12{ best_device->getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>().get<vk::PhysicalDeviceVulkan12Features>() };
+		vk::StructureChain<vk::DeviceCreateInfo, vk::PhysicalDeviceVulkan12Features, vk::PhysicalDeviceDynamicRenderingFeaturesKHR> create_info_chain{};
+		create_info_chain.get<vk::PhysicalDeviceVulkan12Features>()
+			.setTimelineSemaphore(VK_TRUE)
+			.setHostQueryReset(supported_features12.hostQueryReset)
+			.setDrawIndirectCount(supported_features12.drawIndirectCount)
+			.setRuntimeDescriptorArray(supported_features12.runtimeDescriptorArray)
+			.setDescriptorBindingPartiallyBound(supported_features12.descriptorBindingPartiallyBound)
+			.setDescriptorBindingSampledImageUpdateAfterBind(supported_features12.descriptorBindingSampledImageUpdateAfterBind)
+			.setDescriptorBindingStorageBufferUpdateAfterBind(supported_features12.descriptorBindingStorageBufferUpdateAfterBind);
+
+		// Dynamic rendering is an extension before 1.3, so its feature struct only goes in the chain when the extension is there
+		const bool enable_dynamic_rendering{ dynamic_rendering
+			&& CheckDeviceExtensionSupport(*best_device, dynamic_rendering_extensions)
+			&& best_device->getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDynamicRenderingFeaturesKHR>().get<vk::PhysicalDeviceDynamicRenderingFeaturesKHR>().dynamicRendering == VK_TRUE };
+		if (enable_dynamic_rendering)
+		{
+			device_extensions.insert(std::end(device_extensions), std::begin(dynamic_rendering_extensions), std::end(dynamic_rendering_extensions));
+			create_info_chain.get<vk::PhysicalDeviceDynamicRenderingFeaturesKHR>().setDynamicRendering(VK_TRUE);
+		}
+		else {
+			create_info_chain.unlink<vk::PhysicalDeviceDynamicRenderingFeaturesKHR>();
+		}
+
+		// Only useful with a transfer queue to compare against, its device time domain makes timestamps from both queues comparable
+		bool enable_calibrated_timestamps{ false };
+		if (calibrated_timestamps && indices.transfer_family && CheckDeviceExtensionSupport(*best_device, calibrated_timestamp_extensions))
+		{
+			const vk::DispatchLoaderDynamic dispatch{ instance, vkGetInstanceProcAddr }; // for vkGetPhysicalDeviceCalibrateableTimeDomainsEXT, which the loader doesn't export
+			const auto time_domains{ best_device->getCalibrateableTimeDomainsEXT(dispatch) };
+			enable_calibrated_timestamps = std::find(std::begin(time_domains), std::end(time_domains), vk::TimeDomainEXT::eDevice) != std::end(time_domains);
+		}
+		if (enable_calibrated_timestamps) {
+			device_extensions.insert(std::end(device_extensions), std::begin(calibrated_timestamp_extensions), std::end(calibrated_timestamp_extensions));
+		}
 
-		vk::DeviceCreateInfo create_info{};
-		create_info.setPEnabledExtensionNames(required_device_extensions);
+		auto& create_info{ create_info_chain.get<vk::DeviceCreateInfo>() };
+		create_info.setPEnabledExtensionNames(device_extensions);
 		create_info.setPEnabledFeatures(&features);
 		create_info.setQueueCreateInfos(queues_info);
-		if (use_validation_layers) {
+		if (validation) {
 			create_info.setPEnabledLayerNames(validation_layers);
 		}
 
-		return { best_device->createDeviceUnique(create_info), *best_device, indices };
+		return { best_device->createDeviceUnique(create_info), *best_device, indices, enable_dynamic_rendering, enable_calibrated_timestamps };
 	}
 
-	[[nodiscard]] vk::UniqueShaderModule CompileShader(vk::Device& device, shaderc::Compiler& compiler, std::string_view src, shaderc_shader_kind kind, std::string_view name)
+#ifdef RUNTIME_SHADER_COMPILATION
+	[[nodiscard]] std::string ReadTextFile(const std::filesystem::path& path)
 	{
-		const auto result = compiler.CompileGlslToSpv(src.data(), src.size(), kind, name.data());
+		std::ifstream file{ path };
+		if (!file) {
+			throw std::runtime_error("Failed to open '" + path.string() + "'");
+		}
 
-		std::cout << "Shader '" << name << "' compiled with '" << result.GetNumErrors() << "' errors and '" << result.GetNumWarnings() << "' warnings." << '\n';
+		return { std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+	}
 
-		if (result.GetCompilationStatus() != shaderc_compilation_status::shaderc_compilation_status_success)
-		{
-			std::string_view status_type_msg{};
-			switch (result.GetCompilationStatus())
-			{
-				using enum shaderc_compilation_status;
-			case shaderc_compilation_status_success: status_type_msg = "Success"; break;
-			case shaderc_compilation_status_invalid_stage: status_type_msg = "Invalid Stage"; break;
-			case shaderc_compilation_status_compilation_error: status_type_msg = "Compilation Error"; break;
-			case shaderc_compilation_status_internal_error: status_type_msg = "Unexpected Failure"; break;
-			case shaderc_compilation_status_null_result_object: status_type_msg = "Null result object"; break;
-			case shaderc_compilation_status_invalid_assembly: status_type_msg = "Invalid Assembly"; break;
-			case shaderc_compilation_status_validation_error: status_type_msg = "Validation Error"; break;
-			case shaderc_compilation_status_transformation_error: status_type_msg = "Transformation Error"; break;
-			case shaderc_compilation_status_configuration_error: status_type_msg = "Configuration Error"; break;
-			default: status_type_msg = "Unrecognised error code"; break;
-			}
+	/// Every GLSL source under Settings::shader_directory, watched for changes with --watch-shaders
+	constexpr std::array shader_file_names{ "triangle.vert"sv, "triangle.frag"sv, "triangle_bindless.vert"sv, "cull_instances.comp"sv, "compact_draws.comp"sv };
 
-			std::cerr << "Error compiling shader '" << name << "': " << status_type_msg << ". Message: " << result.GetErrorMessage() << '\n';
-		}
+	using ShaderSources = std::unordered_map<std::string, std::string>; // GLSL by file name
 
-		
-		const std::vector<uint32_t> shader_bytecode{ std::begin(result), std::end(result) };
-		return device.createShaderModuleUnique(vk::ShaderModuleCreateInfo{}.setCode(shader_bytecode));
+	/// Has the stages compiled from the GLSL in sources rather than using their embedded SPIR-V
+	void UseShaderSources(std::span<Graphics::ShaderStageDesc> stages, const ShaderSources& sources)
+	{
+		for (auto& stage : stages)
+		{
+			stage.glsl = sources.at(stage.name);
+			stage.spirv = {};
+		}
 	}
+#endif
 
-	[[nodiscard]] vk::UniqueRenderPass CreateRenderPass(vk::Device& device, vk::Format format)
+	/// final_layout is ePresentSrcKHR when rendering to a swap chain, or eTransferSrcOptimal when the result is read back (headless).
+	[[nodiscard]] vk::UniqueRenderPass CreateRenderPass(vk::Device& device, vk::Format format, vk::ImageLayout final_layout = vk::ImageLayout::ePresentSrcKHR)
 	{
 		std::array attachments{
 			vk::AttachmentDescription{}
@@ -413,7 +804,7 @@ namespace TriangleApp_NS
 			.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
 			.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
 			.setInitialLayout(vk::ImageLayout::eUndefined)
-			.setFinalLayout(vk::ImageLayout::ePresentSrcKHR)
+			.setFinalLayout(final_layout)
 		};
 
 		std::array colour_attachment_references{
@@ -428,7 +819,7 @@ namespace TriangleApp_NS
 			.setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
 		};
 
-		std::array dependances{
+		std::vector dependances{
 			vk::SubpassDependency{}
 			.setSrcSubpass(VK_SUBPASS_EXTERNAL)
 			.setDstSubpass(0U)
@@ -438,6 +829,19 @@ namespace TriangleApp_NS
 			.setDstAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
 		};
 
+		// the attachment gets copied out after the pass, make sure the writes are visible to that copy
+		if (final_layout == vk::ImageLayout::eTransferSrcOptimal)
+		{
+			dependances.push_back(vk::SubpassDependency{}
+				.setSrcSubpass(0U)
+				.setDstSubpass(VK_SUBPASS_EXTERNAL)
+				.setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
+				.setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+				.setDstStageMask(vk::PipelineStageFlagBits::eTransfer)
+				.setDstAccessMask(vk::AccessFlagBits::eTransferRead)
+			);
+		}
+
 		return device.createRenderPassUnique(vk::RenderPassCreateInfo{}
 			.setAttachments(attachments)
 			.setSubpasses(subpasses)
@@ -445,121 +849,6 @@ namespace TriangleApp_NS
 		);
 	}
 
-	[[nodiscard]] std::pair<vk::UniquePipeline,vk::UniquePipelineLayout> CreatePipeline(vk::Device& device, shaderc::Compiler& shader_compiler, vk::RenderPass render_pass, vk::Extent2D extent, std::string_view vertex_src, std::string_view fragment_src)
-	{
-		const auto vertex_module = CompileShader(device, shader_compiler, vertex_src, shaderc_shader_kind::shaderc_glsl_vertex_shader, "vertex_shader"); assert(vertex_module);
-		const auto fragment_module = CompileShader(device, shader_compiler, fragment_src, shaderc_shader_kind::shaderc_glsl_fragment_shader, "fragment_shader"); assert(fragment_module);
-
-		std::vector<vk::PipelineShaderStageCreateInfo> stages;
-
-		stages.push_back(vk::PipelineShaderStageCreateInfo{}
-			.setModule(*vertex_module)
-			.setPName("main")
-			.setStage(vk::ShaderStageFlagBits::eVertex))
-			;
-
-		stages.push_back(vk::PipelineShaderStageCreateInfo{}
-			.setModule(*fragment_module)
-			.setPName("main")
-			.setStage(vk::ShaderStageFlagBits::eFragment))
-			;
-
-		auto vertex_input_info = vk::PipelineVertexInputStateCreateInfo{}
-			.setVertexBindingDescriptions({})
-			.setVertexAttributeDescriptions({});
-
-		auto input_assembly = vk::PipelineInputAssemblyStateCreateInfo{}
-			.setTopology(vk::PrimitiveTopology::eTriangleList)
-			.setPrimitiveRestartEnable(VK_FALSE)
-			;
-
-		std::vector<vk::Viewport> viewports{ {0.f, 0.f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.f, 1.f} };
-		std::vector<vk::Rect2D> sissors{ vk::Rect2D{vk::Offset2D{0, 0}, extent} };
-
-		auto viewport_info = vk::PipelineViewportStateCreateInfo{}
-			.setViewports(viewports)
-			.setScissors(sissors)
-			;
-
-		auto rasterizer_info = vk::PipelineRasterizationStateCreateInfo{}
-			.setDepthClampEnable(VK_FALSE)
-			.setPolygonMode(vk::PolygonMode::eFill)
-			.setLineWidth(1.f)
-			.setCullMode(vk::CullModeFlagBits::eBack)
-			.setFrontFace(vk::FrontFace::eClockwise)
-			.setDepthBiasEnable(VK_FALSE)
-			.setDepthBiasConstantFactor(0.f)
-			.setDepthBiasClamp(0.f)
-			.setDepthBiasSlopeFactor(0.f)
-			;
-
-		auto multisampling = vk::PipelineMultisampleStateCreateInfo{}
-			.setSampleShadingEnable(VK_FALSE)
-			.setRasterizationSamples(vk::SampleCountFlagBits::e1)
-			.setMinSampleShading(1.f)
-			.setPSampleMask(nullptr)
-			.setAlphaToCoverageEnable(VK_FALSE)
-			.setAlphaToOneEnable(VK_FALSE)
-			;
-
-		[[maybe_unused]]
-		auto depth_stencil_info = vk::PipelineDepthStencilStateCreateInfo{}
-			;
-
-		auto colour_blend_attachment = vk::PipelineColorBlendAttachmentState{}
-			.setColorWriteMask(vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA)
-			.setBlendEnable(VK_TRUE)
-			.setSrcColorBlendFactor(vk::BlendFactor::eSrcAlpha)
-			.setDstColorBlendFactor(vk::BlendFactor::eOneMinusSrcAlpha)
-			.setColorBlendOp(vk::BlendOp::eAdd)
-			.setSrcAlphaBlendFactor(vk::BlendFactor::eOne)
-			.setDstAlphaBlendFactor(vk::BlendFactor::eZero)
-			.setAlphaBlendOp(vk::BlendOp::eAdd)
-			;
-
-		auto colour_blending = vk::PipelineColorBlendStateCreateInfo{}
-			.setLogicOpEnable(VK_FALSE)
-			.setLogicOp(vk::LogicOp::eCopy)
-			.setAttachments(colour_blend_attachment)
-			.setBlendConstants({ 0, 0, 0, 0 })
-			;
-
-		std::vector<vk::DynamicState> dynamic_states = { vk::DynamicState::eViewport, vk::DynamicState::eLineWidth };
-		[[maybe_unused]]
-		auto dynamic_state = vk::PipelineDynamicStateCreateInfo{}
-			.setDynamicStates(dynamic_states)
-			;
-
-		std::vector<vk::DescriptorSetLayout> layouts{};
-		std::vector<vk::PushConstantRange> push_constant_ranges{};
-		auto pipeline_layout = device.createPipelineLayoutUnique(
-			vk::PipelineLayoutCreateInfo{}
-			.setSetLayouts(layouts)
-			.setPushConstantRanges(push_constant_ranges)
-		);
-
-		auto pipeline_info = vk::GraphicsPipelineCreateInfo{}
-			.setStages(stages)
-			.setPVertexInputState(&vertex_input_info)
-			.setPInputAssemblyState(&input_assembly)
-			.setPViewportState(&viewport_info)
-			.setPRasterizationState(&rasterizer_info)
-			.setPMultisampleState(&multisampling)
-			//.setPDepthStencilState(&depth_stencil_info)
-			.setPColorBlendState(&colour_blending)
-			//.setPDynamicState(&dynamic_state)
-			.setLayout(*pipeline_layout)
-			.setRenderPass(render_pass)
-			.setSubpass(0)
-			.setBasePipelineIndex(-1)
-			.setBasePipelineHandle(VK_NULL_HANDLE)
-			;
-
-		auto [result, pipeline] = device.createGraphicsPipelineUnique(VK_NULL_HANDLE, pipeline_info);
-		assert(result == vk::Result::eSuccess);
-		return { std::move(pipeline), std::move(pipeline_layout) };
-	}
-
 	[[nodiscard]] std::vector<vk::UniqueFramebuffer> CreateSwapChainFrameBuffers(vk::Device& device, vk::RenderPass& render_pass, vk::Extent2D swap_chain_extent, std::span<const vk::UniqueImageView> swap_chain_image_views)
 	{
 		std::vector<vk::UniqueFramebuffer> frame_buffers{};
@@ -580,22 +869,100 @@ namespace TriangleApp_NS
 		return frame_buffers;
 	}
 
-	[[nodiscard]] vk::UniqueCommandPool CreateCommandPool( vk::Device& device, const QueueFamilyIndices& indices )
+	/// Device owned image we render into when running headless, plus a host visible buffer its contents get copied into.
+	struct OffscreenTarget
+	{
+		/// WARNING: Order of members is important! Resources must be destroyed before the memory they are bound to is freed
+		Graphics::Allocation image_memory{};
+		vk::UniqueImage image{};
+		Graphics::Allocation readback_memory{};
+		vk::UniqueBuffer readback_buffer{};
+	};
+
+	[[nodiscard]] OffscreenTarget CreateOffscreenTarget(vk::Device& device, Graphics::MemoryAllocator& allocator, vk::Format format, vk::Extent2D extent)
 	{
-		return device.createCommandPoolUnique(vk::CommandPoolCreateInfo{}
-			.setQueueFamilyIndex(indices.graphics_family.value())
+		OffscreenTarget target{};
+
+		target.image = device.createImageUnique(vk::ImageCreateInfo{}
+			.setImageType(vk::ImageType::e2D)
+			.setFormat(format)
+			.setExtent(vk::Extent3D{ extent.width, extent.height, 1U })
+			.setMipLevels(1U)
+			.setArrayLayers(1U)
+			.setSamples(vk::SampleCountFlagBits::e1)
+			.setTiling(vk::ImageTiling::eOptimal)
+			.setUsage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst) // blitted to with a render scale
+			.setSharingMode(vk::SharingMode::eExclusive)
+			.setInitialLayout(vk::ImageLayout::eUndefined)
+		);
+
+		target.image_memory = allocator.AllocateForImage(*target.image, vk::ImageTiling::eOptimal, Graphics::AllocationDesc{});
+
+		// tightly packed copy of the image, 4 bytes per texel
+		target.readback_buffer = device.createBufferUnique(vk::BufferCreateInfo{}
+			.setSize(vk::DeviceSize{ extent.width } * extent.height * 4U)
+			.setUsage(vk::BufferUsageFlagBits::eTransferDst)
+			.setSharingMode(vk::SharingMode::eExclusive)
 		);
+
+		// read by the CPU, so cached memory when there is some. Invalidated before reading in case it isn't coherent
+		Graphics::AllocationDesc readback_desc{};
+		readback_desc.required_flags = vk::MemoryPropertyFlagBits::eHostVisible;
+		readback_desc.preferred_flags = vk::MemoryPropertyFlagBits::eHostCached;
+		target.readback_memory = allocator.AllocateForBuffer(*target.readback_buffer, readback_desc);
+
+		return target;
 	}
 
-	[[nodiscard]] std::vector<vk::UniqueCommandBuffer> CreateCommandBuffers( vk::Device& device, vk::CommandPool& pool, std::span<const vk::UniqueFramebuffer> frame_buffers)
+	void RecordReadback(vk::CommandBuffer& buffer, const OffscreenTarget& target, vk::Extent2D extent)
 	{
-		return device.allocateCommandBuffersUnique(
-			vk::CommandBufferAllocateInfo{}
-			.setCommandPool(pool)
-			.setLevel(vk::CommandBufferLevel::ePrimary)
-			.setCommandBufferCount(static_cast<uint32_t>(frame_buffers.size()))
+		// render pass (or the render graph) has already transitioned the image to eTransferSrcOptimal
+		buffer.copyImageToBuffer(*target.image, vk::ImageLayout::eTransferSrcOptimal, *target.readback_buffer, vk::BufferImageCopy{}
+			.setBufferOffset(0)
+			.setBufferRowLength(0)
+			.setBufferImageHeight(0)
+			.setImageSubresource(vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, 0U, 0U, 1U })
+			.setImageOffset({ 0, 0, 0 })
+			.setImageExtent({ extent.width, extent.height, 1U })
+		);
+
+		buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, {},
+			vk::BufferMemoryBarrier{}
+			.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eHostRead)
+			.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+			.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+			.setBuffer(*target.readback_buffer)
+			.setOffset(0)
+			.setSize(VK_WHOLE_SIZE),
+			{}
 		);
 	}
+
+	/// Copies the readback buffer of a target to host memory. The GPU must have finished with the target.
+	[[nodiscard]] std::vector<std::byte> ReadbackTarget(const Graphics::MemoryAllocator& allocator, const OffscreenTarget& target, vk::Extent2D extent)
+	{
+		std::vector<std::byte> pixels(std::size_t{ extent.width } * extent.height * 4U);
+
+		allocator.Invalidate(target.readback_memory);
+		std::memcpy(pixels.data(), target.readback_memory.GetMappedData(), pixels.size());
+
+		return pixels;
+	}
+
+	void WriteImageToFile(const std::string& path, std::span<const std::byte> rgba_pixels, vk::Extent2D extent)
+	{
+		std::ofstream file{ path, std::ios::binary };
+		if (!file) {
+			throw std::runtime_error("Failed to open '" + path + "' for writing");
+		}
+
+		// binary PPM, drop the alpha channel
+		file << "P6\n" << extent.width << ' ' << extent.height << "\n255\n";
+		for (std::size_t idx{ 0 }; idx + 3 < rgba_pixels.size(); idx += 4) {
+			file.write(reinterpret_cast<const char*>(&rgba_pixels[idx]), 3);
+		}
+	}
 }
 
 struct TriangleApp::Pimpl
@@ -603,28 +970,157 @@ struct TriangleApp::Pimpl
 	/// WARNING: Order of members is important!
 	/// We rely on C++ calling destructors in reverse of declaration order
 
+	TriangleApp_NS::Settings settings{};
+	std::unique_ptr<Utility::ThreadPool> thread_pool{};
 	std::unique_ptr<GLFWwindow, decltype([](GLFWwindow* window) { glfwDestroyWindow(window); })> window{};
+	std::unique_ptr<Graphics::DebugMessageSink> debug_sink{}; // outlives the instance, destroying it can still report
 	vk::UniqueInstance vk_instance{};
+	vk::DispatchLoaderDynamic debug_utils_dispatch{}; // for vkCreateDebugUtilsMessengerEXT, which the loader doesn't export
+	vk::UniqueHandle<vk::DebugUtilsMessengerEXT, vk::DispatchLoaderDynamic> debug_messenger{};
 	vk::UniqueSurfaceKHR surface{};
+	vk::PhysicalDevice physical_device{};
+	TriangleApp_NS::QueueFamilyIndices queue_families{};
 	vk::UniqueDevice vk_device{};
+	vk::DispatchLoaderDynamic dynamic_rendering_dispatch{}; // for vkCmdBeginRenderingKHR/vkCmdEndRenderingKHR, which the loader doesn't export
+	std::unique_ptr<Graphics::MemoryAllocator> memory_allocator{};
+	vk::UniquePipelineCache pipeline_cache{};
+#ifdef RUNTIME_SHADER_COMPILATION
+	std::unique_ptr<Graphics::ShaderCompileCache> shader_cache{};
+	TriangleApp_NS::ShaderSources shader_sources{}; // what the pipelines in use were compiled from, only replaced once a rebuild succeeds
+#endif
 	vk::Queue graphics_queue{};
 	vk::Queue present_queue{};
+	vk::Queue transfer_queue{}; // the graphics queue when there is no dedicated transfer family
 	vk::UniqueSwapchainKHR swap_chain{};
+	std::vector<TriangleApp_NS::OffscreenTarget> offscreen_targets{}; // only used when headless
+	/// When headless the swap_chain_* members describe the offscreen targets instead, so the rest of the frame code doesn't need to care.
 	std::vector<vk::Image> swap_chain_images{};
 	vk::Format swap_chain_format{};
 	vk::Extent2D swap_chain_extent{};
 	std::vector<vk::UniqueImageView> swap_chain_image_views{};
-	vk::UniqueRenderPass render_pass{};
-	vk::UniquePipelineLayout graphics_pipeline_layout{};
-	vk::UniquePipeline graphics_pipeline{};
-	std::vector<vk::UniqueFramebuffer> swap_chain_frame_buffers{};
-	vk::UniqueCommandPool command_pool{};
-	std::vector<vk::UniqueCommandBuffer> command_buffers;
+	std::unique_ptr<Graphics::UniformRing> uniform_ring{}; // per frame constants
+	uint32_t frame_uniforms_offset{ 0 }; // dynamic offset of the current frame's FrameUniforms
+	std::unique_ptr<Graphics::BindlessHeap> bindless_heap{}; // null unless bindless
+	vk::UniqueRenderPass render_pass{}; // null with dynamic rendering
+	std::unique_ptr<Graphics::PipelineVariantCache> pipeline_variants{};
+	const Graphics::GraphicsPipeline* triangle_pipeline{ nullptr }; // owned by pipeline_variants
+	uint64_t triangle_pipeline_key{ 0 };
+	bool triangle_pipeline_bindless{ false }; // false while the attribute variant stands in for the bindless one
+	std::optional<uint64_t> pending_triangle_key{}; // bindless variant being built in the background
+	TriangleApp_NS::View view{};
+	vk::UniqueDescriptorSetLayout cull_set_layout{}; // source/culled instances, draw commands and counters, null unless GPU culling
+	Graphics::ComputePipeline cull_pipeline{};
+	Graphics::ComputePipeline compact_pipeline{};
+	std::vector<vk::UniqueFramebuffer> swap_chain_frame_buffers{}; // empty with dynamic rendering
+	std::unique_ptr<Graphics::FrameCommandPools> command_pools{}; // per frame in flight and per thread_pool thread
+	std::unique_ptr<Graphics::UploadQueue> upload_queue{};
+	std::unique_ptr<Graphics::RenderGraph> render_graph{}; // null without dynamic rendering
+	Graphics::RenderGraph::Handle graph_target{}; // the swap chain image or offscreen target being rendered to
+	Graphics::RenderGraph::Handle graph_readback{}; // headless only
+	Graphics::RenderGraph::Handle graph_scene{}; // transient image drawn into with a render scale, invalid when drawing straight into the target
+	Graphics::Buffer vertex_buffer{};
+	Graphics::Buffer index_buffer{};
+	Graphics::Buffer instance_buffer{}; // draw_count * instance_count instances, a copy per frame in flight unless static
+	/// GPU culling output, a copy of each per frame in flight
+	Graphics::Buffer culled_instance_buffer{}; // visible instances of each draw packed to the front of its range
+	Graphics::Buffer draw_command_buffer{}; // vk::DrawIndexedIndirectCommand for every draw with anything visible
+	Graphics::Buffer draw_counter_buffer{}; // number of draw commands, then visible instances of each draw
+	vk::UniqueDescriptorPool cull_descriptor_pool{};
+	vk::DescriptorSet cull_descriptor_set{};
+	/// Heap slots of the buffers the bindless vertex shader reads instances from
+	std::optional<uint32_t> instance_slot{};
+	std::optional<uint32_t> culled_instance_slot{};
+	/// Recordings made from each frame's pool, only kept around when reusing command buffers. Cleared when recording_version moves on.
+	struct FrameRecordings
+	{
+		uint64_t version{ 0 };
+		std::vector<std::pair<uint32_t, vk::CommandBuffer>> by_image{};
+	};
+	std::vector<FrameRecordings> frame_recordings{};
+	uint64_t recording_version{ 1 }; // bump whenever something that gets recorded changes
+	std::unique_ptr<Profiling::GpuProfiler> gpu_profiler{}; // one query slot per frame in flight, null unless profiling
+	std::unique_ptr<Profiling::GpuProfiler> transfer_profiler{}; // same for uploads on the transfer queue, null without a dedicated one
+	bool calibrated_timestamps{ false }; // VK_EXT_calibrated_timestamps is enabled, so the two profilers' timestamps can be compared
+	std::optional<Profiling::GpuProfiler::TimestampRange> last_graphics_timestamps{}; // previous frame's, which that frame's uploads could have overlapped
+	std::unique_ptr<Profiling::FrameProfiler> frame_profiler{};
 	std::vector<vk::UniqueSemaphore> image_available_semaphores{};
 	std::vector<vk::UniqueSemaphore> render_finished_semaphores{};
-	std::vector<vk::UniqueFence> in_flight_fences{};
-	std::vector<vk::Fence> images_in_flight{};
-	std::size_t current_frame{};
+	std::unique_ptr<Graphics::FrameScheduler> frame_scheduler{};
+	std::vector<uint64_t> image_frames{}; // frame number that last rendered to each image, 0 if none
+	uint32_t last_submitted_image{};
+	bool framebuffer_resized{ false };
+#ifdef RUNTIME_SHADER_COMPILATION
+	/// Shader hot reload, rebuilds run in the background and are swapped in between frames
+	std::unique_ptr<Utility::FileWatcher> shader_watcher{}; // null unless watching
+	struct TriangleReload
+	{
+		Graphics::GraphicsPipelineDesc desc{};
+		uint64_t key{ 0 };
+	};
+	std::optional<TriangleReload> pending_triangle_reload{}; // built by pipeline_variants
+	struct CullingReload
+	{
+		std::array<Graphics::ComputePipelineDesc, 2> descs{};
+		std::future<Graphics::ComputePipelineBatch> batch{}; // from std::async, so destroying it waits for the build
+	};
+	std::optional<CullingReload> pending_culling_reload{};
+#endif
+	Graphics::DeletionQueue deletion_queue{}; // retired swap chain resources, may hold anything above so has to go first
+
+	/// thread_count includes the calling thread, which takes part in ParallelFor(), so 1 means no pool at all
+	void CreateThreadPool(std::size_t thread_count);
+	/// Sized for the current thread pool, throws away any kept recordings
+	void CreateCommandPools();
+	void CreateImageViews();
+	[[nodiscard]] Graphics::GraphicsPipelineDesc GetTrianglePipelineDesc(bool bindless) const;
+	/// Picks the triangle variant for the current format/render pass and bindless state, building it if there isn't one yet
+	void UpdateTrianglePipeline(bool print_timings);
+	/// Before either is destroyed, the variants made with them go too. Call UpdateTrianglePipeline() after, the current one may be gone
+	void RetireVariantsUsing(uint64_t retire_frame, vk::RenderPass old_render_pass, vk::DescriptorSetLayout old_set_layout);
+	[[nodiscard]] std::array<Graphics::ComputePipelineDesc, 2> GetCullingPipelineDescs() const;
+	void CreateCullingPipelines(bool print_timings);
+#ifdef RUNTIME_SHADER_COMPILATION
+	/// Starts rebuilding the pipelines that use the changed shader files, without waiting for them
+	void ReloadShaders(const std::vector<std::string>& changed);
+	/// Swaps in the rebuilt pipelines that are done, retiring the ones they replace. A failed rebuild leaves the old pipelines in use
+	void FinishShaderReloads();
+#endif
+	void CreateFrameBuffers();
+	/// The frame as a render graph of culling, drawing, upscaling and readback passes, dynamic rendering only. Rebuilt rather than changed
+	/// when what it imports changes, the old one is retired
+	void BuildRenderGraph(bool print_stats);
+	/// Transfer destination when the scene is blitted onto the swap chain images with a render scale
+	[[nodiscard]] vk::ImageUsageFlags GetSwapChainExtraUsage() const noexcept;
+	/// What the scene is drawn at, the target's size scaled by the render scale
+	[[nodiscard]] vk::Extent2D GetRenderExtent() const noexcept;
+	void CreateGeometry();
+	/// Sized for the current draw/instance counts, the old buffer is retired so this can be called between frames
+	void CreateInstanceBuffer();
+	[[nodiscard]] vk::DeviceSize GetInstanceOffset(uint32_t frame_index) const noexcept;
+	/// Culling outputs sized to match the instance buffer, called by CreateInstanceBuffer(). Turns GPU culling off when they'd be too big to bind
+	void CreateCullingBuffers();
+	/// Compute passes filling the frame's draw commands, recorded ahead of the render pass. Making them visible to the draws is up to the caller
+	void RecordCulling(vk::CommandBuffer& cmd, uint32_t frame_index);
+	/// Fills the frame's copy of the instance attributes straight into the staging ring, spread over the thread pool. False when the
+	/// ring is full, leaving the copy as it was
+	bool UploadInstances(uint64_t frame_number, uint32_t frame_index);
+	/// Where the frame's copy of the vertices lives in vertex_buffer
+	[[nodiscard]] vk::DeviceSize GetVertexOffset(uint32_t frame_index) const noexcept;
+	/// Queues an upload of the triangle's vertices into the frame's copy, rotated by the frame number when streaming
+	void UploadVertices(uint64_t frame_number, uint32_t frame_index);
+	/// Either the frame's previous recording for the image when it is still valid, or a freshly recorded buffer from the frame's pool
+	[[nodiscard]] vk::CommandBuffer GetFrameCommandBuffer(uint32_t image_idx, uint32_t frame_index);
+	void RecordFrame(vk::CommandBuffer& cmd, uint32_t image_idx, uint32_t frame_index);
+	/// Everything inside the render pass (or dynamic rendering), either the draws themselves or secondary command buffers recording them
+	void RecordPassContents(vk::CommandBuffer& cmd, uint32_t image_idx, uint32_t frame_index, bool use_secondaries);
+	/// Secondary command buffer drawing [first_draw, first_draw + count) inside the render pass
+	[[nodiscard]] vk::CommandBuffer RecordDrawJob(uint32_t image_idx, uint32_t frame_index, uint32_t first_draw, uint32_t count);
+	void RecordDraws(vk::CommandBuffer& cmd, uint32_t frame_index, uint32_t first_draw, uint32_t count);
+	/// Creates a new swap chain from the old one and rebuilds everything that depends on it.
+	/// The old objects go to the deletion queue so nothing has to wait for the GPU to drain.
+	void RecreateSwapChain();
+	Profiling::FrameTimings DrawFrame();
+	[[nodiscard]] Profiling::Benchmark::Report RunBenchmark();
 };
 
 TriangleApp::TriangleApp()
@@ -634,149 +1130,1663 @@ TriangleApp::TriangleApp()
 
 TriangleApp::~TriangleApp() = default;
 
-void TriangleApp::OnInit([[maybe_unused]] std::span<std::string_view> cli)
+void TriangleApp::OnInit(std::span<std::string_view> cli)
 {
-	glfwInit();
+	const auto startup_begin{ std::chrono::steady_clock::now() };
 
-	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-	pimpl->window.reset(glfwCreateWindow(TriangleApp_NS::window_size.x, TriangleApp_NS::window_size.y, TriangleApp_NS::window_title.data(), nullptr, nullptr));
+	pimpl->settings = TriangleApp_NS::ParseSettings(cli);
+	const bool headless{ pimpl->settings.headless };
 
-	pimpl->vk_instance = TriangleApp_NS::CreateInstance();
-	
-	VkSurfaceKHR surface{};
-	if (const auto result = glfwCreateWindowSurface(*pimpl->vk_instance, pimpl->window.get(), {}, &surface); result != VK_SUCCESS) {
-		throw std::runtime_error("Failed to create window surface");
-	}
-	else {
-		pimpl->surface = vk::UniqueSurfaceKHR(surface, { pimpl->vk_instance.get() });
+	if (!pimpl->settings.trace_path.empty())
+	{
+		Profiling::StartTrace(pimpl->settings.trace_events);
+		Profiling::SetTraceThreadName("main");
 	}
+	const Profiling::TraceScope init_trace{ "OnInit" };
+	// One phase at a time, each ends where the next one is emplaced
+	std::optional<Profiling::TraceScope> phase_trace{ std::in_place, "CreateThreadPool" };
 
-	TriangleApp_NS::QueueFamilyIndices indices{};
-	vk::PhysicalDevice physical_device{};
-	std::tie(pimpl->vk_device, physical_device, indices) = TriangleApp_NS::CreateDevice(*pimpl->vk_instance, surface);
-	assert(pimpl->vk_device);
-	assert(indices.IsComplete());
-
-	pimpl->graphics_queue = pimpl->vk_device->getQueue(indices.graphics_family.value(), 0);
-	pimpl->present_queue = pimpl->vk_device->getQueue(indices.present_family.value(), 0);
-
-	std::tie(pimpl->swap_chain, pimpl->swap_chain_format, pimpl->swap_chain_extent) = TriangleApp_NS::CreateSwapChain(*pimpl->vk_device, physical_device, *pimpl->surface, pimpl->window.get());
-	pimpl->swap_chain_images = pimpl->vk_device->getSwapchainImagesKHR(*pimpl->swap_chain);
-	pimpl->swap_chain_image_views.reserve(pimpl->swap_chain_images.size());
-	std::transform(std::begin(pimpl->swap_chain_images), std::end(pimpl->swap_chain_images), std::back_inserter(pimpl->swap_chain_image_views), [&](vk::Image& image)
-		{
-			vk::ImageViewCreateInfo info{ {}, image, vk::ImageViewType::e2D, pimpl->swap_chain_format };
-			info.setSubresourceRange(vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0U, 1U, 0U, 1U });
-			return pimpl->vk_device->createImageViewUnique(info);
-		});
+	pimpl->CreateThreadPool(pimpl->settings.thread_count);
 
-	pimpl->render_pass = TriangleApp_NS::CreateRenderPass(*pimpl->vk_device, pimpl->swap_chain_format);
+	if (!headless)
+	{
+		phase_trace.emplace("CreateWindow");
+		glfwInit();
 
-	shaderc::Compiler shader_compiler{};
-	std::tie(pimpl->graphics_pipeline, pimpl->graphics_pipeline_layout) = TriangleApp_NS::CreatePipeline(*pimpl->vk_device, shader_compiler, *pimpl->render_pass, pimpl->swap_chain_extent, TriangleApp_NS::vertex_shader_src, TriangleApp_NS::fragment_shader_src);
+		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+		glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+		pimpl->window.reset(glfwCreateWindow(static_cast<int>(pimpl->settings.width), static_cast<int>(pimpl->settings.height), TriangleApp_NS::window_title.data(), nullptr, nullptr));
 
-	pimpl->swap_chain_frame_buffers = TriangleApp_NS::CreateSwapChainFrameBuffers(*pimpl->vk_device, *pimpl->render_pass, pimpl->swap_chain_extent, pimpl->swap_chain_image_views);
-	pimpl->command_pool = TriangleApp_NS::CreateCommandPool(*pimpl->vk_device, indices);
-	pimpl->command_buffers = TriangleApp_NS::CreateCommandBuffers(*pimpl->vk_device, *pimpl->command_pool, pimpl->swap_chain_frame_buffers);
+		// Not every platform reports out of date swap chains on resize, so track it ourselves too
+		glfwSetWindowUserPointer(pimpl->window.get(), pimpl.get());
+		glfwSetFramebufferSizeCallback(pimpl->window.get(), [](GLFWwindow* window, int, int) { static_cast<Pimpl*>(glfwGetWindowUserPointer(window))->framebuffer_resized = true; });
+	}
 
-	// Fill command buffers
-	for (std::size_t idx{ 0 }; auto & buffer : pimpl->command_buffers)
+	phase_trace.emplace("CreateInstance");
+	if (pimpl->settings.validation) {
+		pimpl->debug_sink = std::make_unique<Graphics::DebugMessageSink>(std::cerr, pimpl->settings.debug_messages);
+	}
+	pimpl->vk_instance = TriangleApp_NS::CreateInstance(headless, pimpl->debug_sink.get());
+	if (pimpl->debug_sink)
 	{
-		// Begin recording
-		buffer->begin(vk::CommandBufferBeginInfo{}
-			.setFlags({})
-			.setPInheritanceInfo(nullptr)
-		);
-
-		std::vector<vk::ClearValue> clear_colours{ vk::ClearColorValue{ std::array<float,4>{0.f, 0.f, 0.f, 0.f} } };
+		pimpl->debug_utils_dispatch.init(*pimpl->vk_instance, vkGetInstanceProcAddr);
+		pimpl->debug_messenger = pimpl->vk_instance->createDebugUtilsMessengerEXTUnique(pimpl->debug_sink->GetMessengerCreateInfo(), nullptr, pimpl->debug_utils_dispatch);
+	}
+	
+	if (!headless)
+	{
+		VkSurfaceKHR surface{};
+		if (const auto result = glfwCreateWindowSurface(*pimpl->vk_instance, pimpl->window.get(), {}, &surface); result != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create window surface");
+		}
+		else {
+			pimpl->surface = vk::UniqueSurfaceKHR(surface, { pimpl->vk_instance.get() });
+		}
+	}
 
-		// Starting a render pass
-		buffer->beginRenderPass(vk::RenderPassBeginInfo{}
-			.setRenderPass(*pimpl->render_pass)
-			.setFramebuffer(*pimpl->swap_chain_frame_buffers.at(idx))
-			.setRenderArea({ {0, 0}, pimpl->swap_chain_extent })
-			.setClearValues(clear_colours),
-			vk::SubpassContents::eInline
-		);
+	auto& indices{ pimpl->queue_families };
+	auto& physical_device{ pimpl->physical_device };
+	bool dynamic_rendering{};
+	phase_trace.emplace("CreateDevice");
+	std::tie(pimpl->vk_device, physical_device, indices, dynamic_rendering, pimpl->calibrated_timestamps) = TriangleApp_NS::CreateDevice(*pimpl->vk_instance, pimpl->surface.get(), pimpl->settings.dedicated_queues,
+		pimpl->settings.dynamic_rendering, pimpl->settings.profile, pimpl->settings.validation);
+	assert(pimpl->vk_device);
+	assert(indices.IsComplete(!headless));
 
-		buffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *pimpl->graphics_pipeline);
+	if (dynamic_rendering) {
+		pimpl->dynamic_rendering_dispatch.init(*pimpl->vk_instance, vkGetInstanceProcAddr, *pimpl->vk_device, vkGetDeviceProcAddr);
+	}
+	else if (pimpl->settings.dynamic_rendering)
+	{
+		std::cerr << "Dynamic rendering needs VK_KHR_dynamic_rendering, using a render pass instead\n";
+		pimpl->settings.dynamic_rendering = false;
+	}
+	if (pimpl->settings.render_scale != 1.f && !pimpl->settings.dynamic_rendering)
+	{
+		std::cerr << "--render-scale needs dynamic rendering (the render graph), rendering at full size\n";
+		pimpl->settings.render_scale = 1.f;
+	}
 
-		buffer->draw(3, 1, 0, 0);
+	phase_trace.emplace("CreateAllocator");
+	pimpl->memory_allocator = std::make_unique<Graphics::MemoryAllocator>(*pimpl->vk_device, physical_device, Graphics::MemoryAllocator::Settings{});
 
-		buffer->endRenderPass();
+	if (pimpl->settings.use_pipeline_cache)
+	{
+		phase_trace.emplace("LoadPipelineCache");
+		const auto properties{ physical_device.getProperties() };
+		pimpl->pipeline_cache = Graphics::LoadPipelineCache(*pimpl->vk_device, properties, pimpl->settings.cache_directory / Graphics::GetPipelineCacheFileName(properties));
+	}
 
-		// End recording
-		buffer->end();
+	phase_trace.emplace("CreateQueues");
+	pimpl->graphics_queue = pimpl->vk_device->getQueue(indices.graphics_family.value(), 0);
+	if (!headless) {
+		pimpl->present_queue = pimpl->vk_device->getQueue(indices.present_family.value(), 0);
+	}
+	// Uploads fall back to the graphics queue when there is no transfer family
+	pimpl->transfer_queue = pimpl->vk_device->getQueue(indices.transfer_family.value_or(indices.graphics_family.value()), 0);
 
-		++idx;
+	{
+		const auto describe = [&](const std::optional<uint32_t>& family) { return family ? "family " + std::to_string(*family) + " (dedicated)" : std::string{ "graphics queue" }; };
+		std::cout << "Queues: graphics family " << indices.graphics_family.value();
+		if (indices.present_family) {
+			std::cout << ", present family " << indices.present_family.value();
+		}
+		std::cout << ", transfer on " << describe(indices.transfer_family) << '\n';
 	}
 
-	// Create semaphores so we can synchronize the draw commands and presentation queues
+	if (pimpl->settings.gpu_culling)
+	{
+		const auto features{ physical_device.getFeatures() };
+		const auto features12{ physical_device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>().get<vk::PhysicalDeviceVulkan12Features>() };
+		if (features.multiDrawIndirect != VK_TRUE || features.drawIndirectFirstInstance != VK_TRUE || features12.drawIndirectCount != VK_TRUE)
+		{
+			std::cerr << "GPU culling needs multiDrawIndirect, drawIndirectFirstInstance and drawIndirectCount, drawing from the CPU instead\n";
+			pimpl->settings.gpu_culling = false;
+		}
+	}
+	if (pimpl->settings.bindless)
 	{
-		pimpl->image_available_semaphores.reserve(TriangleApp_NS::max_frames_in_flight);
-		pimpl->render_finished_semaphores.reserve(TriangleApp_NS::max_frames_in_flight);
-		pimpl->in_flight_fences.reserve(TriangleApp_NS::max_frames_in_flight);
+		if (Graphics::BindlessHeap::IsSupported(physical_device)) {
+			pimpl->bindless_heap = std::make_unique<Graphics::BindlessHeap>(*pimpl->vk_device, physical_device);
+		}
+		else
+		{
+			std::cerr << "Bindless needs shaderStorageBufferArrayDynamicIndexing, runtimeDescriptorArray, descriptorBindingPartiallyBound and update after bind for sampled images and storage buffers, using vertex attributes instead\n";
+			pimpl->settings.bindless = false;
+		}
+	}
+	pimpl->view.scale = glm::vec2{ pimpl->settings.zoom };
+	pimpl->uniform_ring = std::make_unique<Graphics::UniformRing>(*pimpl->vk_device, physical_device, *pimpl->memory_allocator, pimpl->settings.frames_in_flight, TriangleApp_NS::uniform_bytes_per_frame);
 
-		std::generate_n(std::back_inserter(pimpl->image_available_semaphores), TriangleApp_NS::max_frames_in_flight, [this]() { return pimpl->vk_device->createSemaphoreUnique(vk::SemaphoreCreateInfo{}); });
-		std::generate_n(std::back_inserter(pimpl->render_finished_semaphores), TriangleApp_NS::max_frames_in_flight, [this]() { return pimpl->vk_device->createSemaphoreUnique(vk::SemaphoreCreateInfo{}); });
-		std::generate_n(std::back_inserter(pimpl->in_flight_fences), TriangleApp_NS::max_frames_in_flight, [this]() { return pimpl->vk_device->createFenceUnique(vk::FenceCreateInfo{ vk::FenceCreateFlagBits::eSignaled }); });
+	phase_trace.emplace("CreateSwapChain");
+	if (headless)
+	{
+		pimpl->swap_chain_format = TriangleApp_NS::headless_format;
+		pimpl->swap_chain_extent = vk::Extent2D{ pimpl->settings.width, pimpl->settings.height };
 
-		pimpl->images_in_flight.resize(pimpl->swap_chain_images.size(), {}); // no frames are using an image yet so these are initialised to be empty
+		// one target per frame in flight so consecutive frames don't have to wait on each other
+		pimpl->offscreen_targets.reserve(pimpl->settings.frames_in_flight);
+		std::generate_n(std::back_inserter(pimpl->offscreen_targets), pimpl->settings.frames_in_flight, [&]() { return TriangleApp_NS::CreateOffscreenTarget(*pimpl->vk_device, *pimpl->memory_allocator, pimpl->swap_chain_format, pimpl->swap_chain_extent); });
+		std::transform(std::begin(pimpl->offscreen_targets), std::end(pimpl->offscreen_targets), std::back_inserter(pimpl->swap_chain_images), [](const TriangleApp_NS::OffscreenTarget& target) { return *target.image; });
 	}
-}
-
-void TriangleApp::MainLoop()
-{
-	while (!glfwWindowShouldClose(pimpl->window.get()))
+	else
 	{
-		glfwPollEvents();
+		std::tie(pimpl->swap_chain, pimpl->swap_chain_format, pimpl->swap_chain_extent) = TriangleApp_NS::CreateSwapChain(*pimpl->vk_device, physical_device, *pimpl->surface, pimpl->window.get(), {}, pimpl->GetSwapChainExtraUsage());
+		pimpl->swap_chain_images = pimpl->vk_device->getSwapchainImagesKHR(*pimpl->swap_chain);
+	}
 
-		// Do a frame
-		{
-			auto& fence = pimpl->in_flight_fences.at(pimpl->current_frame).get();
-			auto& image_available_semaphore = pimpl->image_available_semaphores.at(pimpl->current_frame).get();
-			auto& render_finished_semaphore = pimpl->render_finished_semaphores.at(pimpl->current_frame).get();
+	pimpl->CreateImageViews();
+	if (!pimpl->settings.dynamic_rendering) {
+		pimpl->render_pass = TriangleApp_NS::CreateRenderPass(*pimpl->vk_device, pimpl->swap_chain_format, headless ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR);
+	}
 
-			const auto fence_result = pimpl->vk_device->waitForFences(fence, VK_TRUE, std::numeric_limits<uint64_t>::max()); assert(fence_result == vk::Result::eSuccess);
+#ifdef RUNTIME_SHADER_COMPILATION
+	if (pimpl->settings.compile_shaders_at_runtime) {
+		phase_trace.emplace("LoadShaders");
+		pimpl->shader_cache = std::make_unique<Graphics::ShaderCompileCache>(pimpl->settings.use_shader_cache ? pimpl->settings.cache_directory / "shaders" : std::filesystem::path{});
 
-			const auto [acquire_result, image_idx] = pimpl->vk_device->acquireNextImageKHR(pimpl->swap_chain.get(), std::numeric_limits<uint64_t>::max(), image_available_semaphore, VK_NULL_HANDLE);
-			assert(acquire_result == vk::Result::eSuccess);
+		// Watched from before the sources are read, so an edit in between is still picked up
+		if (pimpl->settings.watch_shaders) {
+			pimpl->shader_watcher = std::make_unique<Utility::FileWatcher>(pimpl->settings.shader_directory, std::vector<std::string>(std::begin(TriangleApp_NS::shader_file_names), std::end(TriangleApp_NS::shader_file_names)));
+		}
+		for (const auto name : TriangleApp_NS::shader_file_names) {
+			pimpl->shader_sources.emplace(name, TriangleApp_NS::ReadTextFile(pimpl->settings.shader_directory / name));
+		}
+	}
+	else if (pimpl->settings.watch_shaders)
+	{
+		std::cerr << "Watching shaders needs them compiled at runtime, not watching with --embedded-shaders\n";
+		pimpl->settings.watch_shaders = false;
+	}
+#endif
+	phase_trace.emplace("CreatePipelines");
+	{
+		Graphics::PipelineBatchOptions batch_options{};
+		batch_options.thread_pool = pimpl->settings.serial_pipeline_creation ? nullptr : pimpl->thread_pool.get();
+		batch_options.single_create_call = pimpl->settings.single_pipeline_create_call;
+#ifdef RUNTIME_SHADER_COMPILATION
+		batch_options.shader_cache = pimpl->shader_cache.get();
+#endif
+		pimpl->pipeline_variants = std::make_unique<Graphics::PipelineVariantCache>(*pimpl->vk_device, pimpl->pipeline_cache.get(), batch_options);
+	}
+	pimpl->UpdateTrianglePipeline(true);
+	if (pimpl->settings.gpu_culling) {
+		pimpl->CreateCullingPipelines(true);
+	}
 
-			auto& image_in_flight_fence = pimpl->images_in_flight.at(image_idx);
+	phase_trace.emplace("CreateCommandPools");
+	pimpl->CreateCommandPools();
+	phase_trace.emplace("CreateGeometry");
+	pimpl->CreateGeometry();
 
-			// Check if a previous frame is still using this image (i.e. there is a fence, wait for it)
-			if (image_in_flight_fence) {
-				const auto result = pimpl->vk_device->waitForFences(image_in_flight_fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
-				assert(result == vk::Result::eSuccess);
+	if (pimpl->settings.profile)
+	{
+		phase_trace.emplace("CreateProfilers");
+		// The statistics query spans the whole render pass, so it has to be inherited by secondary command buffers when those are used
+		const auto features{ physical_device.getFeatures() };
+		const bool pipeline_statistics{ features.pipelineStatisticsQuery == VK_TRUE && (!pimpl->settings.secondary_command_buffers || features.inheritedQueries == VK_TRUE) };
+		pimpl->gpu_profiler = std::make_unique<Profiling::GpuProfiler>(*pimpl->vk_device, physical_device, indices.graphics_family.value(), pimpl->settings.frames_in_flight, pipeline_statistics);
+		if (pimpl->upload_queue->UsesTransferQueue())
+		{
+			const auto features12{ physical_device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>().get<vk::PhysicalDeviceVulkan12Features>() };
+			pimpl->transfer_profiler = std::make_unique<Profiling::GpuProfiler>(*pimpl->vk_device, physical_device, indices.transfer_family.value(), pimpl->settings.frames_in_flight, false, features12.hostQueryReset == VK_TRUE);
+			pimpl->upload_queue->SetProfiler(pimpl->transfer_profiler.get());
+			if (!pimpl->calibrated_timestamps) {
+				std::cerr << "Measuring how long uploads overlap graphics work needs VK_EXT_calibrated_timestamps, only reporting how many finished before the graphics submission\n";
 			}
+		}
 
-			// mark this image as being used
-			image_in_flight_fence = fence;
+		Profiling::FrameProfiler::Settings profiler_settings{};
+		profiler_settings.dump_interval = std::chrono::duration<double>{ pimpl->settings.profile_interval };
+		profiler_settings.json_path = pimpl->settings.profile_json_path;
+		pimpl->frame_profiler = std::make_unique<Profiling::FrameProfiler>(std::move(profiler_settings));
+	}
 
-			std::array wait_semaphores{ image_available_semaphore };
-			std::array signal_semaphores{ render_finished_semaphore };
+	if (pimpl->settings.dynamic_rendering)
+	{
+		phase_trace.emplace("BuildRenderGraph");
+		pimpl->BuildRenderGraph(true);
+	}
+	else
+	{
+		phase_trace.emplace("CreateFrameBuffers");
+		pimpl->CreateFrameBuffers();
+	}
 
-			vk::PipelineStageFlags wait_stages{ vk::PipelineStageFlagBits::eColorAttachmentOutput };
+	// Create semaphores so we can synchronize the draw commands and presentation queues
+	phase_trace.emplace("CreateSyncObjects");
+	{
+		const auto frames_in_flight{ pimpl->settings.frames_in_flight };
+		pimpl->frame_scheduler = std::make_unique<Graphics::FrameScheduler>(*pimpl->vk_device, frames_in_flight);
 
-			// Draw frame
-			pimpl->vk_device->resetFences(fence);
-			pimpl->graphics_queue.submit(vk::SubmitInfo{ wait_semaphores, wait_stages, pimpl->command_buffers.at(image_idx).get(), signal_semaphores }, fence);
+		// nothing is acquired or presented when headless. Swap chains only work with binary semaphores so these stay alongside the timeline
+		if (!headless)
+		{
+			pimpl->image_available_semaphores.reserve(frames_in_flight);
+			pimpl->render_finished_semaphores.reserve(frames_in_flight);
 
-			// Present
-			const auto present_result = pimpl->present_queue.presentKHR(vk::PresentInfoKHR{ signal_semaphores, pimpl->swap_chain.get(), image_idx });
-			assert(present_result == vk::Result::eSuccess);
+			std::generate_n(std::back_inserter(pimpl->image_available_semaphores), frames_in_flight, [this]() { return pimpl->vk_device->createSemaphoreUnique(vk::SemaphoreCreateInfo{}); });
+			std::generate_n(std::back_inserter(pimpl->render_finished_semaphores), frames_in_flight, [this]() { return pimpl->vk_device->createSemaphoreUnique(vk::SemaphoreCreateInfo{}); });
 		}
 
-		pimpl->current_frame = (pimpl->current_frame + 1) % TriangleApp_NS::max_frames_in_flight;
+		pimpl->image_frames.resize(pimpl->swap_chain_images.size(), 0); // no frames are using an image yet
 	}
+	phase_trace.reset();
 
-	pimpl->vk_device->waitIdle();
+	const std::chrono::duration<double, std::milli> startup_time{ std::chrono::steady_clock::now() - startup_begin };
+	std::cout << "Startup took " << startup_time.count() << "ms\n";
 }
 
-void TriangleApp::OnDeinit()
+void TriangleApp::Pimpl::CreateThreadPool(const std::size_t thread_count)
+{
+	thread_pool.reset();
+	if (thread_count > 1) {
+		thread_pool = std::make_unique<Utility::ThreadPool>(thread_count - 1);
+	}
+	if (pipeline_variants && !settings.serial_pipeline_creation) {
+		pipeline_variants->SetThreadPool(thread_pool.get());
+	}
+}
+
+void TriangleApp::Pimpl::CreateCommandPools()
+{
+	const std::size_t recording_threads{ thread_pool ? thread_pool->GetThreadCount() + 1 : 1 };
+	command_pools = std::make_unique<Graphics::FrameCommandPools>(*vk_device, queue_families.graphics_family.value(), settings.frames_in_flight, recording_threads);
+
+	frame_recordings.clear();
+	frame_recordings.resize(settings.frames_in_flight);
+	++recording_version;
+}
+
+void TriangleApp::Pimpl::CreateImageViews()
 {
-	pimpl.reset();
+	swap_chain_image_views.reserve(swap_chain_images.size());
+	std::transform(std::begin(swap_chain_images), std::end(swap_chain_images), std::back_inserter(swap_chain_image_views), [&](vk::Image& image)
+		{
+			vk::ImageViewCreateInfo info{ {}, image, vk::ImageViewType::e2D, swap_chain_format };
+			info.setSubresourceRange(vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0U, 1U, 0U, 1U });
+			return vk_device->createImageViewUnique(info);
+		});
+}
 
-	glfwTerminate();
+Graphics::GraphicsPipelineDesc TriangleApp::Pimpl::GetTrianglePipelineDesc(const bool bindless) const
+{
+	Graphics::GraphicsPipelineDesc triangle_desc{};
+	triangle_desc.name = bindless ? "triangle_bindless" : "triangle";
+	if (settings.dynamic_rendering) {
+		triangle_desc.colour_attachment_formats = { swap_chain_format };
+	}
+	else {
+		triangle_desc.render_pass = *render_pass;
+	}
+	triangle_desc.vertex_bindings = {
+		vk::VertexInputBindingDescription{ 0, static_cast<uint32_t>(sizeof(TriangleApp_NS::Vertex)), vk::VertexInputRate::eVertex },
+		vk::VertexInputBindingDescription{ 1, static_cast<uint32_t>(sizeof(TriangleApp_NS::InstanceData)), vk::VertexInputRate::eInstance },
+	};
+	triangle_desc.vertex_attributes = {
+		vk::VertexInputAttributeDescription{ 0, 0, vk::Format::eR32G32Sfloat, static_cast<uint32_t>(offsetof(TriangleApp_NS::Vertex, position)) },
+		vk::VertexInputAttributeDescription{ 1, 0, vk::Format::eR32G32B32Sfloat, static_cast<uint32_t>(offsetof(TriangleApp_NS::Vertex, colour)) },
+		vk::VertexInputAttributeDescription{ 2, 1, vk::Format::eR32G32Sfloat, static_cast<uint32_t>(offsetof(TriangleApp_NS::InstanceData, offset)) },
+		vk::VertexInputAttributeDescription{ 3, 1, vk::Format::eR16G16Sfloat, static_cast<uint32_t>(offsetof(TriangleApp_NS::InstanceData, scale_rotation)) },
+		vk::VertexInputAttributeDescription{ 4, 1, vk::Format::eR8G8B8A8Unorm, static_cast<uint32_t>(offsetof(TriangleApp_NS::InstanceData, colour)) },
+	};
+	triangle_desc.set_layouts = { uniform_ring->GetLayout() };
+	triangle_desc.push_constant_ranges = { vk::PushConstantRange{ vk::ShaderStageFlagBits::eVertex, 0, TriangleApp_NS::GetDrawConstantsSize(bindless) } };
+	triangle_desc.stages = {
+		Graphics::ShaderStageDesc{ vk::ShaderStageFlagBits::eVertex, "triangle.vert", Shaders::triangle_vert },
+		Graphics::ShaderStageDesc{ vk::ShaderStageFlagBits::eFragment, "triangle.frag", Shaders::triangle_frag },
+	};
+	if (bindless)
+	{
+		// Instances come out of the heap, only the vertices are still attributes
+		assert(bindless_heap);
+		triangle_desc.vertex_bindings.resize(1);
+		triangle_desc.vertex_attributes.resize(2);
+		triangle_desc.set_layouts.push_back(bindless_heap->GetLayout());
+		triangle_desc.stages.front() = Graphics::ShaderStageDesc{ vk::ShaderStageFlagBits::eVertex, "triangle_bindless.vert", Shaders::triangle_bindless_vert };
+	}
+
+#ifdef RUNTIME_SHADER_COMPILATION
+	// The source is part of the variant's key, so an edited shader gets a variant of its own
+	if (shader_cache) {
+		TriangleApp_NS::UseShaderSources(triangle_desc.stages, shader_sources);
+	}
+#endif
+
+	return triangle_desc;
+}
+
+void TriangleApp::Pimpl::RetireVariantsUsing(const uint64_t retire_frame, const vk::RenderPass old_render_pass, const vk::DescriptorSetLayout old_set_layout)
+{
+	auto evicted{ pipeline_variants->EvictUsing(old_render_pass, old_set_layout) };
+	if (evicted.empty()) {
+		return;
+	}
+
+	// A new variant may be built at the address of the old one, which must still count as a change
+	triangle_pipeline = nullptr;
+	for (auto& variant : evicted) {
+		deletion_queue.Retire(retire_frame, std::move(variant));
+	}
+}
+
+void TriangleApp::Pimpl::UpdateTrianglePipeline(const bool print_timings)
+{
+	bool bindless{ bindless_heap != nullptr };
+	const Graphics::PipelineVariantCache::Variant* variant{ nullptr };
+	uint64_t key{ 0 };
+	pending_triangle_key.reset();
+
+	if (bindless && settings.async_pipelines && thread_pool)
+	{
+		// The attribute variant draws the same thing from the same instance buffer, so it stands in until the bindless one is built
+		const auto bindless_desc{ GetTrianglePipelineDesc(true) };
+		key = Graphics::PipelineVariantCache::GetKey(bindless_desc);
+		variant = pipeline_variants->Request(bindless_desc, *thread_pool);
+		if (!variant)
+		{
+			if (pipeline_variants->IsPending(key)) {
+				pending_triangle_key = key;
+			}
+			else {
+				std::cerr << "Bindless pipeline failed to build, drawing with vertex attributes\n";
+			}
+			bindless = false;
+		}
+	}
+	if (!variant)
+	{
+		const auto desc{ GetTrianglePipelineDesc(bindless) };
+		key = Graphics::PipelineVariantCache::GetKey(desc);
+		variant = &pipeline_variants->Get(desc);
+	}
+
+	if (triangle_pipeline != &variant->pipeline)
+	{
+		triangle_pipeline = &variant->pipeline;
+		triangle_pipeline_key = key;
+		triangle_pipeline_bindless = bindless;
+		++recording_version; // kept recordings bind the old variant
+	}
+
+	if (!print_timings) {
+		return;
+	}
+
+	std::string_view shader_source{ "embedded SPIR-V" };
+#ifdef RUNTIME_SHADER_COMPILATION
+	if (shader_cache) {
+		shader_source = "runtime shaderc";
+	}
+#endif
+	std::cout << "Shaders from " << shader_source << ". ";
+	variant->timings.Print(std::cout);
+	if (pending_triangle_key) {
+		std::cout << "Building the bindless pipeline in the background, drawing with vertex attributes until it is ready\n";
+	}
+
+#ifdef RUNTIME_SHADER_COMPILATION
+	if (shader_cache)
+	{
+		const auto statistics{ shader_cache->GetStatistics() };
+		std::cout << "Shader cache: " << statistics.memory_hits << " memory hits, " << statistics.disk_hits << " disk hits, " << statistics.compiles << " compiled\n";
+	}
+#endif
+}
+
+std::array<Graphics::ComputePipelineDesc, 2> TriangleApp::Pimpl::GetCullingPipelineDescs() const
+{
+	// Both passes get identical (so compatible) layouts, the descriptor set and push constants stay bound across them
+	std::array<Graphics::ComputePipelineDesc, 2> descs{};
+	descs[0].name = "cull_instances";
+	descs[0].stage = Graphics::ShaderStageDesc{ vk::ShaderStageFlagBits::eCompute, "cull_instances.comp", Shaders::cull_instances_comp };
+	descs[1].name = "compact_draws";
+	descs[1].stage = Graphics::ShaderStageDesc{ vk::ShaderStageFlagBits::eCompute, "compact_draws.comp", Shaders::compact_draws_comp };
+	for (auto& desc : descs)
+	{
+		desc.set_layouts = { *cull_set_layout };
+		desc.push_constant_ranges = { vk::PushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, static_cast<uint32_t>(sizeof(TriangleApp_NS::CullPushConstants)) } };
+#ifdef RUNTIME_SHADER_COMPILATION
+		if (shader_cache) {
+			TriangleApp_NS::UseShaderSources(std::span{ &desc.stage, 1 }, shader_sources);
+		}
+#endif
+	}
+	return descs;
+}
+
+void TriangleApp::Pimpl::CreateCullingPipelines(const bool print_timings)
+{
+	const std::array bindings{
+		vk::DescriptorSetLayoutBinding{ 0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+		vk::DescriptorSetLayoutBinding{ 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+		vk::DescriptorSetLayoutBinding{ 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+		vk::DescriptorSetLayoutBinding{ 3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+	};
+	cull_set_layout = vk_device->createDescriptorSetLayoutUnique(vk::DescriptorSetLayoutCreateInfo{}.setBindings(bindings));
+	const auto descs{ GetCullingPipelineDescs() };
+
+	Graphics::PipelineBatchOptions batch_options{};
+	batch_options.thread_pool = settings.serial_pipeline_creation ? nullptr : thread_pool.get();
+	batch_options.single_create_call = settings.single_pipeline_create_call;
+#ifdef RUNTIME_SHADER_COMPILATION
+	batch_options.shader_cache = shader_cache.get();
+#endif
+
+	auto batch = Graphics::CreateComputePipelines(*vk_device, pipeline_cache.get(), descs, batch_options);
+	cull_pipeline = std::move(batch.pipelines[0]);
+	compact_pipeline = std::move(batch.pipelines[1]);
+
+	if (print_timings) {
+		batch.timings.Print(std::cout);
+	}
+}
+
+#ifdef RUNTIME_SHADER_COMPILATION
+void TriangleApp::Pimpl::ReloadShaders(const std::vector<std::string>& changed)
+{
+	std::cout << "Shaders changed:";
+	for (const auto& name : changed) {
+		std::cout << ' ' << name;
+	}
+	std::cout << '\n';
+
+	const Profiling::TraceScope trace{ "ReloadShaders" };
+
+	// Read now but only kept once a pipeline has built from them, so a broken edit leaves the old pipelines drawing
+	auto sources{ shader_sources };
+	for (const auto& name : changed)
+	{
+		try {
+			sources[name] = TriangleApp_NS::ReadTextFile(settings.shader_directory / name);
+		}
+		catch (const std::exception& e) {
+			std::cerr << e.what() << ", keeping the previous source\n";
+		}
+	}
+
+	// Unchanged sources give the same key, so only a pipeline that uses one of the edited files is rebuilt
+	auto triangle_desc{ GetTrianglePipelineDesc(triangle_pipeline_bindless) };
+	TriangleApp_NS::UseShaderSources(triangle_desc.stages, sources);
+	const auto triangle_key{ Graphics::PipelineVariantCache::GetKey(triangle_desc) };
+	if (triangle_key != triangle_pipeline_key)
+	{
+		if (thread_pool) {
+			[[maybe_unused]] const auto* variant{ pipeline_variants->Request(triangle_desc, *thread_pool) };
+		}
+		else
+		{
+			// Nowhere to build it in the background, this frame pays for it instead
+			try {
+				[[maybe_unused]] const auto& variant{ pipeline_variants->Get(triangle_desc) };
+			}
+			catch (const std::exception& e) {
+				std::cerr << e.what() << '\n';
+			}
+		}
+		pending_triangle_reload = TriangleReload{ std::move(triangle_desc), triangle_key };
+	}
+
+	if (settings.gpu_culling)
+	{
+		auto descs{ GetCullingPipelineDescs() };
+		const bool culling_changed{ std::any_of(std::begin(descs), std::end(descs), [&](const Graphics::ComputePipelineDesc& desc)
+			{
+				return std::find(std::begin(changed), std::end(changed), desc.stage.name) != std::end(changed);
+			}) };
+		if (culling_changed)
+		{
+			for (auto& desc : descs) {
+				TriangleApp_NS::UseShaderSources(std::span{ &desc.stage, 1 }, sources);
+			}
+
+			// A thread of its own rather than the pool, so the future waits for the build if the app goes first
+			Graphics::PipelineBatchOptions batch_options{};
+			batch_options.shader_cache = shader_cache.get();
+			auto batch{ std::async(std::launch::async, [device = *vk_device, cache = pipeline_cache.get(), descs, batch_options]() mutable
+				{
+					return Graphics::CreateComputePipelines(device, cache, descs, batch_options);
+				}) };
+			pending_culling_reload = CullingReload{ std::move(descs), std::move(batch) };
+		}
+	}
+}
+
+void TriangleApp::Pimpl::FinishShaderReloads()
+{
+	// Frames up to the last submitted one may still be using the replaced pipelines
+	const uint64_t retire_frame{ frame_scheduler->GetFrameNumber() };
+
+	if (pending_triangle_reload && !pipeline_variants->IsPending(pending_triangle_reload->key))
+	{
+		if (pipeline_variants->Find(pending_triangle_reload->key) != nullptr)
+		{
+			for (const auto& stage : pending_triangle_reload->desc.stages) {
+				shader_sources[stage.name] = stage.glsl;
+			}
+
+			// Selects the variant just built from the new sources. Nothing will ask for the old sources' one again
+			const auto old_key{ triangle_pipeline_key };
+			UpdateTrianglePipeline(false);
+			if (triangle_pipeline_key != old_key)
+			{
+				if (auto old_variant{ pipeline_variants->Evict(old_key) }) {
+					deletion_queue.Retire(retire_frame, std::move(*old_variant));
+				}
+			}
+			std::cout << "Reloaded pipeline '" << pending_triangle_reload->desc.name << "'\n";
+		}
+		else {
+			std::cerr << "Pipeline '" << pending_triangle_reload->desc.name << "' failed to rebuild, keeping the old one\n";
+		}
+		pending_triangle_reload.reset();
+	}
+
+	if (pending_culling_reload && pending_culling_reload->batch.wait_for(std::chrono::seconds{ 0 }) == std::future_status::ready)
+	{
+		try
+		{
+			auto batch{ pending_culling_reload->batch.get() };
+			for (const auto& desc : pending_culling_reload->descs) {
+				shader_sources[desc.stage.name] = desc.stage.glsl;
+			}
+
+			deletion_queue.Retire(retire_frame, std::move(cull_pipeline));
+			deletion_queue.Retire(retire_frame, std::move(compact_pipeline));
+			cull_pipeline = std::move(batch.pipelines[0]);
+			compact_pipeline = std::move(batch.pipelines[1]);
+			++recording_version;
+			std::cout << "Reloaded the culling pipelines\n";
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Culling pipelines failed to rebuild, keeping the old ones: " << e.what() << '\n';
+		}
+		pending_culling_reload.reset();
+	}
+}
+#endif
+
+void TriangleApp::Pimpl::CreateFrameBuffers()
+{
+	swap_chain_frame_buffers = TriangleApp_NS::CreateSwapChainFrameBuffers(*vk_device, *render_pass, swap_chain_extent, swap_chain_image_views);
+}
+
+void TriangleApp::Pimpl::CreateGeometry()
+{
+	// Big enough for every frame in flight's instances, plus one more as a wrap around can waste up to a whole upload at the end of the ring
+	const uint64_t max_instances{ settings.instance_stress ? settings.max_instances : uint64_t{ settings.draw_count } * settings.instance_count };
+	const vk::DeviceSize instance_staging{ max_instances * sizeof(TriangleApp_NS::InstanceData) * (settings.frames_in_flight + 1) + (1 << 20) };
+	const vk::DeviceSize staging_size{ std::max(vk::DeviceSize{ settings.staging_size_mib } << 20, instance_staging) };
+
+	const uint32_t transfer_family{ queue_families.transfer_family.value_or(queue_families.graphics_family.value()) };
+	upload_queue = std::make_unique<Graphics::UploadQueue>(*vk_device, *memory_allocator, transfer_queue, transfer_family, queue_families.graphics_family.value(), settings.frames_in_flight, staging_size);
+
+	// Streamed vertices get a copy per frame in flight, so a frame's upload never touches what the frames still in flight are reading.
+	// That is what lets the transfer queue run ahead without waiting on the graphics queue.
+	const uint32_t vertex_copies{ settings.stream_geometry ? settings.frames_in_flight : 1 };
+	vertex_buffer = Graphics::CreateBuffer(*vk_device, *memory_allocator, sizeof(TriangleApp_NS::triangle_vertices) * vertex_copies, vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst);
+	index_buffer = Graphics::CreateBuffer(*vk_device, *memory_allocator, sizeof(TriangleApp_NS::triangle_indices), vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst);
+
+	// Goes out with the first frame's submission
+	for (uint32_t copy{ 0 }; copy < vertex_copies; ++copy) {
+		UploadVertices(0, copy);
+	}
+	if (!upload_queue->Upload(*index_buffer.buffer, 0, std::span{ TriangleApp_NS::triangle_indices })) {
+		throw std::runtime_error("Staging ring too small for the initial geometry");
+	}
+
+	CreateInstanceBuffer();
+}
+
+void TriangleApp::Pimpl::CreateInstanceBuffer()
+{
+	const uint64_t retire_frame{ frame_scheduler ? frame_scheduler->GetFrameNumber() : 0 };
+	if (instance_buffer.buffer) {
+		deletion_queue.Retire(retire_frame, std::move(instance_buffer));
+	}
+	if (instance_slot)
+	{
+		bindless_heap->Free(Graphics::BindlessType::eStorageBuffer, *instance_slot, retire_frame);
+		instance_slot.reset();
+	}
+	++recording_version; // kept recordings bind the old buffer
+
+	const vk::DeviceSize instance_bytes{ vk::DeviceSize{ settings.draw_count } * settings.instance_count * sizeof(TriangleApp_NS::InstanceData) };
+	const uint32_t copies{ settings.static_instances ? 1 : settings.frames_in_flight };
+
+	// The heap binds whole buffers, so the instances and the culled instances (one copy per frame in flight) each have to fit in a
+	// single storage buffer binding. Fall back to vertex attributes when they don't
+	const vk::DeviceSize culled_bytes{ settings.gpu_culling ? instance_bytes * settings.frames_in_flight : 0 };
+	if (bindless_heap && std::max(instance_bytes * copies, culled_bytes) > physical_device.getProperties().limits.maxStorageBufferRange)
+	{
+		std::cerr << "Instances exceed maxStorageBufferRange, using vertex attributes instead of the bindless heap\n";
+		settings.bindless = false;
+		culled_instance_slot.reset();
+		RetireVariantsUsing(retire_frame, {}, bindless_heap->GetLayout());
+		deletion_queue.Retire(retire_frame, std::move(bindless_heap));
+		UpdateTrianglePipeline(false);
+	}
+
+	auto usage{ vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst };
+	if (settings.gpu_culling || bindless_heap) {
+		usage |= vk::BufferUsageFlagBits::eStorageBuffer; // read by the culling pass or straight from the heap
+	}
+	instance_buffer = Graphics::CreateBuffer(*vk_device, *memory_allocator, std::max<vk::DeviceSize>(instance_bytes * copies, 1), usage);
+	if (bindless_heap) {
+		instance_slot = bindless_heap->AddStorageBuffer(*instance_buffer.buffer);
+	}
+	if (settings.gpu_culling) {
+		CreateCullingBuffers();
+	}
+
+	// Every copy starts out filled, after that only streamed instances are uploaded again. With static instances nothing would ever fill a
+	// copy left out here, so a full ring is an error rather than something the next frame makes up for
+	for (uint32_t copy{ 0 }; copy < copies; ++copy)
+	{
+		if (!UploadInstances(0, copy)) {
+			throw std::runtime_error("Staging ring too small for the initial instances");
+		}
+	}
+
+	// The graph imports the buffers and the passes depend on culling/bindless, both of which may have just changed
+	if (render_graph)
+	{
+		deletion_queue.Retire(retire_frame, std::move(render_graph));
+		BuildRenderGraph(false);
+	}
+}
+
+void TriangleApp::Pimpl::CreateCullingBuffers()
+{
+	const uint64_t retire_frame{ frame_scheduler ? frame_scheduler->GetFrameNumber() : 0 };
+	if (cull_descriptor_pool)
+	{
+		deletion_queue.Retire(retire_frame, std::move(cull_descriptor_pool));
+		deletion_queue.Retire(retire_frame, std::move(culled_instance_buffer));
+		deletion_queue.Retire(retire_frame, std::move(draw_command_buffer));
+		deletion_queue.Retire(retire_frame, std::move(draw_counter_buffer));
+	}
+	if (culled_instance_slot)
+	{
+		bindless_heap->Free(Graphics::BindlessType::eStorageBuffer, *culled_instance_slot, retire_frame);
+		culled_instance_slot.reset();
+	}
+
+	const auto frames{ vk::DeviceSize{ settings.frames_in_flight } };
+	const vk::DeviceSize culled_bytes{ std::max<vk::DeviceSize>(vk::DeviceSize{ settings.draw_count } * settings.instance_count * sizeof(TriangleApp_NS::InstanceData) * frames, 16) };
+	const vk::DeviceSize command_bytes{ std::max<vk::DeviceSize>(vk::DeviceSize{ settings.draw_count } * sizeof(vk::DrawIndexedIndirectCommand) * frames, 16) };
+	const vk::DeviceSize counter_bytes{ (vk::DeviceSize{ settings.draw_count } + 1) * sizeof(uint32_t) * frames };
+
+	// The shaders index whole buffers, so every one of them has to fit in a single storage buffer binding
+	const auto max_range{ physical_device.getProperties().limits.maxStorageBufferRange };
+	if (std::max({ instance_buffer.size, culled_bytes, command_bytes, counter_bytes }) > max_range)
+	{
+		std::cerr << "Instances exceed maxStorageBufferRange (" << max_range << " bytes), drawing from the CPU instead of culling on the GPU\n";
+		settings.gpu_culling = false;
+		return;
+	}
+
+	culled_instance_buffer = Graphics::CreateBuffer(*vk_device, *memory_allocator, culled_bytes, vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer);
+	draw_command_buffer = Graphics::CreateBuffer(*vk_device, *memory_allocator, command_bytes, vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer);
+	draw_counter_buffer = Graphics::CreateBuffer(*vk_device, *memory_allocator, counter_bytes, vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst);
+	if (bindless_heap) {
+		culled_instance_slot = bindless_heap->AddStorageBuffer(*culled_instance_buffer.buffer);
+	}
+
+	// A new pool rather than updating the set in place, frames still in flight may be using the old one
+	const vk::DescriptorPoolSize pool_size{ vk::DescriptorType::eStorageBuffer, 4 };
+	cull_descriptor_pool = vk_device->createDescriptorPoolUnique(vk::DescriptorPoolCreateInfo{}
+		.setMaxSets(1)
+		.setPoolSizes(pool_size)
+	);
+	cull_descriptor_set = vk_device->allocateDescriptorSets(vk::DescriptorSetAllocateInfo{}
+		.setDescriptorPool(*cull_descriptor_pool)
+		.setSetLayouts(*cull_set_layout)
+	).front();
+
+	const std::array buffer_infos{
+		vk::DescriptorBufferInfo{ *instance_buffer.buffer, 0, VK_WHOLE_SIZE },
+		vk::DescriptorBufferInfo{ *culled_instance_buffer.buffer, 0, VK_WHOLE_SIZE },
+		vk::DescriptorBufferInfo{ *draw_command_buffer.buffer, 0, VK_WHOLE_SIZE },
+		vk::DescriptorBufferInfo{ *draw_counter_buffer.buffer, 0, VK_WHOLE_SIZE },
+	};
+	std::array<vk::WriteDescriptorSet, buffer_infos.size()> writes{};
+	for (uint32_t binding{ 0 }; binding < writes.size(); ++binding)
+	{
+		writes[binding] = vk::WriteDescriptorSet{}
+			.setDstSet(cull_descriptor_set)
+			.setDstBinding(binding)
+			.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+			.setBufferInfo(buffer_infos[binding]);
+	}
+	vk_device->updateDescriptorSets(writes, {});
+}
+
+vk::DeviceSize TriangleApp::Pimpl::GetInstanceOffset(uint32_t frame_index) const noexcept
+{
+	const vk::DeviceSize instance_bytes{ vk::DeviceSize{ settings.draw_count } * settings.instance_count * sizeof(TriangleApp_NS::InstanceData) };
+	return settings.static_instances ? 0 : instance_bytes * frame_index;
+}
+
+bool TriangleApp::Pimpl::UploadInstances(uint64_t frame_number, uint32_t frame_index)
+{
+	const std::size_t instance_count{ std::size_t{ settings.draw_count } * settings.instance_count };
+	if (instance_count == 0) {
+		return true;
+	}
+
+	const auto staging{ upload_queue->BeginUpload(*instance_buffer.buffer, GetInstanceOffset(frame_index), instance_count * sizeof(TriangleApp_NS::InstanceData)) };
+	if (staging.empty()) {
+		return false;
+	}
+
+	const std::span instances{ reinterpret_cast<TriangleApp_NS::InstanceData*>(staging.data()), instance_count };
+	const std::size_t job_count{ (instance_count + TriangleApp_NS::instances_per_fill_job - 1) / TriangleApp_NS::instances_per_fill_job };
+	const auto fill_job = [&](std::size_t job)
+	{
+		const Profiling::TraceScope trace{ "FillInstances" };
+		const std::size_t first{ job * TriangleApp_NS::instances_per_fill_job };
+		TriangleApp_NS::FillInstances(instances.subspan(first, std::min(TriangleApp_NS::instances_per_fill_job, instance_count - first)), first, instance_count, frame_number);
+	};
+
+	if (thread_pool && job_count > 1) {
+		thread_pool->ParallelFor(job_count, fill_job);
+	}
+	else {
+		for (std::size_t job{ 0 }; job < job_count; ++job) {
+			fill_job(job);
+		}
+	}
+	return true;
+}
+
+vk::DeviceSize TriangleApp::Pimpl::GetVertexOffset(uint32_t frame_index) const noexcept
+{
+	return settings.stream_geometry ? vk::DeviceSize{ sizeof(TriangleApp_NS::triangle_vertices) } * frame_index : 0;
+}
+
+void TriangleApp::Pimpl::UploadVertices(uint64_t frame_number, uint32_t frame_index)
+{
+	auto vertices{ TriangleApp_NS::triangle_vertices };
+	if (settings.stream_geometry)
+	{
+		// a tenth of a degree per frame
+		const float angle{ glm::radians(static_cast<float>(frame_number % 3600) * 0.1f) };
+		const float c{ std::cos(angle) };
+		const float s{ std::sin(angle) };
+		for (auto& vertex : vertices)
+		{
+			const auto p{ vertex.position };
+			vertex.position = { p.x * c - p.y * s, p.x * s + p.y * c };
+		}
+	}
+
+	// A full ring just means this frame shows last frame's vertices
+	[[maybe_unused]] const bool queued{ upload_queue->Upload(*vertex_buffer.buffer, GetVertexOffset(frame_index), std::span<const TriangleApp_NS::Vertex>{ vertices }) };
+}
+
+vk::CommandBuffer TriangleApp::Pimpl::GetFrameCommandBuffer(uint32_t image_idx, uint32_t frame_index)
+{
+	auto& recordings{ frame_recordings.at(frame_index) };
+
+	// Resetting the whole pool also invalidates anything kept from earlier frames, so only keep them while nothing changed
+	if (!settings.reuse_command_buffers || recordings.version != recording_version)
+	{
+		command_pools->Reset(frame_index);
+		recordings.by_image.clear();
+		recordings.version = recording_version;
+	}
+	else
+	{
+		const auto it = std::find_if(std::begin(recordings.by_image), std::end(recordings.by_image), [image_idx](const auto& recording) { return recording.first == image_idx; });
+		if (it != std::end(recordings.by_image)) {
+			return it->second;
+		}
+	}
+
+	auto cmd{ command_pools->Allocate(frame_index) };
+	RecordFrame(cmd, image_idx, frame_index);
+	if (settings.reuse_command_buffers) {
+		recordings.by_image.emplace_back(image_idx, cmd);
+	}
+	return cmd;
+}
+
+void TriangleApp::Pimpl::RecordFrame(vk::CommandBuffer& cmd, uint32_t image_idx, uint32_t frame_index)
+{
+	const Profiling::TraceScope trace{ "RecordFrame" };
+
+	// Begin recording
+	cmd.begin(vk::CommandBufferBeginInfo{}
+		.setFlags(settings.reuse_command_buffers ? vk::CommandBufferUsageFlags{} : vk::CommandBufferUsageFlagBits::eOneTimeSubmit)
+		.setPInheritanceInfo(nullptr)
+	);
+
+	if (gpu_profiler) {
+		gpu_profiler->RecordBegin(cmd, frame_index);
+	}
+
+	if (render_graph)
+	{
+		// The graph has every barrier and layout transition of the frame, only the image rendered to changes
+		render_graph->SetImage(graph_target, swap_chain_images.at(image_idx), *swap_chain_image_views.at(image_idx), swap_chain_extent);
+		if (settings.headless) {
+			render_graph->SetBuffer(graph_readback, *offscreen_targets.at(image_idx).readback_buffer);
+		}
+		render_graph->Record(cmd, Graphics::RenderGraph::FrameInfo{ frame_index, image_idx });
+
+		if (gpu_profiler) {
+			gpu_profiler->RecordEnd(cmd, frame_index);
+		}
+		cmd.end();
+		return;
+	}
+
+	if (settings.gpu_culling)
+	{
+		RecordCulling(cmd, frame_index);
+		// With a bindless heap the attribute variant may be standing in, so the culled instances are made visible to both
+		auto draw_stages{ vk::PipelineStageFlags{ vk::PipelineStageFlagBits::eVertexInput } };
+		auto draw_access{ vk::AccessFlags{ vk::AccessFlagBits::eVertexAttributeRead } };
+		if (bindless_heap)
+		{
+			draw_stages |= vk::PipelineStageFlagBits::eVertexShader;
+			draw_access |= vk::AccessFlagBits::eShaderRead;
+		}
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect | draw_stages, {},
+			vk::MemoryBarrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eIndirectCommandRead | draw_access }, {}, {});
+	}
+
+	// A single indirect draw is left with GPU culling, nothing worth spreading over secondary command buffers
+	const bool use_secondaries{ settings.secondary_command_buffers && !settings.gpu_culling };
+	std::vector<vk::ClearValue> clear_colours{ vk::ClearColorValue{ std::array<float,4>{0.f, 0.f, 0.f, 0.f} } };
+
+	// Starting a render pass
+	cmd.beginRenderPass(vk::RenderPassBeginInfo{}
+		.setRenderPass(*render_pass)
+		.setFramebuffer(*swap_chain_frame_buffers.at(image_idx))
+		.setRenderArea({ {0, 0}, swap_chain_extent })
+		.setClearValues(clear_colours),
+		use_secondaries ? vk::SubpassContents::eSecondaryCommandBuffers : vk::SubpassContents::eInline
+	);
+	RecordPassContents(cmd, image_idx, frame_index, use_secondaries);
+	cmd.endRenderPass();
+
+	if (gpu_profiler) {
+		gpu_profiler->RecordEnd(cmd, frame_index);
+	}
+
+	if (settings.headless) {
+		TriangleApp_NS::RecordReadback(cmd, offscreen_targets.at(image_idx), swap_chain_extent);
+	}
+
+	// End recording
+	cmd.end();
+}
+
+void TriangleApp::Pimpl::RecordPassContents(vk::CommandBuffer& cmd, uint32_t image_idx, uint32_t frame_index, const bool use_secondaries)
+{
+	if (!use_secondaries)
+	{
+		RecordDraws(cmd, frame_index, 0, settings.draw_count);
+		return;
+	}
+
+	// Jobs are recorded in any order on any thread but executed in job order, so the frame comes out the same every time
+	const uint32_t job_count{ (settings.draw_count + settings.draws_per_job - 1) / settings.draws_per_job };
+	std::vector<vk::CommandBuffer> secondaries(job_count);
+
+	const auto record_job = [&](std::size_t job)
+	{
+		const uint32_t first_draw{ static_cast<uint32_t>(job) * settings.draws_per_job };
+		secondaries[job] = RecordDrawJob(image_idx, frame_index, first_draw, std::min(settings.draws_per_job, settings.draw_count - first_draw));
+	};
+
+	if (thread_pool) {
+		thread_pool->ParallelFor(job_count, record_job);
+	}
+	else {
+		for (std::size_t job{ 0 }; job < job_count; ++job) {
+			record_job(job);
+		}
+	}
+
+	if (!secondaries.empty()) {
+		cmd.executeCommands(secondaries);
+	}
+}
+
+void TriangleApp::Pimpl::BuildRenderGraph(const bool print_stats)
+{
+	render_graph = std::make_unique<Graphics::RenderGraph>(*vk_device, *memory_allocator, dynamic_rendering_dispatch);
+	auto& graph{ *render_graph };
+
+	// Nothing is kept from the image's last frame, and the acquire semaphore is waited on at colour attachment output
+	Graphics::RenderGraph::ImportedImageDesc target_desc{};
+	target_desc.initial_stages = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+	if (!settings.headless) {
+		target_desc.final_layout = vk::ImageLayout::ePresentSrcKHR;
+	}
+	graph_target = graph.ImportImage("target", target_desc);
+
+	// With a render scale the scene is drawn into a transient image and blitted over, which needs blits of the format and a target that
+	// can be blitted to (the offscreen targets always can)
+	graph_scene = {};
+	const auto format_features{ physical_device.getFormatProperties(swap_chain_format).optimalTilingFeatures };
+	if (settings.render_scale != 1.f)
+	{
+		constexpr auto blit_features{ vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst };
+		const bool target_usage{ settings.headless || (physical_device.getSurfaceCapabilitiesKHR(*surface).supportedUsageFlags & vk::ImageUsageFlagBits::eTransferDst) };
+		if ((format_features & blit_features) == blit_features && target_usage) {
+			graph_scene = graph.CreateImage("scene", Graphics::RenderGraph::TransientImageDesc{ swap_chain_format, GetRenderExtent() });
+		}
+		else
+		{
+			std::cerr << "--render-scale needs " << vk::to_string(swap_chain_format) << " images that can be blitted, rendering at full size\n";
+			settings.render_scale = 1.f;
+		}
+	}
+
+	using Graphics::ResourceUsage;
+	const auto instances{ graph.ImportBuffer("instances", *instance_buffer.buffer) };
+	// With a bindless heap the attribute variant may be standing in for the bindless one, so the draws read instances both ways
+	const auto instance_reads = [&](Graphics::RenderGraph::Handle buffer)
+	{
+		std::vector<Graphics::RenderGraph::ResourceAccess> reads{ { buffer, ResourceUsage::eVertexBuffer } };
+		if (bindless_heap) {
+			reads.push_back({ buffer, ResourceUsage::eStorageReadVertex });
+		}
+		return reads;
+	};
+
+	Graphics::RenderGraph::PassDesc draw_pass{};
+	draw_pass.name = "triangle";
+	if (settings.gpu_culling)
+	{
+		const auto culled_instances{ graph.ImportBuffer("culled instances", *culled_instance_buffer.buffer) };
+		const auto draw_commands{ graph.ImportBuffer("draw commands", *draw_command_buffer.buffer) };
+		const auto draw_counters{ graph.ImportBuffer("draw counters", *draw_counter_buffer.buffer) };
+
+		Graphics::RenderGraph::PassDesc cull_pass{};
+		cull_pass.name = "cull";
+		cull_pass.accesses = {
+			{ instances, ResourceUsage::eStorageReadCompute },
+			{ culled_instances, ResourceUsage::eStorageWriteCompute },
+			{ draw_commands, ResourceUsage::eStorageWriteCompute },
+			{ draw_counters, ResourceUsage::eStorageWriteCompute },
+		};
+		cull_pass.record = [this](vk::CommandBuffer& cmd, const Graphics::RenderGraph&, const Graphics::RenderGraph::FrameInfo& frame) { RecordCulling(cmd, frame.frame_index); };
+		graph.AddPass(std::move(cull_pass));
+
+		draw_pass.accesses = instance_reads(culled_instances);
+		draw_pass.accesses.push_back({ draw_commands, ResourceUsage::eIndirectBuffer });
+		draw_pass.accesses.push_back({ draw_counters, ResourceUsage::eIndirectBuffer });
+	}
+	else {
+		draw_pass.accesses = instance_reads(instances);
+	}
+
+	// A single indirect draw is left with GPU culling, nothing worth spreading over secondary command buffers
+	const bool use_secondaries{ settings.secondary_command_buffers && !settings.gpu_culling };
+	draw_pass.colour_attachments = { Graphics::RenderGraph::ColourAttachment{ graph_scene.IsValid() ? graph_scene : graph_target } };
+	draw_pass.secondary_command_buffers = use_secondaries;
+	draw_pass.record = [this, use_secondaries](vk::CommandBuffer& cmd, const Graphics::RenderGraph&, const Graphics::RenderGraph::FrameInfo& frame) { RecordPassContents(cmd, frame.image_index, frame.frame_index, use_secondaries); };
+	graph.AddPass(std::move(draw_pass));
+
+	if (graph_scene.IsValid())
+	{
+		const auto filter{ (format_features & vk::FormatFeatureFlagBits::eSampledImageFilterLinear) ? vk::Filter::eLinear : vk::Filter::eNearest };
+
+		Graphics::RenderGraph::PassDesc upscale_pass{};
+		upscale_pass.name = "upscale";
+		upscale_pass.accesses = {
+			{ graph_scene, ResourceUsage::eTransferSrc },
+			{ graph_target, ResourceUsage::eTransferDst },
+		};
+		upscale_pass.record = [this, filter](vk::CommandBuffer& cmd, const Graphics::RenderGraph& frame_graph, const Graphics::RenderGraph::FrameInfo&)
+		{
+			const auto scene_extent{ GetRenderExtent() };
+			const vk::ImageSubresourceLayers layers{ vk::ImageAspectFlagBits::eColor, 0U, 0U, 1U };
+			const std::array scene_bounds{ vk::Offset3D{ 0, 0, 0 }, vk::Offset3D{ static_cast<int32_t>(scene_extent.width), static_cast<int32_t>(scene_extent.height), 1 } };
+			const std::array target_bounds{ vk::Offset3D{ 0, 0, 0 }, vk::Offset3D{ static_cast<int32_t>(swap_chain_extent.width), static_cast<int32_t>(swap_chain_extent.height), 1 } };
+			cmd.blitImage(frame_graph.GetImage(graph_scene), vk::ImageLayout::eTransferSrcOptimal, frame_graph.GetImage(graph_target), vk::ImageLayout::eTransferDstOptimal,
+				vk::ImageBlit{ layers, scene_bounds, layers, target_bounds }, filter);
+		};
+		graph.AddPass(std::move(upscale_pass));
+	}
+
+	if (settings.headless)
+	{
+		graph_readback = graph.ImportBuffer("readback", {}, true);
+
+		Graphics::RenderGraph::PassDesc readback_pass{};
+		readback_pass.name = "readback";
+		readback_pass.accesses = {
+			{ graph_target, ResourceUsage::eTransferSrc },
+			{ graph_readback, ResourceUsage::eTransferDst },
+		};
+		readback_pass.record = [this](vk::CommandBuffer& cmd, const Graphics::RenderGraph&, const Graphics::RenderGraph::FrameInfo& frame) { TriangleApp_NS::RecordReadback(cmd, offscreen_targets.at(frame.image_index), swap_chain_extent); };
+		graph.AddPass(std::move(readback_pass));
+	}
+
+	const auto& stats{ graph.Compile() };
+	++recording_version; // kept recordings were made from the old graph
+
+	if (!print_stats) {
+		return;
+	}
+
+	stats.Print(std::cout);
+	std::cout << "  pass order:";
+	for (const auto& name : graph.GetPassOrder()) {
+		std::cout << ' ' << name;
+	}
+	std::cout << '\n';
+}
+
+vk::ImageUsageFlags TriangleApp::Pimpl::GetSwapChainExtraUsage() const noexcept
+{
+	return settings.render_scale != 1.f ? vk::ImageUsageFlags{ vk::ImageUsageFlagBits::eTransferDst } : vk::ImageUsageFlags{};
+}
+
+vk::Extent2D TriangleApp::Pimpl::GetRenderExtent() const noexcept
+{
+	if (settings.render_scale == 1.f) {
+		return swap_chain_extent;
+	}
+
+	const auto scale = [this](uint32_t size) { return std::max(static_cast<uint32_t>(static_cast<float>(size) * settings.render_scale), 1u); };
+	return vk::Extent2D{ scale(swap_chain_extent.width), scale(swap_chain_extent.height) };
+}
+
+vk::CommandBuffer TriangleApp::Pimpl::RecordDrawJob(uint32_t image_idx, uint32_t frame_index, uint32_t first_draw, uint32_t count)
+{
+	const Profiling::TraceScope trace{ "RecordDrawJob" };
+
+	// Each thread allocates from its own pool, the caller of ParallelFor() gets the last one
+	const std::size_t thread_index{ thread_pool ? thread_pool->GetCurrentThreadIndex() : 0 };
+	auto cmd{ command_pools->Allocate(frame_index, vk::CommandBufferLevel::eSecondary, thread_index) };
+
+	vk::StructureChain<vk::CommandBufferInheritanceInfo, vk::CommandBufferInheritanceRenderingInfoKHR> inheritance_chain{};
+	auto& inheritance{ inheritance_chain.get<vk::CommandBufferInheritanceInfo>() };
+	inheritance.setPipelineStatistics(gpu_profiler ? gpu_profiler->GetPipelineStatisticFlags() : vk::QueryPipelineStatisticFlags{});
+	if (settings.dynamic_rendering)
+	{
+		// No render pass to inherit, the attachment formats stand in for it
+		inheritance_chain.get<vk::CommandBufferInheritanceRenderingInfoKHR>()
+			.setColorAttachmentFormats(swap_chain_format)
+			.setRasterizationSamples(vk::SampleCountFlagBits::e1);
+	}
+	else
+	{
+		inheritance
+			.setRenderPass(*render_pass)
+			.setSubpass(0)
+			.setFramebuffer(*swap_chain_frame_buffers.at(image_idx));
+		inheritance_chain.unlink<vk::CommandBufferInheritanceRenderingInfoKHR>();
+	}
+
+	auto flags{ vk::CommandBufferUsageFlags{ vk::CommandBufferUsageFlagBits::eRenderPassContinue } };
+	if (!settings.reuse_command_buffers) {
+		flags |= vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+	}
+
+	cmd.begin(vk::CommandBufferBeginInfo{}
+		.setFlags(flags)
+		.setPInheritanceInfo(&inheritance)
+	);
+	RecordDraws(cmd, frame_index, first_draw, count);
+	cmd.end();
+
+	return cmd;
+}
+
+void TriangleApp::Pimpl::RecordDraws(vk::CommandBuffer& cmd, uint32_t frame_index, uint32_t first_draw, uint32_t count)
+{
+	cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, *triangle_pipeline->pipeline);
+	// Dynamic in every variant, and secondary command buffers don't inherit it so each one sets its own
+	const auto extent{ GetRenderExtent() };
+	cmd.setViewport(0, vk::Viewport{ 0.f, 0.f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.f, 1.f });
+	cmd.setScissor(0, vk::Rect2D{ vk::Offset2D{ 0, 0 }, extent });
+	cmd.setLineWidth(1.f);
+	cmd.bindIndexBuffer(*index_buffer.buffer, 0, vk::IndexType::eUint16);
+
+	// Sets are bound once per command buffer, per frame data comes from the uniform ring and only small per draw data is pushed
+	cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *triangle_pipeline->layout, 0, uniform_ring->GetSet(), frame_uniforms_offset);
+	TriangleApp_NS::DrawConstants constants{};
+	constants.instances_per_draw = std::max(settings.instance_count, 1u);
+	if (triangle_pipeline_bindless)
+	{
+		const uint32_t instance_count{ settings.draw_count * settings.instance_count };
+		constants.instance_buffer = settings.gpu_culling ? *culled_instance_slot : *instance_slot;
+		constants.instance_first = settings.gpu_culling || !settings.static_instances ? instance_count * frame_index : 0;
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *triangle_pipeline->layout, 1, bindless_heap->GetSet(), {});
+		cmd.bindVertexBuffers(0, *vertex_buffer.buffer, GetVertexOffset(frame_index));
+	}
+	cmd.pushConstants(*triangle_pipeline->layout, vk::ShaderStageFlagBits::eVertex, 0, TriangleApp_NS::GetDrawConstantsSize(triangle_pipeline_bindless), &constants);
+
+	if (settings.gpu_culling)
+	{
+		// Everything that survived culling in one call, however many draws that turns out to be
+		if (!triangle_pipeline_bindless)
+		{
+			const vk::DeviceSize instance_bytes{ vk::DeviceSize{ settings.draw_count } * settings.instance_count * sizeof(TriangleApp_NS::InstanceData) };
+			cmd.bindVertexBuffers(0, { *vertex_buffer.buffer, *culled_instance_buffer.buffer }, { GetVertexOffset(frame_index), instance_bytes * frame_index });
+		}
+		cmd.drawIndexedIndirectCount(
+			*draw_command_buffer.buffer, vk::DeviceSize{ settings.draw_count } * sizeof(vk::DrawIndexedIndirectCommand) * frame_index,
+			*draw_counter_buffer.buffer, (vk::DeviceSize{ settings.draw_count } + 1) * sizeof(uint32_t) * frame_index,
+			settings.draw_count, static_cast<uint32_t>(sizeof(vk::DrawIndexedIndirectCommand)));
+		return;
+	}
+
+	if (!triangle_pipeline_bindless) {
+		cmd.bindVertexBuffers(0, { *vertex_buffer.buffer, *instance_buffer.buffer }, { GetVertexOffset(frame_index), GetInstanceOffset(frame_index) });
+	}
+
+	constexpr auto index_count{ static_cast<uint32_t>(TriangleApp_NS::triangle_indices.size()) };
+	for (uint32_t draw{ first_draw }; draw < first_draw + count; ++draw)
+	{
+		cmd.pushConstants<uint32_t>(*triangle_pipeline->layout, vk::ShaderStageFlagBits::eVertex, static_cast<uint32_t>(offsetof(TriangleApp_NS::DrawConstants, draw_index)), draw);
+		cmd.drawIndexed(index_count, settings.instance_count, 0, 0, draw * settings.instance_count);
+	}
+}
+
+void TriangleApp::Pimpl::RecordCulling(vk::CommandBuffer& cmd, uint32_t frame_index)
+{
+	const uint32_t instance_count{ settings.draw_count * settings.instance_count };
+
+	TriangleApp_NS::CullPushConstants constants{};
+	constants.frustum_planes = TriangleApp_NS::GetFrustumPlanes(view);
+	constants.source_first = settings.static_instances ? 0 : instance_count * frame_index;
+	constants.culled_first = instance_count * frame_index;
+	constants.counters_first = (settings.draw_count + 1) * frame_index;
+	constants.commands_first = settings.draw_count * frame_index;
+	constants.instance_count = instance_count;
+	constants.instances_per_draw = std::max(settings.instance_count, 1u);
+	constants.draw_count = settings.draw_count;
+	constants.index_count = static_cast<uint32_t>(TriangleApp_NS::triangle_indices.size());
+	constants.mesh_radius = TriangleApp_NS::GetBoundingRadius(TriangleApp_NS::triangle_vertices);
+
+	// The counters are accumulated into, so start the frame's from zero. The frame that last used them has finished by now
+	cmd.fillBuffer(*draw_counter_buffer.buffer, vk::DeviceSize{ constants.counters_first } * sizeof(uint32_t), (vk::DeviceSize{ settings.draw_count } + 1) * sizeof(uint32_t), 0);
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {},
+		vk::MemoryBarrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite }, {}, {});
+
+	cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *cull_pipeline.layout, 0, cull_descriptor_set, {});
+	cmd.pushConstants<TriangleApp_NS::CullPushConstants>(*cull_pipeline.layout, vk::ShaderStageFlagBits::eCompute, 0, constants);
+
+	cmd.bindPipeline(vk::PipelineBindPoint::eCompute, *cull_pipeline.pipeline);
+	TriangleApp_NS::DispatchLinear(cmd, (instance_count + TriangleApp_NS::cull_group_size - 1) / TriangleApp_NS::cull_group_size);
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {},
+		vk::MemoryBarrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite }, {}, {});
+
+	cmd.bindPipeline(vk::PipelineBindPoint::eCompute, *compact_pipeline.pipeline);
+	TriangleApp_NS::DispatchLinear(cmd, (settings.draw_count + TriangleApp_NS::cull_group_size - 1) / TriangleApp_NS::cull_group_size);
+}
+
+void TriangleApp::Pimpl::RecreateSwapChain()
+{
+	assert(!settings.headless);
+
+	// A minimised window has a zero sized framebuffer which no swap chain can be created for, so wait until it comes back
+	int width{}, height{};
+	glfwGetFramebufferSize(window.get(), &width, &height);
+	while ((width == 0 || height == 0) && !glfwWindowShouldClose(window.get()))
+	{
+		glfwWaitEvents();
+		glfwGetFramebufferSize(window.get(), &width, &height);
+	}
+	if (width == 0 || height == 0) {
+		return; // closed while minimised
+	}
+	framebuffer_resized = false;
+
+	// Frames up to the last submitted one may still be using the old objects
+	const uint64_t retire_frame{ frame_scheduler->GetFrameNumber() };
+	const auto old_format{ swap_chain_format };
+
+	auto old_swap_chain{ std::move(swap_chain) };
+	std::tie(swap_chain, swap_chain_format, swap_chain_extent) = TriangleApp_NS::CreateSwapChain(*vk_device, physical_device, *surface, window.get(), *old_swap_chain, GetSwapChainExtraUsage());
+	swap_chain_images = vk_device->getSwapchainImagesKHR(*swap_chain);
+
+	deletion_queue.Retire(retire_frame, std::move(swap_chain_frame_buffers));
+	deletion_queue.Retire(retire_frame, std::move(swap_chain_image_views));
+	++recording_version; // kept recordings reference the old framebuffers or image views
+
+	// The render pass (or the pipeline's attachment format with dynamic rendering) depends on the format. The viewport is dynamic, so a
+	// resize alone keeps the pipeline it has. With dynamic rendering variants for the old format stay in the cache for when it comes back,
+	// those made for an old render pass go with it
+	if (swap_chain_format != old_format)
+	{
+		if (!settings.dynamic_rendering)
+		{
+			RetireVariantsUsing(retire_frame, *render_pass, {});
+			deletion_queue.Retire(retire_frame, std::move(render_pass));
+			render_pass = TriangleApp_NS::CreateRenderPass(*vk_device, swap_chain_format, vk::ImageLayout::ePresentSrcKHR);
+		}
+		UpdateTrianglePipeline(false);
+	}
+
+	// Retired last, after everything created from its images
+	deletion_queue.Retire(retire_frame, std::move(old_swap_chain));
+
+	swap_chain_image_views.clear();
+	swap_chain_frame_buffers.clear();
+	image_frames.assign(swap_chain_images.size(), 0);
+
+	CreateImageViews();
+	if (settings.dynamic_rendering)
+	{
+		deletion_queue.Retire(retire_frame, std::move(render_graph));
+		BuildRenderGraph(false);
+	}
+	else {
+		CreateFrameBuffers();
+	}
+}
+
+Profiling::FrameTimings TriangleApp::Pimpl::DrawFrame()
+{
+	const auto frame_begin{ std::chrono::steady_clock::now() };
+	Profiling::FrameTimings timings{};
+
+	if (frame_profiler) {
+		frame_profiler->BeginFrame();
+	}
+
+	// Only blocks if the GPU is still working on the frame frames_in_flight ago
+	const auto fence_wait_begin{ std::chrono::steady_clock::now() };
+	const uint64_t frame_number{ frame_scheduler->BeginFrame() };
+	const uint32_t frame_index{ frame_scheduler->GetFrameIndex() };
+	timings.fence_wait_ms = TriangleApp_NS::MillisecondsSince(fence_wait_begin, "WaitForFrame");
+
+	if (!deletion_queue.IsEmpty()) {
+		deletion_queue.Collect(frame_scheduler->GetCompletedFrame());
+	}
+	if (bindless_heap) {
+		bindless_heap->Collect(frame_scheduler->GetCompletedFrame());
+	}
+	// Swaps the stand-in for the bindless variant once its background build is done
+	if (pending_triangle_key && !pipeline_variants->IsPending(*pending_triangle_key)) {
+		UpdateTrianglePipeline(false);
+	}
+#ifdef RUNTIME_SHADER_COMPILATION
+	// Edits made while a rebuild is still going are picked up once it is done
+	if (shader_watcher)
+	{
+		FinishShaderReloads();
+		if (!pending_triangle_reload && !pending_culling_reload)
+		{
+			if (const auto changed{ shader_watcher->Poll() }; !changed.empty()) {
+				ReloadShaders(changed);
+			}
+		}
+	}
+#endif
+
+	upload_queue->Collect(frame_scheduler->GetCompletedFrame());
+	const auto upload_begin{ std::chrono::steady_clock::now() };
+	if (settings.stream_geometry) {
+		UploadVertices(frame_number, frame_index);
+	}
+	if (!settings.static_instances) {
+		[[maybe_unused]] const bool queued{ UploadInstances(frame_number, frame_index) }; // a full ring means the frame shows its previous instances
+	}
+	timings.upload_ms = TriangleApp_NS::MillisecondsSince(upload_begin, "Upload");
+
+	// The frame's constants always go first in its slice, so recordings kept from earlier frames with the same index still point at them
+	uniform_ring->BeginFrame(frame_index);
+	TriangleApp_NS::FrameUniforms frame_uniforms{};
+	frame_uniforms.view = view;
+	frame_uniforms_offset = uniform_ring->Push(frame_uniforms).value();
+	uniform_ring->Flush();
+	timings.uniform_bytes = uniform_ring->GetFrameBytes();
+	if (frame_profiler) {
+		frame_profiler->SetUniformBytes(timings.uniform_bytes);
+	}
+
+	// The work this frame slot submitted frames_in_flight frames ago is done now, so its queries can be read without stalling
+	if (gpu_profiler)
+	{
+		const auto results{ gpu_profiler->Collect(frame_index) };
+		if (results.gpu_ms) {
+			frame_profiler->AddGpuTime(*results.gpu_ms);
+		}
+		if (results.pipeline_statistics) {
+			frame_profiler->SetPipelineStatistics(*results.pipeline_statistics);
+		}
+
+		if (transfer_profiler)
+		{
+			const auto transfer{ transfer_profiler->Collect(frame_index) };
+			if (transfer.gpu_ms) {
+				frame_profiler->AddTransferTime(*transfer.gpu_ms);
+			}
+
+			// A frame's copies are submitted while the graphics queue is still busy with the frame before, which is what they can overlap.
+			// Not the frame's own work, which waits for them. Timestamps of different queues are only comparable with calibrated timestamps.
+			if (calibrated_timestamps && transfer.timestamps && last_graphics_timestamps)
+			{
+				const double overlap_ms{ transfer_profiler->GetOverlapMs(*transfer.timestamps, *gpu_profiler, *last_graphics_timestamps) };
+				frame_profiler->AddTransferOverlap(overlap_ms);
+				timings.transfer_overlap_ms = overlap_ms;
+			}
+		}
+		last_graphics_timestamps = results.timestamps;
+	}
+
+	// Every frame's last submission signals the timeline with its frame number
+	const auto timeline{ frame_scheduler->GetTimeline() };
+	const auto submit = [&, this](vk::SubmitInfo submit_info, uint32_t image_idx)
+	{
+		// Uploads ride along ahead of the commands that read them. When they went to the transfer queue this is only the acquire
+		// side of the ownership transfer, and the frame waits on the transfer queue's timeline
+		std::vector<vk::CommandBuffer> command_buffers{ submit_info.pCommandBuffers, submit_info.pCommandBuffers + submit_info.commandBufferCount };
+		std::vector<vk::Semaphore> wait_semaphores{ submit_info.pWaitSemaphores, submit_info.pWaitSemaphores + submit_info.waitSemaphoreCount };
+		std::vector<vk::PipelineStageFlags> wait_stages{ submit_info.pWaitDstStageMask, submit_info.pWaitDstStageMask + submit_info.waitSemaphoreCount };
+		std::vector<uint64_t> wait_values(wait_semaphores.size(), 0); // ignored for binary semaphores
+
+		const auto uploads{ upload_queue->Submit(frame_index, frame_number) };
+		if (uploads.command_buffer) {
+			command_buffers.insert(std::begin(command_buffers), uploads.command_buffer);
+		}
+		if (uploads.wait_semaphore)
+		{
+			wait_semaphores.push_back(uploads.wait_semaphore);
+			wait_stages.push_back(uploads.wait_stages);
+			wait_values.push_back(uploads.wait_value);
+		}
+		submit_info.setCommandBuffers(command_buffers);
+		submit_info.setWaitSemaphores(wait_semaphores);
+		submit_info.setWaitDstStageMask(wait_stages);
+
+		std::vector<vk::Semaphore> signal_semaphores{ submit_info.pSignalSemaphores, submit_info.pSignalSemaphores + submit_info.signalSemaphoreCount };
+		std::vector<uint64_t> signal_values(signal_semaphores.size(), 0); // ignored for binary semaphores
+		signal_semaphores.push_back(timeline);
+		signal_values.push_back(frame_number);
+
+		const auto timeline_info{ vk::TimelineSemaphoreSubmitInfo{}
+			.setWaitSemaphoreValues(wait_values)
+			.setSignalSemaphoreValues(signal_values)
+		};
+		submit_info.setSignalSemaphores(signal_semaphores);
+		submit_info.setPNext(&timeline_info);
+
+		// Copies that are already done by now cost the graphics queue nothing, a host side measure of the overlap that works on any device
+		if (uploads.wait_semaphore)
+		{
+			timings.transfer_submitted = true;
+			timings.transfer_ready = upload_queue->IsComplete(uploads);
+			if (frame_profiler) {
+				frame_profiler->AddTransferSubmit(timings.transfer_ready);
+			}
+		}
+
+		const auto submit_begin{ std::chrono::steady_clock::now() };
+		graphics_queue.submit(submit_info);
+		timings.submit_ms = TriangleApp_NS::MillisecondsSince(submit_begin, "Submit");
+		if (frame_profiler)
+		{
+			frame_profiler->AddCpuSubmitTime(timings.submit_ms);
+			gpu_profiler->OnSubmitted(frame_index);
+		}
+		image_frames.at(image_idx) = frame_number;
+	};
+
+	if (settings.headless)
+	{
+		// offscreen targets map 1:1 onto frames in flight, so BeginFrame() already covers reuse of the target
+		const auto image_idx{ frame_index };
+
+		const auto cmd{ GetFrameCommandBuffer(image_idx, frame_index) };
+		submit(vk::SubmitInfo{}.setCommandBuffers(cmd), image_idx);
+
+		last_submitted_image = image_idx;
+	}
+	else
+	{
+		auto& image_available_semaphore = image_available_semaphores.at(frame_index).get();
+		auto& render_finished_semaphore = render_finished_semaphores.at(frame_index).get();
+
+		const auto acquire_begin{ std::chrono::steady_clock::now() };
+		vk::ResultValue<uint32_t> acquired{ vk::Result::eSuccess, 0 };
+		try
+		{
+			acquired = vk_device->acquireNextImageKHR(swap_chain.get(), std::numeric_limits<uint64_t>::max(), image_available_semaphore, VK_NULL_HANDLE);
+		}
+		catch (const vk::OutOfDateKHRError&)
+		{
+			// Nothing was acquired so nothing gets submitted this frame, try again next frame with a new swap chain
+			frame_scheduler->AbandonFrame();
+			RecreateSwapChain();
+			timings.frame_ms = TriangleApp_NS::MillisecondsSince(frame_begin, "DrawFrame");
+			return timings;
+		}
+		const auto [acquire_result, image_idx] = acquired;
+		assert(acquire_result == vk::Result::eSuccess || acquire_result == vk::Result::eSuboptimalKHR);
+		timings.acquire_ms = TriangleApp_NS::MillisecondsSince(acquire_begin, "Acquire");
+
+		// Images aren't necessarily acquired in order, so a frame other than the one BeginFrame() waited on may still be using this image
+		if (!frame_scheduler->IsFrameComplete(image_frames.at(image_idx)))
+		{
+			const auto image_wait_begin{ std::chrono::steady_clock::now() };
+			frame_scheduler->WaitForFrame(image_frames.at(image_idx));
+			timings.fence_wait_ms += TriangleApp_NS::MillisecondsSince(image_wait_begin, "WaitForImage");
+		}
+
+		std::array wait_semaphores{ image_available_semaphore };
+		std::array signal_semaphores{ render_finished_semaphore };
+
+		vk::PipelineStageFlags wait_stages{ vk::PipelineStageFlagBits::eColorAttachmentOutput };
+
+		// Draw frame
+		const auto cmd{ GetFrameCommandBuffer(image_idx, frame_index) };
+		submit(vk::SubmitInfo{ wait_semaphores, wait_stages, cmd, signal_semaphores }, image_idx);
+
+		// Present
+		const auto present_begin{ std::chrono::steady_clock::now() };
+		bool recreate_swap_chain{ acquire_result == vk::Result::eSuboptimalKHR || framebuffer_resized };
+		try
+		{
+			const auto present_result = present_queue.presentKHR(vk::PresentInfoKHR{ signal_semaphores, swap_chain.get(), image_idx });
+			recreate_swap_chain |= present_result == vk::Result::eSuboptimalKHR;
+		}
+		catch (const vk::OutOfDateKHRError&)
+		{
+			recreate_swap_chain = true;
+		}
+		timings.present_ms = TriangleApp_NS::MillisecondsSince(present_begin, "Present");
+
+		last_submitted_image = image_idx;
+
+		if (recreate_swap_chain) {
+			RecreateSwapChain();
+		}
+	}
+
+	if (frame_profiler) {
+		frame_profiler->Update();
+	}
+
+	timings.frame_ms = TriangleApp_NS::MillisecondsSince(frame_begin, "DrawFrame");
+	return timings;
+}
+
+Profiling::Benchmark::Report TriangleApp::Pimpl::RunBenchmark()
+{
+	const Profiling::TraceScope trace{ "RunBenchmark" };
+	const auto properties{ physical_device.getProperties() };
+
+	Profiling::BenchmarkInfo info{};
+	info.device_name = properties.deviceName.data();
+	info.driver_version = properties.driverVersion;
+	info.api_version = properties.apiVersion;
+	info.headless = settings.headless;
+	info.width = swap_chain_extent.width;
+	info.height = swap_chain_extent.height;
+	info.instance_count = settings.instance_count;
+	info.draw_count = settings.draw_count;
+	info.vertices_per_instance = static_cast<uint32_t>(TriangleApp_NS::triangle_indices.size());
+	info.recording_threads = settings.secondary_command_buffers && !settings.gpu_culling ? command_pools->GetThreadCount() : 0;
+	info.gpu_culling = settings.gpu_culling;
+	info.bindless = settings.bindless;
+	info.dynamic_rendering = settings.dynamic_rendering;
+	info.render_scale = settings.render_scale;
+	info.warmup_frames = settings.bench_warmup_frames;
+	Profiling::Benchmark benchmark{ std::move(info), settings.bench_frames };
+
+	// Still pump window events so the window stays responsive, but never stop early, every run does the same amount of work
+	const auto do_frame = [this]()
+	{
+		if (!settings.headless) {
+			glfwPollEvents();
+		}
+		return DrawFrame();
+	};
+
+	for (std::size_t frame{ 0 }; frame < settings.bench_warmup_frames; ++frame) {
+		do_frame();
+	}
+
+	vk_device->waitIdle();
+	benchmark.Start();
+	for (std::size_t frame{ 0 }; frame < settings.bench_frames; ++frame) {
+		benchmark.AddFrame(do_frame());
+	}
+	vk_device->waitIdle();
+	benchmark.Stop();
+
+	const auto report{ benchmark.GetReport() };
+	Profiling::Benchmark::PrintReport(std::cout, report);
+	return report;
+}
+
+void TriangleApp::MainLoop()
+{
+	if (pimpl->settings.cull_bench)
+	{
+		Profiling::CullingBenchmarkSettings cull_settings{};
+		cull_settings.object_count = pimpl->settings.cull_bench_objects;
+		cull_settings.thread_pool = pimpl->thread_pool.get();
+		Profiling::RunCullingBenchmark(std::cout, cull_settings);
+	}
+	else if (pimpl->settings.bench)
+	{
+		std::vector<Profiling::Benchmark::Report> reports{};
+
+		if (pimpl->settings.instance_stress)
+		{
+			// One draw of 1k, 10k, ... instances, to find where vertex throughput and per instance upload cost level off
+			pimpl->settings.draw_count = 1;
+			for (uint32_t instances{ std::min(1000u, pimpl->settings.max_instances) }; ; instances = static_cast<uint32_t>(std::min<uint64_t>(uint64_t{ instances } * 10, pimpl->settings.max_instances)))
+			{
+				// The previous run's uploads are done with, the new buffer's initial fill needs their staging space
+				pimpl->vk_device->waitIdle();
+				pimpl->upload_queue->Collect(pimpl->frame_scheduler->GetCompletedFrame());
+				pimpl->settings.instance_count = instances;
+				pimpl->CreateInstanceBuffer();
+				reports.push_back(pimpl->RunBenchmark());
+
+				if (instances >= pimpl->settings.max_instances) {
+					break;
+				}
+			}
+		}
+		else if (pimpl->settings.bench_thread_sweep)
+		{
+			// 1, 2, 4, ... and finally the full thread count
+			for (std::size_t threads{ 1 }; ; threads = std::min(threads * 2, pimpl->settings.thread_count))
+			{
+				pimpl->vk_device->waitIdle();
+				pimpl->CreateThreadPool(threads);
+				pimpl->CreateCommandPools();
+				reports.push_back(pimpl->RunBenchmark());
+
+				if (threads == pimpl->settings.thread_count) {
+					break;
+				}
+			}
+		}
+		else
+		{
+			reports.push_back(pimpl->RunBenchmark());
+		}
+
+		if (Profiling::Benchmark::WriteReportFile(pimpl->settings.bench_output_path, reports)) {
+			std::cout << "Wrote benchmark results to '" << pimpl->settings.bench_output_path.string() << "'\n";
+		}
+		else {
+			std::cerr << "Failed to write benchmark results to '" << pimpl->settings.bench_output_path.string() << "'\n";
+		}
+	}
+	else if (pimpl->settings.headless)
+	{
+		for (std::size_t frame{ 0 }; frame < pimpl->settings.headless_frame_count; ++frame) {
+			pimpl->DrawFrame();
+		}
+	}
+	else
+	{
+		while (!glfwWindowShouldClose(pimpl->window.get()))
+		{
+			glfwPollEvents();
+
+			// Do a frame
+			pimpl->DrawFrame();
+		}
+	}
+
+	pimpl->vk_device->waitIdle();
+
+	if (pimpl->frame_profiler)
+	{
+		Profiling::FrameProfiler::PrintReport(std::cout, pimpl->frame_profiler->GetReport());
+		pimpl->pipeline_variants->GetStats().Print(std::cout);
+	}
+
+	if (pimpl->settings.memory_stats) {
+		pimpl->memory_allocator->GetStats().Print(std::cout);
+	}
+
+	const std::size_t frames_drawn{ pimpl->settings.bench ? pimpl->settings.bench_frames : pimpl->settings.headless_frame_count };
+	if (pimpl->settings.headless && !pimpl->settings.headless_output_path.empty() && frames_drawn > 0)
+	{
+		const auto pixels{ TriangleApp_NS::ReadbackTarget(*pimpl->memory_allocator, pimpl->offscreen_targets.at(pimpl->last_submitted_image), pimpl->swap_chain_extent) };
+		TriangleApp_NS::WriteImageToFile(pimpl->settings.headless_output_path, pixels, pimpl->swap_chain_extent);
+		std::cout << "Wrote frame to '" << pimpl->settings.headless_output_path << "'\n";
+	}
+}
+
+void TriangleApp::OnDeinit()
+{
+	const bool headless{ pimpl->settings.headless };
+	const auto trace_path{ pimpl->settings.trace_path };
+
+	if (pimpl->pipeline_cache)
+	{
+		const Profiling::TraceScope trace{ "SavePipelineCache" };
+		const auto properties{ pimpl->physical_device.getProperties() };
+		Graphics::SavePipelineCache(*pimpl->vk_device, *pimpl->pipeline_cache, properties, pimpl->settings.cache_directory / Graphics::GetPipelineCacheFileName(properties));
+	}
+
+	{
+		const Profiling::TraceScope trace{ "Destroy" };
+		pimpl.reset();
+	}
+
+	// Everything that records from other threads (the pool, background builds) is gone by now
+	if (!trace_path.empty())
+	{
+		if (Profiling::WriteTrace(trace_path)) {
+			std::cout << "Wrote trace to '" << trace_path.string() << "'\n";
+		}
+		else {
+			std::cerr << "Failed to write trace to '" << trace_path.string() << "'\n";
+		}
+	}
+
+	if (!headless) {
+		glfwTerminate();
+	}
 }
@@ -0,0 +1,178 @@
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include <string>
+
+#include "BindlessHeap.hpp"
+
+namespace
+{
+	[[nodiscard]] std::string GetName(Graphics::BindlessType type)
+	{
+		switch (type)
+		{
+		case Graphics::BindlessType::eSampledImage: return "sampled image";
+		case Graphics::BindlessType::eStorageBuffer: return "storage buffer";
+		case Graphics::BindlessType::eSampler: return "sampler";
+		default: return "unknown";
+		}
+	}
+}
+
+namespace Graphics
+{
+	bool BindlessHeap::IsSupported(vk::PhysicalDevice physical_device)
+	{
+		// Shaders pick the storage buffer with a push constant, which is dynamically uniform indexing and a core feature
+		const auto features_chain{ physical_device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>() };
+		const auto& core_features{ features_chain.get<vk::PhysicalDeviceFeatures2>().features };
+		const auto& features{ features_chain.get<vk::PhysicalDeviceVulkan12Features>() };
+		return core_features.shaderStorageBufferArrayDynamicIndexing == VK_TRUE
+			&& features.runtimeDescriptorArray == VK_TRUE
+			&& features.descriptorBindingPartiallyBound == VK_TRUE
+			&& features.descriptorBindingSampledImageUpdateAfterBind == VK_TRUE // covers samplers too
+			&& features.descriptorBindingStorageBufferUpdateAfterBind == VK_TRUE;
+	}
+
+	BindlessHeap::BindlessHeap(vk::Device& logical_device, vk::PhysicalDevice physical_device, const Capacities& capacities)
+		: device{ logical_device }
+	{
+		assert(IsSupported(physical_device));
+
+		// Every stage can see the whole heap, so the per stage limits apply as well as the per set ones
+		const auto properties{ physical_device.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceVulkan12Properties>().get<vk::PhysicalDeviceVulkan12Properties>() };
+		auto& sampled_images{ slots[static_cast<std::size_t>(BindlessType::eSampledImage)].capacity };
+		auto& storage_buffers{ slots[static_cast<std::size_t>(BindlessType::eStorageBuffer)].capacity };
+		auto& samplers{ slots[static_cast<std::size_t>(BindlessType::eSampler)].capacity };
+		sampled_images = std::min({ capacities.sampled_images, properties.maxDescriptorSetUpdateAfterBindSampledImages, properties.maxPerStageDescriptorUpdateAfterBindSampledImages });
+		storage_buffers = std::min({ capacities.storage_buffers, properties.maxDescriptorSetUpdateAfterBindStorageBuffers, properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers });
+		samplers = std::min({ capacities.samplers, properties.maxDescriptorSetUpdateAfterBindSamplers, properties.maxPerStageDescriptorUpdateAfterBindSamplers });
+
+		// Then shrink everything evenly until the arrays fit in the stage's resource limit together
+		const uint64_t total{ uint64_t{ sampled_images } + storage_buffers + samplers };
+		if (total > properties.maxPerStageUpdateAfterBindResources)
+		{
+			for (auto* capacity : { &sampled_images, &storage_buffers, &samplers }) {
+				*capacity = static_cast<uint32_t>(uint64_t{ *capacity } * properties.maxPerStageUpdateAfterBindResources / total);
+			}
+		}
+
+		const std::array bindings{
+			vk::DescriptorSetLayoutBinding{ static_cast<uint32_t>(BindlessType::eSampledImage), vk::DescriptorType::eSampledImage, sampled_images, vk::ShaderStageFlagBits::eAll },
+			vk::DescriptorSetLayoutBinding{ static_cast<uint32_t>(BindlessType::eStorageBuffer), vk::DescriptorType::eStorageBuffer, storage_buffers, vk::ShaderStageFlagBits::eAll },
+			vk::DescriptorSetLayoutBinding{ static_cast<uint32_t>(BindlessType::eSampler), vk::DescriptorType::eSampler, samplers, vk::ShaderStageFlagBits::eAll },
+		};
+
+		// Partially bound as most slots are empty at any one time, and update after bind so new resources can be written while
+		// frames still in flight have the set bound
+		const vk::DescriptorBindingFlags binding_flags{ vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind };
+		const std::array<vk::DescriptorBindingFlags, bindings.size()> flags{ binding_flags, binding_flags, binding_flags };
+
+		vk::StructureChain<vk::DescriptorSetLayoutCreateInfo, vk::DescriptorSetLayoutBindingFlagsCreateInfo> layout_info_chain{};
+		layout_info_chain.get<vk::DescriptorSetLayoutCreateInfo>()
+			.setFlags(vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool)
+			.setBindings(bindings);
+		layout_info_chain.get<vk::DescriptorSetLayoutBindingFlagsCreateInfo>()
+			.setBindingFlags(flags);
+		layout = device.createDescriptorSetLayoutUnique(layout_info_chain.get<vk::DescriptorSetLayoutCreateInfo>());
+
+		const std::array pool_sizes{
+			vk::DescriptorPoolSize{ vk::DescriptorType::eSampledImage, sampled_images },
+			vk::DescriptorPoolSize{ vk::DescriptorType::eStorageBuffer, storage_buffers },
+			vk::DescriptorPoolSize{ vk::DescriptorType::eSampler, samplers },
+		};
+		pool = device.createDescriptorPoolUnique(vk::DescriptorPoolCreateInfo{}
+			.setFlags(vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind)
+			.setMaxSets(1)
+			.setPoolSizes(pool_sizes)
+		);
+		set = device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo{}
+			.setDescriptorPool(*pool)
+			.setSetLayouts(*layout)
+		).front();
+	}
+
+	uint32_t BindlessHeap::AddSampledImage(vk::ImageView view, vk::ImageLayout image_layout)
+	{
+		const uint32_t slot{ Allocate(BindlessType::eSampledImage) };
+		const vk::DescriptorImageInfo image_info{ {}, view, image_layout };
+		device.updateDescriptorSets(vk::WriteDescriptorSet{}
+			.setDstSet(set)
+			.setDstBinding(static_cast<uint32_t>(BindlessType::eSampledImage))
+			.setDstArrayElement(slot)
+			.setDescriptorType(vk::DescriptorType::eSampledImage)
+			.setImageInfo(image_info), {});
+		return slot;
+	}
+
+	uint32_t BindlessHeap::AddStorageBuffer(vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize range)
+	{
+		const uint32_t slot{ Allocate(BindlessType::eStorageBuffer) };
+		const vk::DescriptorBufferInfo buffer_info{ buffer, offset, range };
+		device.updateDescriptorSets(vk::WriteDescriptorSet{}
+			.setDstSet(set)
+			.setDstBinding(static_cast<uint32_t>(BindlessType::eStorageBuffer))
+			.setDstArrayElement(slot)
+			.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+			.setBufferInfo(buffer_info), {});
+		return slot;
+	}
+
+	uint32_t BindlessHeap::AddSampler(vk::Sampler sampler)
+	{
+		const uint32_t slot{ Allocate(BindlessType::eSampler) };
+		const vk::DescriptorImageInfo image_info{ sampler };
+		device.updateDescriptorSets(vk::WriteDescriptorSet{}
+			.setDstSet(set)
+			.setDstBinding(static_cast<uint32_t>(BindlessType::eSampler))
+			.setDstArrayElement(slot)
+			.setDescriptorType(vk::DescriptorType::eSampler)
+			.setImageInfo(image_info), {});
+		return slot;
+	}
+
+	void BindlessHeap::Free(BindlessType type, uint32_t slot, uint64_t last_used_frame)
+	{
+		assert(slot < slots[static_cast<std::size_t>(type)].next);
+		assert(pending.empty() || pending.back().frame <= last_used_frame);
+
+		// The descriptor is left as it is, partially bound lets it go stale as long as no shader reads it
+		pending.push_back(PendingFree{ last_used_frame, type, slot });
+	}
+
+	std::size_t BindlessHeap::Collect(uint64_t completed_frame)
+	{
+		std::size_t count{ 0 };
+		while (!pending.empty() && pending.front().frame <= completed_frame)
+		{
+			slots[static_cast<std::size_t>(pending.front().type)].free.push_back(pending.front().slot);
+			pending.pop_front();
+			++count;
+		}
+		return count;
+	}
+
+	uint32_t BindlessHeap::GetUsedCount(BindlessType type) const noexcept
+	{
+		const auto& array{ slots[static_cast<std::size_t>(type)] };
+		return array.next - static_cast<uint32_t>(array.free.size());
+	}
+
+	uint32_t BindlessHeap::Allocate(BindlessType type)
+	{
+		// Recycled slots before fresh ones, so the arrays only grow while every slot handed out is still in use
+		auto& array{ slots[static_cast<std::size_t>(type)] };
+		if (!array.free.empty())
+		{
+			const uint32_t slot{ array.free.back() };
+			array.free.pop_back();
+			return slot;
+		}
+
+		if (array.next == array.capacity) {
+			throw std::runtime_error("Bindless heap is out of " + GetName(type) + " slots (" + std::to_string(array.capacity) + ")");
+		}
+		return array.next++;
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "LearningVulkan/Bridges/vulkan.hpp"
+
+namespace Graphics
+{
+	/// Which array of the heap a slot belongs to, also the binding the array is at
+	enum class BindlessType : uint32_t
+	{
+		eSampledImage = 0,
+		eStorageBuffer = 1,
+		eSampler = 2,
+	};
+
+	/// One large update-after-bind descriptor set with an array each of sampled images, storage buffers and samplers.
+	/// Shaders index the arrays with slots passed in push constants, so the set is bound once per command buffer whatever the draws use,
+	/// and adding a resource is a single descriptor write instead of a new set.
+	/// Freed slots are only handed out again once the frames that may still read them have completed. Not thread safe.
+	class BindlessHeap
+	{
+	public:
+		struct Capacities
+		{
+			uint32_t sampled_images{ 16 * 1024 };
+			uint32_t storage_buffers{ 16 * 1024 };
+			uint32_t samplers{ 256 };
+		};
+
+		/// Whether the device has the descriptor indexing features the heap needs. Enabling them at device creation is up to the caller.
+		[[nodiscard]] static bool IsSupported(vk::PhysicalDevice physical_device);
+
+		/// Capacities are clamped to the device's update-after-bind limits
+		BindlessHeap(vk::Device& device, vk::PhysicalDevice physical_device, const Capacities& capacities = {});
+
+		/// Each returns the slot shaders index the matching array with. Throws when the array is full.
+		[[nodiscard]] uint32_t AddSampledImage(vk::ImageView view, vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal);
+		[[nodiscard]] uint32_t AddStorageBuffer(vk::Buffer buffer, vk::DeviceSize offset = 0, vk::DeviceSize range = VK_WHOLE_SIZE);
+		[[nodiscard]] uint32_t AddSampler(vk::Sampler sampler);
+
+		/// last_used_frame is the newest frame number that might read the slot. Frame numbers passed in must not go down.
+		void Free(BindlessType type, uint32_t slot, uint64_t last_used_frame);
+		/// Makes the slots freed by frames up to and including completed_frame available again. Returns how many were recycled.
+		std::size_t Collect(uint64_t completed_frame);
+
+		[[nodiscard]] vk::DescriptorSetLayout GetLayout() const noexcept { return *layout; }
+		[[nodiscard]] vk::DescriptorSet GetSet() const noexcept { return set; }
+		[[nodiscard]] uint32_t GetCapacity(BindlessType type) const noexcept { return slots[static_cast<std::size_t>(type)].capacity; }
+		/// Slots handed out and not yet recycled, including ones waiting on a frame
+		[[nodiscard]] uint32_t GetUsedCount(BindlessType type) const noexcept;
+
+	private:
+		struct Slots
+		{
+			uint32_t capacity{ 0 };
+			uint32_t next{ 0 }; // slots from here on have never been used
+			std::vector<uint32_t> free{};
+		};
+
+		struct PendingFree
+		{
+			uint64_t frame{ 0 };
+			BindlessType type{};
+			uint32_t slot{ 0 };
+		};
+
+		[[nodiscard]] uint32_t Allocate(BindlessType type);
+
+		vk::Device& device;
+		vk::UniqueDescriptorSetLayout layout{};
+		vk::UniqueDescriptorPool pool{};
+		vk::DescriptorSet set{}; // freed with the pool
+		std::array<Slots, 3> slots{};
+		std::deque<PendingFree> pending{};
+	};
+}
@@ -0,0 +1,18 @@
+
+#include "Buffer.hpp"
+
+namespace Graphics
+{
+	Buffer CreateBuffer(vk::Device& device, MemoryAllocator& allocator, vk::DeviceSize size, vk::BufferUsageFlags usage, const AllocationDesc& desc)
+	{
+		Buffer buffer{};
+		buffer.size = size;
+		buffer.buffer = device.createBufferUnique(vk::BufferCreateInfo{}
+			.setSize(size)
+			.setUsage(usage)
+			.setSharingMode(vk::SharingMode::eExclusive)
+		);
+		buffer.memory = allocator.AllocateForBuffer(*buffer.buffer, desc);
+		return buffer;
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "LearningVulkan/Bridges/vulkan.hpp"
+#include "LearningVulkan/Graphics/MemoryAllocator.hpp"
+
+namespace Graphics
+{
+	/// A buffer together with the memory bound to it
+	struct Buffer
+	{
+		/// WARNING: Order of members is important! The buffer must be destroyed before its memory goes back to the allocator
+		Allocation memory{};
+		vk::UniqueBuffer buffer{};
+		vk::DeviceSize size{ 0 };
+	};
+
+	[[nodiscard]] Buffer CreateBuffer(vk::Device& device, MemoryAllocator& allocator, vk::DeviceSize size, vk::BufferUsageFlags usage, const AllocationDesc& desc = {});
+}
@@ -0,0 +1,468 @@
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CULL_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define CULL_NEON
+#include <arm_neon.h>
+#endif
+
+// MSVC lets any function use any intrinsic, GCC and Clang need the instruction set enabled per function
+#if defined(CULL_X86) && !defined(_MSC_VER)
+#define CULL_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CULL_TARGET_AVX2
+#endif
+
+#include "LearningVulkan/Utility/ThreadPool.hpp"
+
+#include "CpuCulling.hpp"
+
+// The kernels only agree bit for bit while nothing fuses a multiply and an add they don't, which compilers targeting ARM64 do by default
+#if defined(_MSC_VER) && !defined(__clang__)
+#pragma fp_contract(off)
+#elif defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+namespace
+{
+	using Graphics::CullParams;
+	using Graphics::CullShape;
+	using Graphics::ObjectBounds;
+
+	constexpr std::size_t plane_count{ std::tuple_size_v<decltype(Graphics::Frustum::planes)> };
+	constexpr float min_lod_depth{ 1e-4f }; // objects at or behind the eye get the most detailed LOD rather than dividing by zero
+
+	/// Signature shared by every kernel: culls [begin, end), returns the number of visible objects
+	using CullRangeFn = std::size_t(*)(const ObjectBounds& bounds, const CullParams& params, std::size_t begin, std::size_t end, uint8_t* lods);
+
+	// Every kernel evaluates the same expressions in the same order, without fused multiply-adds, so they agree bit for bit with the scalar one
+
+	template<CullShape shape>
+	std::size_t CullRangeScalar(const ObjectBounds& bounds, const CullParams& params, std::size_t begin, std::size_t end, uint8_t* lods)
+	{
+		std::size_t visible_count{ 0 };
+		for (std::size_t idx{ begin }; idx < end; ++idx)
+		{
+			const float cx{ bounds.centre_x[idx] };
+			const float cy{ bounds.centre_y[idx] };
+			const float cz{ bounds.centre_z[idx] };
+			const float radius{ bounds.radius[idx] };
+
+			bool visible{ true };
+			for (const auto& plane : params.frustum.planes)
+			{
+				// how far the bounds reach towards the plane from their centre
+				float reach{ radius };
+				if constexpr (shape == CullShape::eAabb) {
+					reach = std::abs(plane.x) * bounds.extent_x[idx] + std::abs(plane.y) * bounds.extent_y[idx] + std::abs(plane.z) * bounds.extent_z[idx];
+				}
+
+				const float distance{ plane.x * cx + plane.y * cy + plane.z * cz + plane.w };
+				if (distance < -reach)
+				{
+					visible = false;
+					break;
+				}
+			}
+
+			if (!visible)
+			{
+				lods[idx] = Graphics::culled_lod;
+				continue;
+			}
+
+			const float depth{ params.depth_row.x * cx + params.depth_row.y * cy + params.depth_row.z * cz + params.depth_row.w };
+			const float size{ radius * params.lod_scale / std::max(depth, min_lod_depth) };
+			uint32_t lod{ 0 };
+			for (uint32_t threshold{ 0 }; threshold + 1 < params.lod_count; ++threshold) {
+				lod += size < params.lod_thresholds[threshold] ? 1 : 0;
+			}
+			lods[idx] = static_cast<uint8_t>(lod);
+			++visible_count;
+		}
+
+		return visible_count;
+	}
+
+#ifdef CULL_X86
+	template<CullShape shape>
+	std::size_t CullRangeSse(const ObjectBounds& bounds, const CullParams& params, std::size_t begin, std::size_t end, uint8_t* lods)
+	{
+		constexpr std::size_t lanes{ 4 };
+		const auto sign_mask{ _mm_set1_ps(-0.f) };
+
+		__m128 px[plane_count], py[plane_count], pz[plane_count], pw[plane_count], abs_x[plane_count], abs_y[plane_count], abs_z[plane_count];
+		for (std::size_t plane{ 0 }; plane < plane_count; ++plane)
+		{
+			px[plane] = _mm_set1_ps(params.frustum.planes[plane].x);
+			py[plane] = _mm_set1_ps(params.frustum.planes[plane].y);
+			pz[plane] = _mm_set1_ps(params.frustum.planes[plane].z);
+			pw[plane] = _mm_set1_ps(params.frustum.planes[plane].w);
+			abs_x[plane] = _mm_andnot_ps(sign_mask, px[plane]);
+			abs_y[plane] = _mm_andnot_ps(sign_mask, py[plane]);
+			abs_z[plane] = _mm_andnot_ps(sign_mask, pz[plane]);
+		}
+		const auto dx{ _mm_set1_ps(params.depth_row.x) };
+		const auto dy{ _mm_set1_ps(params.depth_row.y) };
+		const auto dz{ _mm_set1_ps(params.depth_row.z) };
+		const auto dw{ _mm_set1_ps(params.depth_row.w) };
+		const auto lod_scale{ _mm_set1_ps(params.lod_scale) };
+		const auto min_depth{ _mm_set1_ps(min_lod_depth) };
+		const auto culled{ _mm_set1_epi32(Graphics::culled_lod) };
+
+		std::size_t visible_count{ 0 };
+		const std::size_t simd_end{ begin + (end - begin) / lanes * lanes };
+		for (std::size_t idx{ begin }; idx < simd_end; idx += lanes)
+		{
+			const auto cx{ _mm_loadu_ps(&bounds.centre_x[idx]) };
+			const auto cy{ _mm_loadu_ps(&bounds.centre_y[idx]) };
+			const auto cz{ _mm_loadu_ps(&bounds.centre_z[idx]) };
+			const auto radius{ _mm_loadu_ps(&bounds.radius[idx]) };
+
+			auto inside{ _mm_castsi128_ps(_mm_set1_epi32(-1)) };
+			for (std::size_t plane{ 0 }; plane < plane_count; ++plane)
+			{
+				auto reach{ radius };
+				if constexpr (shape == CullShape::eAabb)
+				{
+					reach = _mm_add_ps(_mm_add_ps(
+						_mm_mul_ps(abs_x[plane], _mm_loadu_ps(&bounds.extent_x[idx])),
+						_mm_mul_ps(abs_y[plane], _mm_loadu_ps(&bounds.extent_y[idx]))),
+						_mm_mul_ps(abs_z[plane], _mm_loadu_ps(&bounds.extent_z[idx])));
+				}
+
+				const auto distance{ _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px[plane], cx), _mm_mul_ps(py[plane], cy)), _mm_mul_ps(pz[plane], cz)), pw[plane]) };
+				inside = _mm_and_ps(inside, _mm_cmpnlt_ps(distance, _mm_xor_ps(reach, sign_mask)));
+			}
+
+			const auto depth{ _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, cx), _mm_mul_ps(dy, cy)), _mm_mul_ps(dz, cz)), dw) };
+			const auto size{ _mm_div_ps(_mm_mul_ps(radius, lod_scale), _mm_max_ps(min_depth, depth)) };
+			auto lod{ _mm_setzero_si128() };
+			for (uint32_t threshold{ 0 }; threshold + 1 < params.lod_count; ++threshold) {
+				lod = _mm_sub_epi32(lod, _mm_castps_si128(_mm_cmplt_ps(size, _mm_set1_ps(params.lod_thresholds[threshold])))); // true is -1
+			}
+
+			const auto inside_mask{ _mm_castps_si128(inside) };
+			const auto result{ _mm_or_si128(_mm_and_si128(inside_mask, lod), _mm_andnot_si128(inside_mask, culled)) };
+			const auto packed{ _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(result, result), _mm_setzero_si128())) };
+			std::memcpy(&lods[idx], &packed, lanes);
+
+			visible_count += static_cast<std::size_t>(std::popcount(static_cast<uint32_t>(_mm_movemask_ps(inside))));
+		}
+
+		return visible_count + CullRangeScalar<shape>(bounds, params, simd_end, end, lods);
+	}
+
+	template<CullShape shape>
+	CULL_TARGET_AVX2 std::size_t CullRangeAvx2(const ObjectBounds& bounds, const CullParams& params, std::size_t begin, std::size_t end, uint8_t* lods)
+	{
+		constexpr std::size_t lanes{ 8 };
+		const auto sign_mask{ _mm256_set1_ps(-0.f) };
+
+		__m256 px[plane_count], py[plane_count], pz[plane_count], pw[plane_count], abs_x[plane_count], abs_y[plane_count], abs_z[plane_count];
+		for (std::size_t plane{ 0 }; plane < plane_count; ++plane)
+		{
+			px[plane] = _mm256_set1_ps(params.frustum.planes[plane].x);
+			py[plane] = _mm256_set1_ps(params.frustum.planes[plane].y);
+			pz[plane] = _mm256_set1_ps(params.frustum.planes[plane].z);
+			pw[plane] = _mm256_set1_ps(params.frustum.planes[plane].w);
+			abs_x[plane] = _mm256_andnot_ps(sign_mask, px[plane]);
+			abs_y[plane] = _mm256_andnot_ps(sign_mask, py[plane]);
+			abs_z[plane] = _mm256_andnot_ps(sign_mask, pz[plane]);
+		}
+		const auto dx{ _mm256_set1_ps(params.depth_row.x) };
+		const auto dy{ _mm256_set1_ps(params.depth_row.y) };
+		const auto dz{ _mm256_set1_ps(params.depth_row.z) };
+		const auto dw{ _mm256_set1_ps(params.depth_row.w) };
+		const auto lod_scale{ _mm256_set1_ps(params.lod_scale) };
+		const auto min_depth{ _mm256_set1_ps(min_lod_depth) };
+		const auto culled{ _mm256_set1_epi32(Graphics::culled_lod) };
+
+		std::size_t visible_count{ 0 };
+		const std::size_t simd_end{ begin + (end - begin) / lanes * lanes };
+		for (std::size_t idx{ begin }; idx < simd_end; idx += lanes)
+		{
+			const auto cx{ _mm256_loadu_ps(&bounds.centre_x[idx]) };
+			const auto cy{ _mm256_loadu_ps(&bounds.centre_y[idx]) };
+			const auto cz{ _mm256_loadu_ps(&bounds.centre_z[idx]) };
+			const auto radius{ _mm256_loadu_ps(&bounds.radius[idx]) };
+
+			auto inside{ _mm256_castsi256_ps(_mm256_set1_epi32(-1)) };
+			for (std::size_t plane{ 0 }; plane < plane_count; ++plane)
+			{
+				auto reach{ radius };
+				if constexpr (shape == CullShape::eAabb)
+				{
+					reach = _mm256_add_ps(_mm256_add_ps(
+						_mm256_mul_ps(abs_x[plane], _mm256_loadu_ps(&bounds.extent_x[idx])),
+						_mm256_mul_ps(abs_y[plane], _mm256_loadu_ps(&bounds.extent_y[idx]))),
+						_mm256_mul_ps(abs_z[plane], _mm256_loadu_ps(&bounds.extent_z[idx])));
+				}
+
+				const auto distance{ _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px[plane], cx), _mm256_mul_ps(py[plane], cy)), _mm256_mul_ps(pz[plane], cz)), pw[plane]) };
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_xor_ps(reach, sign_mask), _CMP_NLT_UQ));
+			}
+
+			const auto depth{ _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, cx), _mm256_mul_ps(dy, cy)), _mm256_mul_ps(dz, cz)), dw) };
+			const auto size{ _mm256_div_ps(_mm256_mul_ps(radius, lod_scale), _mm256_max_ps(min_depth, depth)) };
+			auto lod{ _mm256_setzero_si256() };
+			for (uint32_t threshold{ 0 }; threshold + 1 < params.lod_count; ++threshold) {
+				lod = _mm256_sub_epi32(lod, _mm256_castps_si256(_mm256_cmp_ps(size, _mm256_set1_ps(params.lod_thresholds[threshold]), _CMP_LT_OQ)));
+			}
+
+			const auto result{ _mm256_blendv_epi8(culled, lod, _mm256_castps_si256(inside)) };
+			// pack within the 128-bit halves, which keeps the lanes in order as the halves are packed separately
+			const auto words{ _mm_packs_epi32(_mm256_castsi256_si128(result), _mm256_extracti128_si256(result, 1)) };
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(&lods[idx]), _mm_packus_epi16(words, words));
+
+			visible_count += static_cast<std::size_t>(std::popcount(static_cast<uint32_t>(_mm256_movemask_ps(inside))));
+		}
+
+		return visible_count + CullRangeScalar<shape>(bounds, params, simd_end, end, lods);
+	}
+
+	[[nodiscard]] bool DetectAvx2() noexcept
+	{
+#if defined(_MSC_VER)
+		std::array<int, 4> info{};
+		__cpuid(info.data(), 0);
+		if (info[0] < 7) {
+			return false;
+		}
+
+		// the OS has to save the AVX registers on context switches too
+		__cpuid(info.data(), 1);
+		const bool os_saves_avx{ (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 0x6) == 0x6 };
+
+		__cpuidex(info.data(), 7, 0);
+		return os_saves_avx && (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+
+#ifdef CULL_NEON
+	template<CullShape shape>
+	std::size_t CullRangeNeon(const ObjectBounds& bounds, const CullParams& params, std::size_t begin, std::size_t end, uint8_t* lods)
+	{
+		constexpr std::size_t lanes{ 4 };
+
+		float32x4_t px[plane_count], py[plane_count], pz[plane_count], pw[plane_count], abs_x[plane_count], abs_y[plane_count], abs_z[plane_count];
+		for (std::size_t plane{ 0 }; plane < plane_count; ++plane)
+		{
+			px[plane] = vdupq_n_f32(params.frustum.planes[plane].x);
+			py[plane] = vdupq_n_f32(params.frustum.planes[plane].y);
+			pz[plane] = vdupq_n_f32(params.frustum.planes[plane].z);
+			pw[plane] = vdupq_n_f32(params.frustum.planes[plane].w);
+			abs_x[plane] = vabsq_f32(px[plane]);
+			abs_y[plane] = vabsq_f32(py[plane]);
+			abs_z[plane] = vabsq_f32(pz[plane]);
+		}
+		const auto dx{ vdupq_n_f32(params.depth_row.x) };
+		const auto dy{ vdupq_n_f32(params.depth_row.y) };
+		const auto dz{ vdupq_n_f32(params.depth_row.z) };
+		const auto dw{ vdupq_n_f32(params.depth_row.w) };
+		const auto lod_scale{ vdupq_n_f32(params.lod_scale) };
+		const auto min_depth{ vdupq_n_f32(min_lod_depth) };
+		const auto culled{ vdupq_n_u32(Graphics::culled_lod) };
+
+		std::size_t visible_count{ 0 };
+		const std::size_t simd_end{ begin + (end - begin) / lanes * lanes };
+		for (std::size_t idx{ begin }; idx < simd_end; idx += lanes)
+		{
+			const auto cx{ vld1q_f32(&bounds.centre_x[idx]) };
+			const auto cy{ vld1q_f32(&bounds.centre_y[idx]) };
+			const auto cz{ vld1q_f32(&bounds.centre_z[idx]) };
+			const auto radius{ vld1q_f32(&bounds.radius[idx]) };
+
+			auto inside{ vdupq_n_u32(~0u) };
+			for (std::size_t plane{ 0 }; plane < plane_count; ++plane)
+			{
+				auto reach{ radius };
+				if constexpr (shape == CullShape::eAabb)
+				{
+					reach = vaddq_f32(vaddq_f32(
+						vmulq_f32(abs_x[plane], vld1q_f32(&bounds.extent_x[idx])),
+						vmulq_f32(abs_y[plane], vld1q_f32(&bounds.extent_y[idx]))),
+						vmulq_f32(abs_z[plane], vld1q_f32(&bounds.extent_z[idx])));
+				}
+
+				const auto distance{ vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(px[plane], cx), vmulq_f32(py[plane], cy)), vmulq_f32(pz[plane], cz)), pw[plane]) };
+				inside = vbicq_u32(inside, vcltq_f32(distance, vnegq_f32(reach)));
+			}
+
+			const auto depth{ vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(dx, cx), vmulq_f32(dy, cy)), vmulq_f32(dz, cz)), dw) };
+			const auto size{ vdivq_f32(vmulq_f32(radius, lod_scale), vmaxq_f32(depth, min_depth)) };
+			auto lod{ vdupq_n_u32(0) };
+			for (uint32_t threshold{ 0 }; threshold + 1 < params.lod_count; ++threshold) {
+				lod = vsubq_u32(lod, vcltq_f32(size, vdupq_n_f32(params.lod_thresholds[threshold]))); // true is all ones, i.e. -1
+			}
+
+			const auto result{ vbslq_u32(inside, lod, culled) };
+			const auto narrow{ vmovn_u32(result) };
+			const auto bytes{ vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(vcombine_u16(narrow, narrow))), 0) };
+			std::memcpy(&lods[idx], &bytes, lanes);
+
+			visible_count += vaddvq_u32(vshrq_n_u32(inside, 31));
+		}
+
+		return visible_count + CullRangeScalar<shape>(bounds, params, simd_end, end, lods);
+	}
+#endif
+
+	[[nodiscard]] CullRangeFn GetRangeFunction(Graphics::CullKernel kernel, CullShape shape) noexcept
+	{
+		const bool sphere{ shape == CullShape::eSphere };
+		switch (kernel)
+		{
+#ifdef CULL_X86
+		case Graphics::CullKernel::eSse: return sphere ? &CullRangeSse<CullShape::eSphere> : &CullRangeSse<CullShape::eAabb>;
+		case Graphics::CullKernel::eAvx2: return sphere ? &CullRangeAvx2<CullShape::eSphere> : &CullRangeAvx2<CullShape::eAabb>;
+#endif
+#ifdef CULL_NEON
+		case Graphics::CullKernel::eNeon: return sphere ? &CullRangeNeon<CullShape::eSphere> : &CullRangeNeon<CullShape::eAabb>;
+#endif
+		default: return sphere ? &CullRangeScalar<CullShape::eSphere> : &CullRangeScalar<CullShape::eAabb>;
+		}
+	}
+
+	/// glm matrices are indexed [column][row]
+	[[nodiscard]] glm::vec4 GetRow(const glm::mat4& matrix, int row)
+	{
+		return { matrix[0][row], matrix[1][row], matrix[2][row], matrix[3][row] };
+	}
+}
+
+namespace Graphics
+{
+	void ObjectBounds::Resize(std::size_t count)
+	{
+		for (auto* component : { &centre_x, &centre_y, &centre_z, &radius, &extent_x, &extent_y, &extent_z }) {
+			component->resize(count);
+		}
+	}
+
+	Frustum Frustum::FromMatrix(const glm::mat4& view_projection)
+	{
+		// Clip space is inside when -w <= x <= w, -w <= y <= w and 0 <= z <= w
+		const auto x{ GetRow(view_projection, 0) };
+		const auto y{ GetRow(view_projection, 1) };
+		const auto z{ GetRow(view_projection, 2) };
+		const auto w{ GetRow(view_projection, 3) };
+
+		Frustum frustum{};
+		frustum.planes = { w + x, w - x, w + y, w - y, z, w - z };
+		for (auto& plane : frustum.planes)
+		{
+			const float length{ std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z) };
+			plane /= length;
+		}
+		return frustum;
+	}
+
+	CullParams CullParams::FromCamera(const glm::mat4& view, const glm::mat4& projection, float viewport_height, std::span<const float> lod_thresholds, CullShape shape)
+	{
+		assert(lod_thresholds.size() < max_lod_count);
+
+		const auto view_projection{ projection * view };
+
+		CullParams params{};
+		params.frustum = Frustum::FromMatrix(view_projection);
+		params.depth_row = GetRow(view_projection, 3);
+		params.lod_scale = std::abs(projection[1][1]) * viewport_height * .5f; // [1][1] is negative with Vulkan's flipped y
+		params.lod_count = static_cast<uint32_t>(std::min(lod_thresholds.size(), max_lod_count - 1)) + 1;
+		std::copy_n(std::begin(lod_thresholds), params.lod_count - 1, std::begin(params.lod_thresholds));
+		params.shape = shape;
+		return params;
+	}
+
+	bool IsSupported(CullKernel kernel) noexcept
+	{
+		switch (kernel)
+		{
+		case CullKernel::eScalar:
+			return true;
+#ifdef CULL_X86
+		case CullKernel::eSse:
+			return true; // SSE2 is part of x64, and required by the 32-bit build anyway
+		case CullKernel::eAvx2:
+		{
+			static const bool has_avx2{ DetectAvx2() };
+			return has_avx2;
+		}
+#endif
+#ifdef CULL_NEON
+		case CullKernel::eNeon:
+			return true;
+#endif
+		default:
+			return false;
+		}
+	}
+
+	CullKernel GetBestCullKernel() noexcept
+	{
+		for (const auto kernel : { CullKernel::eAvx2, CullKernel::eNeon, CullKernel::eSse })
+		{
+			if (IsSupported(kernel)) {
+				return kernel;
+			}
+		}
+		return CullKernel::eScalar;
+	}
+
+	std::string_view GetName(CullKernel kernel) noexcept
+	{
+		switch (kernel)
+		{
+		case CullKernel::eScalar: return "scalar";
+		case CullKernel::eSse: return "SSE";
+		case CullKernel::eAvx2: return "AVX2";
+		case CullKernel::eNeon: return "NEON";
+		default: return "unknown";
+		}
+	}
+
+	std::size_t CullObjects(const ObjectBounds& bounds, const CullParams& params, std::span<uint8_t> lods, const CullOptions& options)
+	{
+		assert(lods.size() >= bounds.Size());
+		assert(params.lod_count >= 1 && params.lod_count <= max_lod_count);
+
+		const auto kernel{ options.kernel.value_or(GetBestCullKernel()) };
+		assert(IsSupported(kernel));
+		const auto cull_range{ GetRangeFunction(kernel, params.shape) };
+
+		// Whole SIMD widths per job so only the very last one has a scalar tail
+		const std::size_t count{ bounds.Size() };
+		const std::size_t job_size{ std::max<std::size_t>((options.objects_per_job + 7) / 8 * 8, 8) };
+		const std::size_t job_count{ (count + job_size - 1) / job_size };
+
+		if (!options.thread_pool || job_count < 2) {
+			return cull_range(bounds, params, 0, count, lods.data());
+		}
+
+		std::vector<std::size_t> visible(job_count, 0);
+		options.thread_pool->ParallelFor(job_count, [&](std::size_t job)
+			{
+				const std::size_t begin{ job * job_size };
+				visible[job] = cull_range(bounds, params, begin, std::min(begin + job_size, count), lods.data());
+			});
+
+		return std::accumulate(std::begin(visible), std::end(visible), std::size_t{ 0 });
+	}
+}
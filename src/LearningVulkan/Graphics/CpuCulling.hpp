@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "LearningVulkan/Bridges/glm.hpp"
+
+namespace Utility
+{
+	class ThreadPool;
+}
+
+namespace Graphics
+{
+	/// Bounds of many objects as a structure of arrays, so the SIMD kernels load 4 or 8 objects' worth of a component at once.
+	/// The sphere and the box share their centre. The sphere is also what LOD selection goes by, whichever shape is culled.
+	struct ObjectBounds
+	{
+		std::vector<float> centre_x{};
+		std::vector<float> centre_y{};
+		std::vector<float> centre_z{};
+		std::vector<float> radius{};
+		std::vector<float> extent_x{}; // half size of the axis aligned box
+		std::vector<float> extent_y{};
+		std::vector<float> extent_z{};
+
+		void Resize(std::size_t count);
+		[[nodiscard]] std::size_t Size() const noexcept { return centre_x.size(); }
+	};
+
+	/// Normals point inwards, a point p is inside when dot(plane.xyz, p) + plane.w >= 0 for every plane
+	struct Frustum
+	{
+		std::array<glm::vec4, 6> planes{}; // left, right, bottom, top, near, far
+
+		/// Extracts the planes of a view-projection matrix with Vulkan's 0 to 1 depth range, normalised so distances are in world units
+		[[nodiscard]] static Frustum FromMatrix(const glm::mat4& view_projection);
+	};
+
+	enum class CullShape : uint8_t
+	{
+		eSphere,
+		eAabb,
+	};
+
+	enum class CullKernel : uint8_t
+	{
+		eScalar, // reference implementation, the others must give the same results
+		eSse,
+		eAvx2,
+		eNeon,
+	};
+
+	constexpr std::size_t max_lod_count{ 8 };
+	constexpr uint8_t culled_lod{ 0xFF }; // written for objects outside the frustum
+
+	struct CullParams
+	{
+		Frustum frustum{};
+		glm::vec4 depth_row{}; // row 3 of the view-projection, i.e. clip space w, which is view depth for a perspective projection
+		float lod_scale{ 1.f }; // radius / depth * lod_scale is the projected radius in pixels
+		std::array<float, max_lod_count - 1> lod_thresholds{}; // projected radius in pixels below which LOD i + 1 is used, descending
+		uint32_t lod_count{ 1 };
+		CullShape shape{ CullShape::eSphere };
+
+		/// lod_thresholds are in pixels of projected radius on a viewport viewport_height pixels high, at most max_lod_count - 1 of them
+		[[nodiscard]] static CullParams FromCamera(const glm::mat4& view, const glm::mat4& projection, float viewport_height, std::span<const float> lod_thresholds, CullShape shape = CullShape::eSphere);
+	};
+
+	struct CullOptions
+	{
+		std::optional<CullKernel> kernel{}; // best one the CPU supports when empty
+		Utility::ThreadPool* thread_pool{ nullptr }; // null runs everything on the calling thread
+		std::size_t objects_per_job{ 64 * 1024 };
+	};
+
+	[[nodiscard]] bool IsSupported(CullKernel kernel) noexcept;
+	/// AVX2 over SSE when the CPU has it, NEON on ARM, scalar otherwise
+	[[nodiscard]] CullKernel GetBestCullKernel() noexcept;
+	[[nodiscard]] std::string_view GetName(CullKernel kernel) noexcept;
+
+	/// Writes the LOD of every object into lods, or culled_lod for objects outside the frustum. Returns how many objects are visible.
+	std::size_t CullObjects(const ObjectBounds& bounds, const CullParams& params, std::span<uint8_t> lods, const CullOptions& options = {});
+}
@@ -0,0 +1,258 @@
+
+#include <algorithm>
+#include <bit>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "LearningVulkan/Utility/Hash.hpp"
+
+#include "DebugMessageSink.hpp"
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// How long the logger thread sleeps once the ring is empty. Producers never wake it, so they don't make a syscall
+	constexpr std::chrono::milliseconds poll_interval{ 10 };
+	constexpr std::size_t summary_name_length{ 80 }; // of the text, for repeats of messages without an id name
+
+	constexpr VkDebugUtilsMessageSeverityFlagsEXT all_severities{ VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT };
+	constexpr VkDebugUtilsMessageTypeFlagsEXT all_types{ VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT };
+
+	/// Copies as much as fits, always null terminated. True if it didn't all fit
+	bool CopyTruncated(const char* source, std::span<char> destination) noexcept
+	{
+		const std::string_view text{ source ? source : "" };
+		const auto length{ std::min(text.size(), destination.size() - 1) };
+		std::copy_n(text.data(), length, destination.data());
+		destination[length] = '\0';
+		return length < text.size();
+	}
+}
+
+namespace Graphics
+{
+	void DebugMessageSink::Stats::Print(std::ostream& output) const
+	{
+		output << "Debug messages: " << received << " received, " << printed << " printed, " << repeats << " repeats, "
+			<< rate_limited << " over the rate limit, " << dropped << " dropped with the queue full, " << filtered << " filtered out\n";
+	}
+
+	DebugMessageSink::DebugMessageSink(std::ostream& output, const Settings& sink_settings)
+		: out{ output }
+		, settings{ sink_settings }
+		, severities{ static_cast<VkDebugUtilsMessageSeverityFlagsEXT>(sink_settings.severities) }
+		, types{ static_cast<VkDebugUtilsMessageTypeFlagsEXT>(sink_settings.types) }
+	{
+		const auto capacity{ std::bit_ceil(std::max<std::size_t>(settings.capacity, 2)) };
+		slots = std::make_unique<Slot[]>(capacity);
+		mask = capacity - 1;
+		for (std::size_t idx{ 0 }; idx < capacity; ++idx) {
+			slots[idx].sequence.store(idx, std::memory_order_relaxed);
+		}
+
+		logger = std::thread{ [this]() { Run(); } };
+	}
+
+	DebugMessageSink::~DebugMessageSink()
+	{
+		stopping.store(true, std::memory_order_release);
+		logger.join();
+
+		if (const auto stats{ GetStats() }; stats.received > 0) {
+			stats.Print(out);
+		}
+	}
+
+	void DebugMessageSink::SetSeverities(vk::DebugUtilsMessageSeverityFlagsEXT kept_severities) noexcept
+	{
+		severities.store(static_cast<VkDebugUtilsMessageSeverityFlagsEXT>(kept_severities), std::memory_order_relaxed);
+	}
+
+	void DebugMessageSink::SetTypes(vk::DebugUtilsMessageTypeFlagsEXT kept_types) noexcept
+	{
+		types.store(static_cast<VkDebugUtilsMessageTypeFlagsEXT>(kept_types), std::memory_order_relaxed);
+	}
+
+	vk::DebugUtilsMessengerCreateInfoEXT DebugMessageSink::GetMessengerCreateInfo() noexcept
+	{
+		return vk::DebugUtilsMessengerCreateInfoEXT
+		{
+			{},
+			static_cast<vk::DebugUtilsMessageSeverityFlagsEXT>(all_severities),
+			static_cast<vk::DebugUtilsMessageTypeFlagsEXT>(all_types),
+			&DebugMessageSink::OnMessage,
+			this
+		};
+	}
+
+	DebugMessageSink::Stats DebugMessageSink::GetStats() const noexcept
+	{
+		Stats stats{};
+		stats.received = received.load(std::memory_order_relaxed);
+		stats.filtered = filtered.load(std::memory_order_relaxed);
+		stats.dropped = dropped.load(std::memory_order_relaxed);
+		stats.printed = printed.load(std::memory_order_relaxed);
+		stats.repeats = repeats.load(std::memory_order_relaxed);
+		stats.rate_limited = rate_limited.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	VKAPI_ATTR VkBool32 VKAPI_CALL DebugMessageSink::OnMessage(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT type, const VkDebugUtilsMessengerCallbackDataEXT* callback_data, void* user_data)
+	{
+		auto& sink{ *static_cast<DebugMessageSink*>(user_data) };
+		if ((sink.severities.load(std::memory_order_relaxed) & severity) == 0 || (sink.types.load(std::memory_order_relaxed) & type) == 0)
+		{
+			sink.filtered.fetch_add(1, std::memory_order_relaxed);
+			return VK_FALSE;
+		}
+
+		sink.received.fetch_add(1, std::memory_order_relaxed);
+		sink.Push(severity, type, *callback_data);
+		return VK_FALSE;
+	}
+
+	void DebugMessageSink::Push(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT type, const VkDebugUtilsMessengerCallbackDataEXT& callback_data) noexcept
+	{
+		// Claim a position whose slot the logger thread is done with, another producer may get there first
+		uint64_t position{ enqueue_position.load(std::memory_order_relaxed) };
+		Slot* slot{ nullptr };
+		for (;;)
+		{
+			slot = &slots[position & mask];
+			const auto difference{ static_cast<int64_t>(slot->sequence.load(std::memory_order_acquire) - position) };
+			if (difference == 0)
+			{
+				if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			else if (difference < 0)
+			{
+				// still holds the message from a lap ago, i.e. full
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			else {
+				position = enqueue_position.load(std::memory_order_relaxed);
+			}
+		}
+
+		auto& message{ slot->message };
+		message.severity = severity;
+		message.type = type;
+		message.id_number = callback_data.messageIdNumber;
+		message.truncated = CopyTruncated(callback_data.pMessage, message.text);
+		CopyTruncated(callback_data.pMessageIdName, message.id_name);
+		slot->sequence.store(position + 1, std::memory_order_release);
+	}
+
+	void DebugMessageSink::Run()
+	{
+		struct Repeat
+		{
+			std::string name{};
+			uint64_t count{ 0 };
+			uint64_t reported{ 0 };
+		};
+		std::unordered_map<uint64_t, Repeat> seen{};
+
+		auto window_begin{ Clock::now() };
+		uint32_t window_lines{ 0 };
+		auto summary_begin{ Clock::now() };
+		uint64_t reported_dropped{ 0 };
+		uint64_t reported_rate_limited{ 0 };
+
+		const auto summarise = [&]()
+		{
+			for (auto& [key, repeat] : seen)
+			{
+				if (repeat.count > repeat.reported)
+				{
+					out << "[Validation-layer] " << repeat.name << " repeated " << repeat.count - repeat.reported << " more times\n";
+					repeat.reported = repeat.count;
+				}
+			}
+			if (const auto count{ rate_limited.load(std::memory_order_relaxed) }; count > reported_rate_limited)
+			{
+				out << "[Validation-layer] " << count - reported_rate_limited << " messages over the limit of " << settings.max_lines_per_second << " per second were not printed\n";
+				reported_rate_limited = count;
+			}
+			if (const auto count{ dropped.load(std::memory_order_relaxed) }; count > reported_dropped)
+			{
+				out << "[Validation-layer] " << count - reported_dropped << " messages were dropped with the queue full\n";
+				reported_dropped = count;
+			}
+		};
+
+		for (;;)
+		{
+			// Checked before draining, so whatever was pushed before the destructor started is still printed
+			const bool stop{ stopping.load(std::memory_order_acquire) };
+
+			bool any_message{ false };
+			for (;;)
+			{
+				auto& slot{ slots[dequeue_position & mask] };
+				if (slot.sequence.load(std::memory_order_acquire) != dequeue_position + 1) {
+					break;
+				}
+				any_message = true;
+
+				const auto& message{ slot.message };
+				const std::string_view text{ message.text.data() };
+				const uint64_t key{ message.id_number != 0 ? Utility::HashValue(message.id_number) : Utility::Fnv1a(text) };
+				if (const auto it{ seen.find(key) }; it != std::end(seen))
+				{
+					++it->second.count;
+					repeats.fetch_add(1, std::memory_order_relaxed);
+				}
+				else
+				{
+					const auto now{ Clock::now() };
+					if (now - window_begin >= std::chrono::seconds{ 1 })
+					{
+						window_begin = now;
+						window_lines = 0;
+					}
+
+					// Left out of seen, so the next one to arrive within the limit still gets printed in full
+					if (settings.max_lines_per_second > 0 && window_lines >= settings.max_lines_per_second) {
+						rate_limited.fetch_add(1, std::memory_order_relaxed);
+					}
+					else
+					{
+						++window_lines;
+						out << "[Validation-layer]"
+							<< '[' << vk::to_string(static_cast<vk::DebugUtilsMessageTypeFlagBitsEXT>(message.type)) << ']'
+							<< '[' << vk::to_string(static_cast<vk::DebugUtilsMessageSeverityFlagBitsEXT>(message.severity)) << ']'
+							<< ' ' << text << (message.truncated ? " [truncated]" : "")
+							<< '\n';
+						printed.fetch_add(1, std::memory_order_relaxed);
+
+						const std::string_view id_name{ message.id_name.data() };
+						seen.emplace(key, Repeat{ std::string{ id_name.empty() ? text.substr(0, summary_name_length) : id_name }, 1, 1 });
+					}
+				}
+
+				// Hands the slot back to the producers for the next lap
+				slot.sequence.store(dequeue_position + mask + 1, std::memory_order_release);
+				++dequeue_position;
+			}
+
+			if (stop || Clock::now() - summary_begin >= settings.summary_interval)
+			{
+				summarise();
+				summary_begin = Clock::now();
+			}
+			if (stop) {
+				break;
+			}
+			if (!any_message) {
+				std::this_thread::sleep_for(poll_interval);
+			}
+		}
+	}
+}
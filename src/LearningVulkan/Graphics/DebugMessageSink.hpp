@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <thread>
+
+#include "LearningVulkan/Bridges/vulkan.hpp"
+
+namespace Graphics
+{
+	/// Receives the debug utils messenger's (validation layer, loader) messages without ever doing I/O on the thread that reported them.
+	/// The callback copies the message into a slot of a fixed size lock-free ring and returns, a logger thread of its own prints them.
+	/// Only the first of a message (same message id, or same text for ones without an id) is printed, repeats are counted and their
+	/// counts printed every summary_interval. Past max_lines_per_second the rest are counted instead of printed, as are messages
+	/// arriving while the ring is full.
+	class DebugMessageSink
+	{
+	public:
+		struct Settings
+		{
+			std::size_t capacity{ 256 }; // messages queued for the logger thread, rounded up to a power of two
+			vk::DebugUtilsMessageSeverityFlagsEXT severities{ vk::DebugUtilsMessageSeverityFlagBitsEXT::eWarning | vk::DebugUtilsMessageSeverityFlagBitsEXT::eError };
+			vk::DebugUtilsMessageTypeFlagsEXT types{ vk::DebugUtilsMessageTypeFlagBitsEXT::eGeneral | vk::DebugUtilsMessageTypeFlagBitsEXT::eValidation | vk::DebugUtilsMessageTypeFlagBitsEXT::ePerformance };
+			uint32_t max_lines_per_second{ 20 }; // 0 for no limit
+			std::chrono::milliseconds summary_interval{ 5000 };
+		};
+
+		struct Stats
+		{
+			uint64_t received{ 0 }; // passed the filters
+			uint64_t filtered{ 0 };
+			uint64_t dropped{ 0 }; // ring was full
+			uint64_t printed{ 0 };
+			uint64_t repeats{ 0 };
+			uint64_t rate_limited{ 0 };
+
+			void Print(std::ostream& out) const;
+		};
+
+		/// Starts the logger thread, which writes to out
+		DebugMessageSink(std::ostream& output, const Settings& sink_settings);
+		/// Prints everything still queued, the outstanding repeat counts and the stats if anything was received
+		~DebugMessageSink();
+
+		DebugMessageSink(const DebugMessageSink&) = delete;
+		DebugMessageSink& operator=(const DebugMessageSink&) = delete;
+
+		/// Which messages are kept, can be changed from any thread at any time
+		void SetSeverities(vk::DebugUtilsMessageSeverityFlagsEXT kept_severities) noexcept;
+		void SetTypes(vk::DebugUtilsMessageTypeFlagsEXT kept_types) noexcept;
+
+		/// Subscribes to every severity and type so the filters can be widened later, whatever they filter out costs one atomic load.
+		/// Chained into the vk::InstanceCreateInfo it also covers vkCreateInstance/vkDestroyInstance, so the sink has to outlive the instance
+		[[nodiscard]] vk::DebugUtilsMessengerCreateInfoEXT GetMessengerCreateInfo() noexcept;
+
+		[[nodiscard]] Stats GetStats() const noexcept;
+
+	private:
+		struct Message
+		{
+			VkDebugUtilsMessageSeverityFlagBitsEXT severity{};
+			VkDebugUtilsMessageTypeFlagsEXT type{};
+			int32_t id_number{ 0 };
+			bool truncated{ false };
+			std::array<char, 128> id_name{}; // null terminated, like text
+			std::array<char, 2048> text{};
+		};
+
+		/// sequence says whose turn it is: equal to the position when free for a producer, position + 1 once written for the consumer
+		struct Slot
+		{
+			std::atomic<uint64_t> sequence{ 0 };
+			Message message{};
+		};
+
+		static VKAPI_ATTR VkBool32 VKAPI_CALL OnMessage(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT type, const VkDebugUtilsMessengerCallbackDataEXT* callback_data, void* user_data);
+		void Push(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT type, const VkDebugUtilsMessengerCallbackDataEXT& callback_data) noexcept;
+		void Run();
+
+		std::ostream& out;
+		const Settings settings;
+		std::atomic<VkDebugUtilsMessageSeverityFlagsEXT> severities;
+		std::atomic<VkDebugUtilsMessageTypeFlagsEXT> types;
+
+		std::unique_ptr<Slot[]> slots;
+		uint64_t mask{ 0 }; // capacity - 1
+		std::atomic<uint64_t> enqueue_position{ 0 }; // claimed by the producers
+		uint64_t dequeue_position{ 0 }; // logger thread only
+
+		std::atomic<uint64_t> received{ 0 };
+		std::atomic<uint64_t> filtered{ 0 };
+		std::atomic<uint64_t> dropped{ 0 };
+		std::atomic<uint64_t> printed{ 0 };
+		std::atomic<uint64_t> repeats{ 0 };
+		std::atomic<uint64_t> rate_limited{ 0 };
+
+		std::atomic<bool> stopping{ false };
+		std::thread logger; // last, so everything it uses exists before it starts
+	};
+}
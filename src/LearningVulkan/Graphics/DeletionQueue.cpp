@@ -0,0 +1,29 @@
+
+#include "DeletionQueue.hpp"
+
+namespace Graphics
+{
+	DeletionQueue::~DeletionQueue()
+	{
+		Flush();
+	}
+
+	std::size_t DeletionQueue::Collect(uint64_t completed_frame)
+	{
+		// frame numbers only go up so entries are already ordered by frame
+		std::size_t count{ 0 };
+		while (!entries.empty() && entries.front().frame <= completed_frame)
+		{
+			entries.pop_front();
+			++count;
+		}
+		return count;
+	}
+
+	void DeletionQueue::Flush() noexcept
+	{
+		while (!entries.empty()) {
+			entries.pop_front();
+		}
+	}
+}
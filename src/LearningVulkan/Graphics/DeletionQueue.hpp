@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <type_traits>
+
+namespace Graphics
+{
+	/// Holds on to objects the GPU may still be using until the frame that last used them has finished, instead of waiting for the device to go idle.
+	/// Anything movable can be retired (unique handles, vectors of them, unique_ptrs, ...), it is destroyed in the order it was retired.
+	class DeletionQueue
+	{
+	public:
+		DeletionQueue() = default;
+		~DeletionQueue();
+
+		DeletionQueue(const DeletionQueue&) = delete;
+		DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+		/// last_used_frame is the newest frame number that might reference the object
+		template<typename T>
+		void Retire(uint64_t last_used_frame, T&& object)
+		{
+			entries.push_back(Entry{ last_used_frame, std::make_shared<std::decay_t<T>>(std::forward<T>(object)) });
+		}
+
+		/// Destroys everything retired by frames up to and including completed_frame. Returns how many objects were destroyed.
+		std::size_t Collect(uint64_t completed_frame);
+
+		/// Destroys everything, only call once the device is idle.
+		void Flush() noexcept;
+
+		[[nodiscard]] bool IsEmpty() const noexcept { return entries.empty(); }
+
+	private:
+		struct Entry
+		{
+			uint64_t frame{ 0 };
+			std::shared_ptr<void> object{}; // type erased, destroys the right type when released
+		};
+
+		std::deque<Entry> entries{};
+	};
+}
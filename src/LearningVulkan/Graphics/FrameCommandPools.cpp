@@ -0,0 +1,58 @@
+
+#include <algorithm>
+#include <cassert>
+
+#include "FrameCommandPools.hpp"
+
+namespace Graphics
+{
+	FrameCommandPools::FrameCommandPools(vk::Device& logical_device, uint32_t family_index, uint32_t frames_in_flight, std::size_t threads)
+		: device{ logical_device }
+		, queue_family_index{ family_index }
+		, thread_count{ std::max<std::size_t>(threads, 1) }
+	{
+		pools.resize(frames_in_flight * thread_count);
+		for (auto& pool : pools)
+		{
+			// transient as everything is re-recorded (or at most reused) within a few frames
+			pool.pool = device.createCommandPoolUnique(vk::CommandPoolCreateInfo{}
+				.setFlags(vk::CommandPoolCreateFlagBits::eTransient)
+				.setQueueFamilyIndex(queue_family_index)
+			);
+		}
+	}
+
+	void FrameCommandPools::Reset(uint32_t frame_index)
+	{
+		assert(static_cast<std::size_t>(frame_index) * thread_count < pools.size());
+
+		for (std::size_t thread{ 0 }; thread < thread_count; ++thread)
+		{
+			auto& pool{ pools[frame_index * thread_count + thread] };
+			device.resetCommandPool(*pool.pool, {});
+			pool.primary.used = 0;
+			pool.secondary.used = 0;
+		}
+	}
+
+	vk::CommandBuffer FrameCommandPools::Allocate(uint32_t frame_index, vk::CommandBufferLevel level, std::size_t thread_index)
+	{
+		assert(thread_index < thread_count);
+
+		auto& pool{ pools.at(frame_index * thread_count + thread_index) };
+		auto& buffers{ level == vk::CommandBufferLevel::ePrimary ? pool.primary : pool.secondary };
+
+		if (buffers.used == buffers.buffers.size())
+		{
+			const auto allocated{ device.allocateCommandBuffers(vk::CommandBufferAllocateInfo{}
+				.setCommandPool(*pool.pool)
+				.setLevel(level)
+				.setCommandBufferCount(1)
+			) };
+			assert(allocated.size() == 1);
+			buffers.buffers.push_back(allocated.front());
+		}
+
+		return buffers.buffers[buffers.used++];
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "LearningVulkan/Bridges/vulkan.hpp"
+
+namespace Graphics
+{
+	/// Transient command pools per frame in flight and per recording thread. Each frame's pools are reset as a whole and command buffers are
+	/// handed out linearly, so there is no per-buffer reset or free, and buffers allocated in earlier frames get recycled.
+	/// Threads never share a pool, so recording on several threads at once needs no locking.
+	class FrameCommandPools
+	{
+	public:
+		FrameCommandPools(vk::Device& device, uint32_t queue_family_index, uint32_t frames_in_flight, std::size_t thread_count = 1);
+
+		/// Resets all of the frame's pools, every buffer allocated from them goes back to the initial state.
+		/// Only call once the GPU has finished the previous frame that used this frame_index, and not while other threads are allocating.
+		void Reset(uint32_t frame_index);
+
+		/// Next unused buffer of the frame's pool for the thread, more are only allocated when all of them have been handed out since the last Reset().
+		[[nodiscard]] vk::CommandBuffer Allocate(uint32_t frame_index, vk::CommandBufferLevel level = vk::CommandBufferLevel::ePrimary, std::size_t thread_index = 0);
+
+		[[nodiscard]] uint32_t GetQueueFamilyIndex() const noexcept { return queue_family_index; }
+		[[nodiscard]] std::size_t GetThreadCount() const noexcept { return thread_count; }
+
+	private:
+		struct Buffers
+		{
+			std::vector<vk::CommandBuffer> buffers{}; // owned by the pool, freed with it
+			std::size_t used{ 0 };
+		};
+
+		struct ThreadCommandPool
+		{
+			vk::UniqueCommandPool pool{};
+			Buffers primary{};
+			Buffers secondary{};
+		};
+
+		vk::Device& device;
+		uint32_t queue_family_index;
+		std::size_t thread_count;
+		std::vector<ThreadCommandPool> pools{}; // frames_in_flight * thread_count, grouped by frame
+	};
+}
@@ -0,0 +1,69 @@
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+#include "FrameScheduler.hpp"
+
+namespace Graphics
+{
+	FrameScheduler::FrameScheduler(vk::Device& logical_device, uint32_t frame_count)
+		: device{ logical_device }
+		, frames_in_flight{ std::max(frame_count, 1u) }
+	{
+		vk::StructureChain<vk::SemaphoreCreateInfo, vk::SemaphoreTypeCreateInfo> create_info{};
+		create_info.get<vk::SemaphoreTypeCreateInfo>()
+			.setSemaphoreType(vk::SemaphoreType::eTimeline)
+			.setInitialValue(0);
+
+		timeline = device.createSemaphoreUnique(create_info.get<vk::SemaphoreCreateInfo>());
+	}
+
+	uint64_t FrameScheduler::BeginFrame()
+	{
+		++frame_number;
+
+		// the frame that last used this frame's resources
+		if (frame_number > frames_in_flight) {
+			WaitForFrame(frame_number - frames_in_flight);
+		}
+
+		return frame_number;
+	}
+
+	void FrameScheduler::AbandonFrame()
+	{
+		assert(frame_number > 0);
+		--frame_number;
+	}
+
+	uint64_t FrameScheduler::GetCompletedFrame() const
+	{
+		known_completed = std::max(known_completed, device.getSemaphoreCounterValue(*timeline));
+		return known_completed;
+	}
+
+	bool FrameScheduler::IsFrameComplete(uint64_t frame) const
+	{
+		return frame <= known_completed || frame <= GetCompletedFrame();
+	}
+
+	void FrameScheduler::WaitForFrame(uint64_t frame) const
+	{
+		assert(frame <= frame_number && "Waiting on a frame that hasn't started would never return");
+
+		if (IsFrameComplete(frame)) {
+			return;
+		}
+
+		const auto semaphore{ *timeline };
+		const auto result{ device.waitSemaphores(vk::SemaphoreWaitInfo{}
+			.setSemaphores(semaphore)
+			.setValues(frame),
+			std::numeric_limits<uint64_t>::max()
+		) };
+		assert(result == vk::Result::eSuccess);
+
+		known_completed = std::max(known_completed, frame);
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+#include "LearningVulkan/Bridges/vulkan.hpp"
+
+namespace Graphics
+{
+	/// Paces frames with a single timeline semaphore instead of a fence per frame.
+	/// The last submission of frame N signals the timeline with N, so the host or any queue can wait on exactly the frame it depends on.
+	class FrameScheduler
+	{
+	public:
+		FrameScheduler(vk::Device& device, uint32_t frames_in_flight);
+
+		/// Starts the next frame, only blocks when the CPU has got frames_in_flight frames ahead of the GPU. Returns the new frame number.
+		uint64_t BeginFrame();
+		/// Undoes BeginFrame() for a frame that ended up submitting nothing (e.g. the swap chain went out of date), otherwise the timeline would never reach its number.
+		void AbandonFrame();
+
+		[[nodiscard]] uint32_t GetFramesInFlight() const noexcept { return frames_in_flight; }
+		/// Frame currently being recorded, this is the value its submission should signal. Starts at 1, 0 means "no frame".
+		[[nodiscard]] uint64_t GetFrameNumber() const noexcept { return frame_number; }
+		/// Index for per-frame resources, in [0, frames_in_flight)
+		[[nodiscard]] uint32_t GetFrameIndex() const noexcept { return static_cast<uint32_t>(frame_number % frames_in_flight); }
+		[[nodiscard]] vk::Semaphore GetTimeline() const noexcept { return *timeline; }
+
+		/// Latest frame the GPU has finished
+		[[nodiscard]] uint64_t GetCompletedFrame() const;
+		[[nodiscard]] bool IsFrameComplete(uint64_t frame) const;
+
+		/// Blocks until the GPU has finished the given frame, returns straight away if it already has.
+		void WaitForFrame(uint64_t frame) const;
+		/// Waits for every frame submitted so far.
+		void WaitIdle() const { WaitForFrame(frame_number); }
+
+	private:
+		vk::Device& device;
+		vk::UniqueSemaphore timeline{};
+		uint32_t frames_in_flight;
+		uint64_t frame_number{ 0 };
+		mutable uint64_t known_completed{ 0 }; // saves asking the driver about frames we already know are done
+	};
+}
@@ -0,0 +1,410 @@
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+
+#include "LearningVulkan/Graphics/ShaderCompiler.hpp"
+#include "LearningVulkan/Profiling/Trace.hpp"
+#include "LearningVulkan/Utility/ThreadPool.hpp"
+
+#include "GraphicsPipelines.hpp"
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	[[nodiscard]] double ElapsedMs(Clock::time_point since)
+	{
+		return std::chrono::duration<double, std::milli>{ Clock::now() - since }.count();
+	}
+
+	/// Also records the span as a trace event, so the per thread timeline shows which worker built what
+	[[nodiscard]] double ElapsedMs(Clock::time_point since, const char* trace_name)
+	{
+		const auto end{ Clock::now() };
+		Profiling::RecordTraceEvent(trace_name, since, end);
+		return std::chrono::duration<double, std::milli>{ end - since }.count();
+	}
+
+	/// Runs body(i) for i in [0, count) on the pool if there is one, otherwise serially.
+	void ForEach(Utility::ThreadPool* pool, std::size_t count, const std::function<void(std::size_t)>& body)
+	{
+		if (pool)
+		{
+			pool->ParallelFor(count, body);
+			return;
+		}
+
+		for (std::size_t idx{ 0 }; idx < count; ++idx) {
+			body(idx);
+		}
+	}
+
+#ifdef RUNTIME_SHADER_COMPILATION
+	[[nodiscard]] shaderc_shader_kind ToShaderKind(vk::ShaderStageFlagBits stage)
+	{
+		switch (stage)
+		{
+		case vk::ShaderStageFlagBits::eVertex: return shaderc_glsl_vertex_shader;
+		case vk::ShaderStageFlagBits::eTessellationControl: return shaderc_glsl_tess_control_shader;
+		case vk::ShaderStageFlagBits::eTessellationEvaluation: return shaderc_glsl_tess_evaluation_shader;
+		case vk::ShaderStageFlagBits::eGeometry: return shaderc_glsl_geometry_shader;
+		case vk::ShaderStageFlagBits::eFragment: return shaderc_glsl_fragment_shader;
+		case vk::ShaderStageFlagBits::eCompute: return shaderc_glsl_compute_shader;
+		default: return shaderc_glsl_infer_from_source;
+		}
+	}
+#endif
+
+	/// Compiles the stage first when it only has GLSL, filling in the timings as it goes
+	[[nodiscard]] vk::UniqueShaderModule CreateStageModule(vk::Device& device, const std::string& pipeline_name, const Graphics::ShaderStageDesc& stage, [[maybe_unused]] const Graphics::PipelineBatchOptions& options, Graphics::PipelineBatchTimings::Stage& timing)
+	{
+		timing.pipeline = pipeline_name;
+		timing.name = stage.name;
+
+		std::span<const uint32_t> spirv{ stage.spirv };
+
+#ifdef RUNTIME_SHADER_COMPILATION
+		std::optional<shaderc::SpvCompilationResult> compiled{};
+		if (spirv.empty() && !stage.glsl.empty())
+		{
+			thread_local shaderc::Compiler compiler{}; // compilers are not shared between threads
+
+			const auto compile_begin{ Clock::now() };
+			if (options.shader_cache) {
+				spirv = options.shader_cache->GetOrCompile(compiler, stage.glsl, ToShaderKind(stage.stage), stage.name);
+			}
+			else
+			{
+				compiled.emplace(CompileShader(compiler, stage.glsl, ToShaderKind(stage.stage), stage.name));
+				if (compiled->GetCompilationStatus() == shaderc_compilation_status_success) {
+					spirv = { compiled->cbegin(), compiled->cend() };
+				}
+			}
+			timing.compile_ms = ElapsedMs(compile_begin, "CompileShader");
+		}
+#endif
+
+		if (spirv.empty()) {
+			throw std::runtime_error("Shader stage '" + stage.name + "' of pipeline '" + pipeline_name + "' has no SPIR-V");
+		}
+
+		const auto module_begin{ Clock::now() };
+		auto module{ device.createShaderModuleUnique(vk::ShaderModuleCreateInfo{}
+			.setCodeSize(spirv.size_bytes())
+			.setPCode(spirv.data())
+		) };
+		timing.module_ms = ElapsedMs(module_begin, "CreateShaderModule");
+
+		return module;
+	}
+
+	/// Everything a vk::GraphicsPipelineCreateInfo points at. Holds pointers to its own members so must stay put once filled.
+	struct PipelineState
+	{
+		PipelineState() = default;
+		PipelineState(const PipelineState&) = delete;
+		PipelineState& operator=(const PipelineState&) = delete;
+
+		std::vector<vk::PipelineShaderStageCreateInfo> stages{};
+		vk::PipelineVertexInputStateCreateInfo vertex_input_info{};
+		vk::PipelineInputAssemblyStateCreateInfo input_assembly{};
+		vk::PipelineViewportStateCreateInfo viewport_info{};
+		vk::PipelineRasterizationStateCreateInfo rasterizer_info{};
+		vk::PipelineMultisampleStateCreateInfo multisampling{};
+		vk::PipelineDepthStencilStateCreateInfo depth_stencil_info{};
+		vk::PipelineColorBlendAttachmentState colour_blend_attachment{};
+		vk::PipelineColorBlendStateCreateInfo colour_blending{};
+		std::vector<vk::DynamicState> dynamic_states{};
+		vk::PipelineDynamicStateCreateInfo dynamic_state{};
+		vk::PipelineRenderingCreateInfoKHR rendering_info{};
+		vk::GraphicsPipelineCreateInfo create_info{};
+	};
+
+	void FillPipelineState(PipelineState& state, const Graphics::GraphicsPipelineDesc& desc, vk::PipelineLayout layout, std::span<const vk::UniqueShaderModule> modules)
+	{
+		assert(modules.size() == desc.stages.size());
+
+		for (std::size_t idx{ 0 }; idx < desc.stages.size(); ++idx)
+		{
+			state.stages.push_back(vk::PipelineShaderStageCreateInfo{}
+				.setModule(*modules[idx])
+				.setPName("main")
+				.setStage(desc.stages[idx].stage))
+				;
+		}
+
+		state.vertex_input_info = vk::PipelineVertexInputStateCreateInfo{}
+			.setVertexBindingDescriptions(desc.vertex_bindings)
+			.setVertexAttributeDescriptions(desc.vertex_attributes);
+
+		state.input_assembly = vk::PipelineInputAssemblyStateCreateInfo{}
+			.setTopology(desc.topology)
+			.setPrimitiveRestartEnable(VK_FALSE)
+			;
+
+		// Both dynamic, only the counts are baked in
+		state.viewport_info = vk::PipelineViewportStateCreateInfo{}
+			.setViewportCount(1U)
+			.setScissorCount(1U)
+			;
+
+		state.rasterizer_info = vk::PipelineRasterizationStateCreateInfo{}
+			.setDepthClampEnable(VK_FALSE)
+			.setPolygonMode(desc.polygon_mode)
+			.setLineWidth(1.f)
+			.setCullMode(desc.cull_mode)
+			.setFrontFace(desc.front_face)
+			.setDepthBiasEnable(VK_FALSE)
+			.setDepthBiasConstantFactor(0.f)
+			.setDepthBiasClamp(0.f)
+			.setDepthBiasSlopeFactor(0.f)
+			;
+
+		state.multisampling = vk::PipelineMultisampleStateCreateInfo{}
+			.setSampleShadingEnable(VK_FALSE)
+			.setRasterizationSamples(vk::SampleCountFlagBits::e1)
+			.setMinSampleShading(1.f)
+			.setPSampleMask(nullptr)
+			.setAlphaToCoverageEnable(VK_FALSE)
+			.setAlphaToOneEnable(VK_FALSE)
+			;
+
+		state.colour_blend_attachment = vk::PipelineColorBlendAttachmentState{}
+			.setColorWriteMask(vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA)
+			.setBlendEnable(desc.alpha_blend ? VK_TRUE : VK_FALSE)
+			.setSrcColorBlendFactor(vk::BlendFactor::eSrcAlpha)
+			.setDstColorBlendFactor(vk::BlendFactor::eOneMinusSrcAlpha)
+			.setColorBlendOp(vk::BlendOp::eAdd)
+			.setSrcAlphaBlendFactor(vk::BlendFactor::eOne)
+			.setDstAlphaBlendFactor(vk::BlendFactor::eZero)
+			.setAlphaBlendOp(vk::BlendOp::eAdd)
+			;
+
+		state.colour_blending = vk::PipelineColorBlendStateCreateInfo{}
+			.setLogicOpEnable(VK_FALSE)
+			.setLogicOp(vk::LogicOp::eCopy)
+			.setAttachments(state.colour_blend_attachment)
+			.setBlendConstants({ 0, 0, 0, 0 })
+			;
+
+		state.dynamic_states = { vk::DynamicState::eViewport, vk::DynamicState::eScissor, vk::DynamicState::eLineWidth };
+		state.dynamic_state = vk::PipelineDynamicStateCreateInfo{}
+			.setDynamicStates(state.dynamic_states)
+			;
+
+		state.create_info = vk::GraphicsPipelineCreateInfo{}
+			.setStages(state.stages)
+			.setPVertexInputState(&state.vertex_input_info)
+			.setPInputAssemblyState(&state.input_assembly)
+			.setPViewportState(&state.viewport_info)
+			.setPRasterizationState(&state.rasterizer_info)
+			.setPMultisampleState(&state.multisampling)
+			//.setPDepthStencilState(&state.depth_stencil_info)
+			.setPColorBlendState(&state.colour_blending)
+			.setPDynamicState(&state.dynamic_state)
+			.setLayout(layout)
+			.setRenderPass(desc.render_pass)
+			.setSubpass(desc.subpass)
+			.setBasePipelineIndex(-1)
+			.setBasePipelineHandle(VK_NULL_HANDLE)
+			;
+
+		// Dynamic rendering, the pipeline only needs to know the formats it will be drawing into
+		if (!desc.render_pass)
+		{
+			assert(desc.colour_attachment_formats.size() == 1); // one blend attachment state
+			state.rendering_info = vk::PipelineRenderingCreateInfoKHR{}
+				.setColorAttachmentFormats(desc.colour_attachment_formats)
+				;
+			state.create_info.setPNext(&state.rendering_info);
+		}
+	}
+}
+
+namespace Graphics
+{
+	double PipelineBatchTimings::GetSerialMs() const noexcept
+	{
+		double total{ 0. };
+		for (const auto& stage : stages) {
+			total += stage.compile_ms + stage.module_ms;
+		}
+		for (const auto& pipeline : pipelines) {
+			total += pipeline.create_ms;
+		}
+		return total;
+	}
+
+	void PipelineBatchTimings::Print(std::ostream& out) const
+	{
+		const double serial_ms{ GetSerialMs() };
+		out << "Pipeline batch: " << pipelines.size() << " pipeline(s), " << stages.size() << " shader stage(s) in " << total_wall_ms << "ms"
+			<< " (shaders " << shader_wall_ms << "ms, pipelines " << pipeline_wall_ms << "ms)"
+			<< ", " << serial_ms << "ms of work";
+		if (total_wall_ms > 0.) {
+			out << " (" << (serial_ms / total_wall_ms) << "x vs serial)";
+		}
+		out << '\n';
+
+		for (const auto& stage : stages) {
+			out << "  stage '" << stage.name << "' of '" << stage.pipeline << "': compile " << stage.compile_ms << "ms, module " << stage.module_ms << "ms\n";
+		}
+		for (const auto& pipeline : pipelines) {
+			out << "  pipeline '" << pipeline.name << "': " << pipeline.create_ms << "ms\n";
+		}
+	}
+
+	GraphicsPipelineBatch CreateGraphicsPipelines(vk::Device& device, vk::PipelineCache pipeline_cache, std::span<const GraphicsPipelineDesc> descs, const PipelineBatchOptions& options)
+	{
+		const auto batch_begin{ Clock::now() };
+
+		GraphicsPipelineBatch batch{};
+		batch.pipelines.resize(descs.size());
+
+		// Flatten every stage of every pipeline into one list of work items, each writing only to its own slots
+		struct StageWork
+		{
+			std::size_t desc_idx{};
+			std::size_t stage_idx{};
+		};
+		std::vector<StageWork> stage_work;
+		std::vector<std::vector<vk::UniqueShaderModule>> modules(descs.size());
+		for (std::size_t desc_idx{ 0 }; desc_idx < descs.size(); ++desc_idx)
+		{
+			modules[desc_idx].resize(descs[desc_idx].stages.size());
+			for (std::size_t stage_idx{ 0 }; stage_idx < descs[desc_idx].stages.size(); ++stage_idx) {
+				stage_work.push_back({ desc_idx, stage_idx });
+			}
+		}
+		batch.timings.stages.resize(stage_work.size());
+
+		ForEach(options.thread_pool, stage_work.size(), [&](std::size_t work_idx)
+			{
+				const auto [desc_idx, stage_idx] = stage_work[work_idx];
+				modules[desc_idx][stage_idx] = CreateStageModule(device, descs[desc_idx].name, descs[desc_idx].stages[stage_idx], options, batch.timings.stages[work_idx]);
+			});
+
+		batch.timings.shader_wall_ms = ElapsedMs(batch_begin);
+		const auto pipelines_begin{ Clock::now() };
+
+		std::vector<PipelineState> states(descs.size());
+		for (std::size_t idx{ 0 }; idx < descs.size(); ++idx)
+		{
+			batch.pipelines[idx].layout = device.createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo{}
+				.setSetLayouts(descs[idx].set_layouts)
+				.setPushConstantRanges(descs[idx].push_constant_ranges)
+			);
+
+			FillPipelineState(states[idx], descs[idx], *batch.pipelines[idx].layout, modules[idx]);
+		}
+
+		if (options.single_create_call)
+		{
+			std::vector<vk::GraphicsPipelineCreateInfo> infos;
+			infos.reserve(states.size());
+			std::transform(std::begin(states), std::end(states), std::back_inserter(infos), [](const PipelineState& state) { return state.create_info; });
+
+			const auto create_begin{ Clock::now() };
+			auto [result, pipelines] = device.createGraphicsPipelinesUnique(pipeline_cache, infos);
+			assert(result == vk::Result::eSuccess);
+			batch.timings.pipelines.push_back({ "<batch>", ElapsedMs(create_begin, "CreatePipelines") });
+
+			for (std::size_t idx{ 0 }; idx < pipelines.size(); ++idx) {
+				batch.pipelines[idx].pipeline = std::move(pipelines[idx]);
+			}
+		}
+		else
+		{
+			batch.timings.pipelines.resize(descs.size());
+
+			// pipeline caches are internally synchronised, so every worker can feed the same one
+			ForEach(options.thread_pool, descs.size(), [&](std::size_t idx)
+				{
+					const auto create_begin{ Clock::now() };
+					auto [result, pipeline] = device.createGraphicsPipelineUnique(pipeline_cache, states[idx].create_info);
+					assert(result == vk::Result::eSuccess);
+					batch.pipelines[idx].pipeline = std::move(pipeline);
+					batch.timings.pipelines[idx] = { descs[idx].name, ElapsedMs(create_begin, "CreatePipeline") };
+				});
+		}
+
+		// modules are no longer needed once the pipelines exist, they go out of scope here
+
+		batch.timings.pipeline_wall_ms = ElapsedMs(pipelines_begin);
+		batch.timings.total_wall_ms = ElapsedMs(batch_begin);
+		return batch;
+	}
+
+	ComputePipelineBatch CreateComputePipelines(vk::Device& device, vk::PipelineCache pipeline_cache, std::span<const ComputePipelineDesc> descs, const PipelineBatchOptions& options)
+	{
+		const auto batch_begin{ Clock::now() };
+
+		ComputePipelineBatch batch{};
+		batch.pipelines.resize(descs.size());
+		batch.timings.stages.resize(descs.size());
+
+		// One stage per pipeline, so shader work is simply one item per description
+		std::vector<vk::UniqueShaderModule> modules(descs.size());
+		ForEach(options.thread_pool, descs.size(), [&](std::size_t idx)
+			{
+				modules[idx] = CreateStageModule(device, descs[idx].name, descs[idx].stage, options, batch.timings.stages[idx]);
+			});
+
+		batch.timings.shader_wall_ms = ElapsedMs(batch_begin);
+		const auto pipelines_begin{ Clock::now() };
+
+		std::vector<vk::ComputePipelineCreateInfo> infos(descs.size());
+		for (std::size_t idx{ 0 }; idx < descs.size(); ++idx)
+		{
+			assert(descs[idx].stage.stage == vk::ShaderStageFlagBits::eCompute);
+			batch.pipelines[idx].layout = device.createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo{}
+				.setSetLayouts(descs[idx].set_layouts)
+				.setPushConstantRanges(descs[idx].push_constant_ranges)
+			);
+
+			infos[idx] = vk::ComputePipelineCreateInfo{}
+				.setStage(vk::PipelineShaderStageCreateInfo{}
+					.setModule(*modules[idx])
+					.setPName("main")
+					.setStage(vk::ShaderStageFlagBits::eCompute))
+				.setLayout(*batch.pipelines[idx].layout)
+				.setBasePipelineIndex(-1)
+				.setBasePipelineHandle(VK_NULL_HANDLE)
+				;
+		}
+
+		if (options.single_create_call)
+		{
+			const auto create_begin{ Clock::now() };
+			auto [result, pipelines] = device.createComputePipelinesUnique(pipeline_cache, infos);
+			assert(result == vk::Result::eSuccess);
+			batch.timings.pipelines.push_back({ "<batch>", ElapsedMs(create_begin, "CreatePipelines") });
+
+			for (std::size_t idx{ 0 }; idx < pipelines.size(); ++idx) {
+				batch.pipelines[idx].pipeline = std::move(pipelines[idx]);
+			}
+		}
+		else
+		{
+			batch.timings.pipelines.resize(descs.size());
+			ForEach(options.thread_pool, descs.size(), [&](std::size_t idx)
+				{
+					const auto create_begin{ Clock::now() };
+					auto [result, pipeline] = device.createComputePipelineUnique(pipeline_cache, infos[idx]);
+					assert(result == vk::Result::eSuccess);
+					batch.pipelines[idx].pipeline = std::move(pipeline);
+					batch.timings.pipelines[idx] = { descs[idx].name, ElapsedMs(create_begin, "CreatePipeline") };
+				});
+		}
+
+		batch.timings.pipeline_wall_ms = ElapsedMs(pipelines_begin);
+		batch.timings.total_wall_ms = ElapsedMs(batch_begin);
+		return batch;
+	}
+}
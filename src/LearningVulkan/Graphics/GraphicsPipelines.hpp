@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "LearningVulkan/Bridges/vulkan.hpp"
+
+namespace Utility
+{
+	class ThreadPool;
+}
+
+namespace Graphics
+{
+#ifdef RUNTIME_SHADER_COMPILATION
+	class ShaderCompileCache;
+#endif
+
+	struct ShaderStageDesc
+	{
+		vk::ShaderStageFlagBits stage{ vk::ShaderStageFlagBits::eVertex };
+		std::string name{}; // for diagnostics/timings
+		std::span<const uint32_t> spirv{}; // precompiled bytecode (e.g. embedded), used as is when not empty
+#ifdef RUNTIME_SHADER_COMPILATION
+		std::string glsl{}; // compiled at runtime when spirv is empty
+#endif
+	};
+
+	struct GraphicsPipelineDesc
+	{
+		std::string name{};
+		std::vector<ShaderStageDesc> stages{};
+		vk::RenderPass render_pass{};
+		uint32_t subpass{ 0 };
+		std::vector<vk::Format> colour_attachment_formats{}; // only used without a render pass, for VK_KHR_dynamic_rendering
+		// Viewport, scissor and line width are dynamic state, so nothing here depends on the size of what is rendered to
+		vk::PrimitiveTopology topology{ vk::PrimitiveTopology::eTriangleList };
+		vk::PolygonMode polygon_mode{ vk::PolygonMode::eFill };
+		vk::CullModeFlags cull_mode{ vk::CullModeFlagBits::eBack };
+		vk::FrontFace front_face{ vk::FrontFace::eClockwise };
+		bool alpha_blend{ true }; // src_alpha/one_minus_src_alpha, otherwise colour is written as is
+		std::vector<vk::VertexInputBindingDescription> vertex_bindings{};
+		std::vector<vk::VertexInputAttributeDescription> vertex_attributes{};
+		std::vector<vk::DescriptorSetLayout> set_layouts{};
+		std::vector<vk::PushConstantRange> push_constant_ranges{};
+	};
+
+	struct GraphicsPipeline
+	{
+		/// WARNING: Order of members is important! The pipeline must be destroyed before its layout
+		vk::UniquePipelineLayout layout{};
+		vk::UniquePipeline pipeline{};
+	};
+
+	struct ComputePipelineDesc
+	{
+		std::string name{};
+		ShaderStageDesc stage{ vk::ShaderStageFlagBits::eCompute };
+		std::vector<vk::DescriptorSetLayout> set_layouts{};
+		std::vector<vk::PushConstantRange> push_constant_ranges{};
+	};
+
+	struct ComputePipeline
+	{
+		/// WARNING: Order of members is important! The pipeline must be destroyed before its layout
+		vk::UniquePipelineLayout layout{};
+		vk::UniquePipeline pipeline{};
+	};
+
+	struct PipelineBatchOptions
+	{
+		Utility::ThreadPool* thread_pool{ nullptr }; // null runs everything serially on the calling thread
+		bool single_create_call{ false }; // one vkCreateGraphicsPipelines call for the whole batch instead of one per pipeline spread over the pool
+#ifdef RUNTIME_SHADER_COMPILATION
+		ShaderCompileCache* shader_cache{ nullptr };
+#endif
+	};
+
+	struct PipelineBatchTimings
+	{
+		struct Stage
+		{
+			std::string pipeline{};
+			std::string name{};
+			double compile_ms{ 0. }; // zero for precompiled stages
+			double module_ms{ 0. };
+		};
+
+		struct Pipeline
+		{
+			std::string name{};
+			double create_ms{ 0. };
+		};
+
+		std::vector<Stage> stages{};
+		std::vector<Pipeline> pipelines{}; // a single "<batch>" entry when created with one call
+		double shader_wall_ms{ 0. };
+		double pipeline_wall_ms{ 0. };
+		double total_wall_ms{ 0. };
+
+		/// Sum of the individual pieces of work, i.e. roughly what the batch would take if done serially.
+		[[nodiscard]] double GetSerialMs() const noexcept;
+		void Print(std::ostream& out) const;
+	};
+
+	struct GraphicsPipelineBatch
+	{
+		std::vector<GraphicsPipeline> pipelines{}; // same order as the descriptions
+		PipelineBatchTimings timings{};
+	};
+
+	struct ComputePipelineBatch
+	{
+		std::vector<ComputePipeline> pipelines{}; // same order as the descriptions
+		PipelineBatchTimings timings{};
+	};
+
+	/// Creates every pipeline described. Shader stages are compiled (one shaderc::Compiler per thread) and turned into modules
+	/// concurrently, then the pipelines are created either concurrently or with a single call, all sharing the one pipeline cache.
+	[[nodiscard]] GraphicsPipelineBatch CreateGraphicsPipelines(vk::Device& device, vk::PipelineCache pipeline_cache, std::span<const GraphicsPipelineDesc> descs, const PipelineBatchOptions& options = {});
+
+	/// Compute counterpart of CreateGraphicsPipelines(), same options and timings.
+	[[nodiscard]] ComputePipelineBatch CreateComputePipelines(vk::Device& device, vk::PipelineCache pipeline_cache, std::span<const ComputePipelineDesc> descs, const PipelineBatchOptions& options = {});
+}
@@ -0,0 +1,582 @@
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "MemoryAllocator.hpp"
+
+namespace
+{
+	[[nodiscard]] constexpr vk::DeviceSize AlignUp(vk::DeviceSize value, vk::DeviceSize alignment) noexcept
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	[[nodiscard]] constexpr vk::DeviceSize AlignDown(vk::DeviceSize value, vk::DeviceSize alignment) noexcept
+	{
+		return value / alignment * alignment;
+	}
+}
+
+namespace Graphics
+{
+	/// One vk::DeviceMemory sub-allocated with a single strategy
+	struct MemoryBlock
+	{
+		struct Range
+		{
+			vk::DeviceSize offset{ 0 };
+			vk::DeviceSize reserved{ 0 };
+		};
+
+		vk::UniqueDeviceMemory memory{};
+		vk::DeviceSize size{ 0 };
+		uint32_t memory_type{ 0 };
+		ResourceTiling tiling{ ResourceTiling::Linear };
+		AllocationStrategy strategy{ AllocationStrategy::Buddy };
+		std::byte* mapped{ nullptr };
+		std::size_t live_allocations{ 0 };
+		vk::DeviceSize reserved_bytes{ 0 };
+
+		// Buddy, free offsets per order where order n is min_size << n bytes
+		vk::DeviceSize min_size{ 0 };
+		std::vector<std::vector<vk::DeviceSize>> free_lists{};
+
+		// Linear
+		vk::DeviceSize linear_offset{ 0 };
+
+		// Pool
+		vk::DeviceSize slot_size{ 0 };
+		std::vector<vk::DeviceSize> free_slots{};
+
+		void Initialise()
+		{
+			switch (strategy)
+			{
+			case AllocationStrategy::Buddy:
+			{
+				const auto max_order{ static_cast<std::size_t>(std::countr_zero(size / min_size)) };
+				free_lists.resize(max_order + 1);
+				free_lists[max_order].push_back(0);
+				break;
+			}
+			case AllocationStrategy::Linear:
+				linear_offset = 0;
+				break;
+			case AllocationStrategy::Pool:
+				for (vk::DeviceSize slot{ size / slot_size }; slot > 0; --slot) {
+					free_slots.push_back((slot - 1) * slot_size);
+				}
+				break;
+			}
+		}
+
+		[[nodiscard]] std::optional<Range> TryAllocate(vk::DeviceSize request_size, vk::DeviceSize alignment)
+		{
+			std::optional<Range> range{};
+
+			switch (strategy)
+			{
+			case AllocationStrategy::Buddy:
+			{
+				// buddies are aligned to their own size, so rounding up to the alignment covers it
+				const auto chunk{ std::bit_ceil(std::max({ request_size, alignment, min_size })) };
+				if (chunk > size) {
+					break;
+				}
+				const auto order{ static_cast<std::size_t>(std::countr_zero(chunk / min_size)) };
+
+				auto available{ order };
+				while (available < free_lists.size() && free_lists[available].empty()) {
+					++available;
+				}
+				if (available == free_lists.size()) {
+					break;
+				}
+
+				const auto offset{ free_lists[available].back() };
+				free_lists[available].pop_back();
+
+				// split down to the size we need, handing the upper halves to the free lists
+				while (available > order)
+				{
+					--available;
+					free_lists[available].push_back(offset + (min_size << available));
+				}
+
+				range = Range{ offset, chunk };
+				break;
+			}
+			case AllocationStrategy::Linear:
+			{
+				const auto offset{ AlignUp(linear_offset, alignment) };
+				if (offset + request_size > size) {
+					break;
+				}
+
+				range = Range{ offset, offset + request_size - linear_offset };
+				linear_offset = offset + request_size;
+				break;
+			}
+			case AllocationStrategy::Pool:
+				assert(request_size <= slot_size && slot_size % alignment == 0);
+				if (free_slots.empty()) {
+					break;
+				}
+
+				range = Range{ free_slots.back(), slot_size };
+				free_slots.pop_back();
+				break;
+			}
+
+			if (range)
+			{
+				++live_allocations;
+				reserved_bytes += range->reserved;
+			}
+			return range;
+		}
+
+		void Free(vk::DeviceSize offset, vk::DeviceSize reserved)
+		{
+			assert(live_allocations > 0);
+			--live_allocations;
+			reserved_bytes -= reserved;
+
+			switch (strategy)
+			{
+			case AllocationStrategy::Buddy:
+			{
+				auto order{ static_cast<std::size_t>(std::countr_zero(reserved / min_size)) };
+
+				// merge with the buddy for as long as it is free too
+				while (order + 1 < free_lists.size())
+				{
+					const auto buddy{ offset ^ (min_size << order) };
+					auto& list{ free_lists[order] };
+					const auto it{ std::find(std::begin(list), std::end(list), buddy) };
+					if (it == std::end(list)) {
+						break;
+					}
+
+					list.erase(it);
+					offset = std::min(offset, buddy);
+					++order;
+				}
+				free_lists[order].push_back(offset);
+				break;
+			}
+			case AllocationStrategy::Linear:
+				// space only comes back once the whole block is empty
+				if (live_allocations == 0) {
+					linear_offset = 0;
+				}
+				break;
+			case AllocationStrategy::Pool:
+				free_slots.push_back(offset);
+				break;
+			}
+		}
+
+		[[nodiscard]] vk::DeviceSize GetFreeBytes() const noexcept
+		{
+			// Linear blocks can't reuse freed space until they empty, so only the tail counts as free
+			return strategy == AllocationStrategy::Linear ? size - linear_offset : size - reserved_bytes;
+		}
+
+		[[nodiscard]] vk::DeviceSize GetLargestFreeRange() const noexcept
+		{
+			switch (strategy)
+			{
+			case AllocationStrategy::Buddy:
+				for (std::size_t order{ free_lists.size() }; order > 0; --order)
+				{
+					if (!free_lists[order - 1].empty()) {
+						return min_size << (order - 1);
+					}
+				}
+				return 0;
+			case AllocationStrategy::Linear:
+				return size - linear_offset;
+			case AllocationStrategy::Pool:
+				return free_slots.empty() ? 0 : slot_size;
+			}
+			return 0;
+		}
+	};
+
+	Allocation::~Allocation()
+	{
+		Reset();
+	}
+
+	Allocation::Allocation(Allocation&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	Allocation& Allocation::operator=(Allocation&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Reset();
+			allocator = std::exchange(other.allocator, nullptr);
+			block = std::exchange(other.block, nullptr);
+			memory = std::exchange(other.memory, vk::DeviceMemory{});
+			offset = other.offset;
+			size = other.size;
+			reserved = other.reserved;
+			mapped = std::exchange(other.mapped, nullptr);
+			memory_type = other.memory_type;
+		}
+		return *this;
+	}
+
+	void Allocation::Reset() noexcept
+	{
+		if (allocator)
+		{
+			allocator->Free(*this);
+			allocator = nullptr;
+			block = nullptr;
+			memory = vk::DeviceMemory{};
+			mapped = nullptr;
+		}
+	}
+
+	void MemoryAllocator::Stats::Print(std::ostream& out) const
+	{
+		constexpr double mib{ 1024. * 1024. };
+		out << "Device memory: " << block_count << " blocks, " << dedicated_count << " dedicated, " << allocation_count << " allocations. "
+			<< static_cast<double>(reserved_bytes) / mib << "MiB reserved, "
+			<< static_cast<double>(used_bytes) / mib << "MiB used, "
+			<< static_cast<double>(wasted_bytes) / mib << "MiB wasted, "
+			<< static_cast<double>(free_bytes) / mib << "MiB free (largest range " << static_cast<double>(largest_free_range) / mib << "MiB, "
+			<< fragmentation * 100. << "% fragmented)\n";
+		if (allocate_us.count > 0) {
+			out << "  Allocation latency: p50 " << allocate_us.p50 << "us, p95 " << allocate_us.p95 << "us, p99 " << allocate_us.p99 << "us, max " << allocate_us.max << "us\n";
+		}
+	}
+
+	MemoryAllocator::MemoryAllocator(vk::Device& logical_device, const vk::PhysicalDevice& physical_device, Settings allocator_settings)
+		: device{ logical_device }
+		, settings{ allocator_settings }
+		, allocate_us{ allocator_settings.latency_window }
+	{
+		settings.min_allocation_size = std::bit_ceil(std::max<vk::DeviceSize>(settings.min_allocation_size, 1));
+		settings.block_size = std::bit_ceil(std::max(settings.block_size, settings.min_allocation_size));
+
+		memory_properties = physical_device.getMemoryProperties();
+		const auto limits{ physical_device.getProperties().limits };
+		buffer_image_granularity = std::max<vk::DeviceSize>(limits.bufferImageGranularity, 1);
+		non_coherent_atom_size = std::max<vk::DeviceSize>(limits.nonCoherentAtomSize, 1);
+		max_allocation_count = limits.maxMemoryAllocationCount;
+	}
+
+	MemoryAllocator::~MemoryAllocator()
+	{
+		assert(allocation_count == 0 && "Allocations must be freed before the allocator is destroyed");
+	}
+
+	Allocation MemoryAllocator::Allocate(const vk::MemoryRequirements& requirements, ResourceTiling tiling, const AllocationDesc& desc)
+	{
+		return AllocateImpl(requirements, tiling, desc, DedicatedInfo{});
+	}
+
+	Allocation MemoryAllocator::AllocateForBuffer(vk::Buffer buffer, const AllocationDesc& desc)
+	{
+		const auto requirements_chain{ device.getBufferMemoryRequirements2<vk::MemoryRequirements2, vk::MemoryDedicatedRequirements>(vk::BufferMemoryRequirementsInfo2{ buffer }) };
+		const auto& dedicated_requirements{ requirements_chain.get<vk::MemoryDedicatedRequirements>() };
+
+		DedicatedInfo dedicated{};
+		dedicated.buffer = buffer;
+		dedicated.requested = dedicated_requirements.prefersDedicatedAllocation || dedicated_requirements.requiresDedicatedAllocation;
+
+		auto allocation{ AllocateImpl(requirements_chain.get<vk::MemoryRequirements2>().memoryRequirements, ResourceTiling::Linear, desc, dedicated) };
+		device.bindBufferMemory(buffer, allocation.GetMemory(), allocation.GetOffset());
+		return allocation;
+	}
+
+	Allocation MemoryAllocator::AllocateForImage(vk::Image image, vk::ImageTiling tiling, const AllocationDesc& desc)
+	{
+		const auto requirements_chain{ device.getImageMemoryRequirements2<vk::MemoryRequirements2, vk::MemoryDedicatedRequirements>(vk::ImageMemoryRequirementsInfo2{ image }) };
+		const auto& dedicated_requirements{ requirements_chain.get<vk::MemoryDedicatedRequirements>() };
+
+		DedicatedInfo dedicated{};
+		dedicated.image = image;
+		dedicated.requested = dedicated_requirements.prefersDedicatedAllocation || dedicated_requirements.requiresDedicatedAllocation;
+
+		const auto resource_tiling{ tiling == vk::ImageTiling::eOptimal ? ResourceTiling::Optimal : ResourceTiling::Linear };
+		auto allocation{ AllocateImpl(requirements_chain.get<vk::MemoryRequirements2>().memoryRequirements, resource_tiling, desc, dedicated) };
+		device.bindImageMemory(image, allocation.GetMemory(), allocation.GetOffset());
+		return allocation;
+	}
+
+	Allocation MemoryAllocator::AllocateImpl(const vk::MemoryRequirements& requirements, ResourceTiling tiling, const AllocationDesc& desc, const DedicatedInfo& dedicated)
+	{
+		const auto begin{ std::chrono::steady_clock::now() };
+
+		const uint32_t memory_type{ FindMemoryType(requirements.memoryTypeBits, desc) };
+		const auto flags{ memory_properties.memoryTypes[memory_type].propertyFlags };
+
+		// Host access to non-coherent memory is flushed/invalidated in whole atoms, keep allocations from sharing one
+		auto alignment{ std::max<vk::DeviceSize>(requirements.alignment, 1) };
+		if ((flags & vk::MemoryPropertyFlagBits::eHostVisible) && !(flags & vk::MemoryPropertyFlagBits::eHostCoherent)) {
+			alignment = std::max(alignment, non_coherent_atom_size);
+		}
+
+		std::scoped_lock lock{ mutex };
+
+		Allocation allocation{};
+		if (desc.dedicated || dedicated.requested || requirements.size >= settings.dedicated_threshold || requirements.size > settings.block_size)
+		{
+			allocation = AllocateDedicated(requirements.size, memory_type, dedicated);
+		}
+		else
+		{
+			// Without a granularity restriction buffers and images can share blocks
+			const auto block_tiling{ buffer_image_granularity > 1 ? tiling : ResourceTiling::Linear };
+
+			// Pool slots are per power of two size class, big ones would waste most of a block so they go to the buddy blocks instead
+			auto strategy{ desc.strategy };
+			vk::DeviceSize slot_size{ 0 };
+			if (strategy == AllocationStrategy::Pool)
+			{
+				slot_size = std::bit_ceil(std::max({ requirements.size, alignment, settings.min_allocation_size }));
+				if (slot_size > settings.block_size / 16) {
+					strategy = AllocationStrategy::Buddy;
+					slot_size = 0;
+				}
+			}
+
+			std::optional<MemoryBlock::Range> range{};
+			MemoryBlock* block{ nullptr };
+			for (auto& candidate : blocks)
+			{
+				if (candidate->memory_type != memory_type || candidate->tiling != block_tiling || candidate->strategy != strategy || candidate->slot_size != slot_size) {
+					continue;
+				}
+
+				range = candidate->TryAllocate(requirements.size, alignment);
+				if (range)
+				{
+					block = candidate.get();
+					break;
+				}
+			}
+
+			if (!range)
+			{
+				block = &CreateBlock(memory_type, block_tiling, strategy, slot_size, std::bit_ceil(std::max(requirements.size, alignment)));
+				range = block->TryAllocate(requirements.size, alignment);
+				if (!range) {
+					throw std::runtime_error("Failed to sub-allocate from a new memory block");
+				}
+			}
+
+			allocation.allocator = this;
+			allocation.block = block;
+			allocation.memory = *block->memory;
+			allocation.offset = range->offset;
+			allocation.size = requirements.size;
+			allocation.reserved = range->reserved;
+			allocation.mapped = block->mapped ? block->mapped + range->offset : nullptr;
+			allocation.memory_type = memory_type;
+		}
+
+		++allocation_count;
+		used_bytes += allocation.size;
+		allocated_bytes += allocation.reserved;
+		allocate_us.Add(std::chrono::duration<double, std::micro>{ std::chrono::steady_clock::now() - begin }.count());
+
+		return allocation;
+	}
+
+	uint32_t MemoryAllocator::FindMemoryType(uint32_t type_bits, const AllocationDesc& desc) const
+	{
+		std::optional<uint32_t> best{};
+		int best_score{ -1 };
+
+		for (uint32_t idx{ 0 }; idx < memory_properties.memoryTypeCount; ++idx)
+		{
+			const auto flags{ memory_properties.memoryTypes[idx].propertyFlags };
+			if (!(type_bits & (1U << idx)) || (flags & desc.required_flags) != desc.required_flags) {
+				continue;
+			}
+
+			const int score{ std::popcount(static_cast<VkMemoryPropertyFlags>(flags & desc.preferred_flags)) };
+			if (score > best_score)
+			{
+				best = idx;
+				best_score = score;
+			}
+		}
+
+		if (!best) {
+			throw std::runtime_error("Failed to find a suitable memory type");
+		}
+		return *best;
+	}
+
+	Allocation MemoryAllocator::AllocateDedicated(vk::DeviceSize size, uint32_t memory_type, const DedicatedInfo& dedicated)
+	{
+		const auto dedicated_info{ vk::MemoryDedicatedAllocateInfo{}
+			.setBuffer(dedicated.buffer)
+			.setImage(dedicated.image)
+		};
+
+		auto info{ vk::MemoryAllocateInfo{}
+			.setAllocationSize(size)
+			.setMemoryTypeIndex(memory_type)
+		};
+		if (dedicated.buffer || dedicated.image) {
+			info.setPNext(&dedicated_info);
+		}
+
+		Allocation allocation{};
+		allocation.allocator = this;
+		allocation.memory = AllocateDeviceMemory(info);
+		allocation.offset = 0;
+		allocation.size = size;
+		allocation.reserved = size;
+		allocation.memory_type = memory_type;
+		if (memory_properties.memoryTypes[memory_type].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible) {
+			allocation.mapped = static_cast<std::byte*>(device.mapMemory(allocation.memory, 0, VK_WHOLE_SIZE));
+		}
+
+		++dedicated_count;
+		dedicated_bytes += size;
+		return allocation;
+	}
+
+	MemoryBlock& MemoryAllocator::CreateBlock(uint32_t memory_type, ResourceTiling tiling, AllocationStrategy strategy, vk::DeviceSize slot_size, vk::DeviceSize min_size)
+	{
+		auto block{ std::make_unique<MemoryBlock>() };
+		block->memory_type = memory_type;
+		block->tiling = tiling;
+		block->strategy = strategy;
+		block->slot_size = slot_size;
+		block->min_size = settings.min_allocation_size;
+
+		// Halve the block size on failure, as long as what we are about to allocate still fits
+		for (auto size{ settings.block_size }; ; size /= 2)
+		{
+			try
+			{
+				block->memory = vk::UniqueDeviceMemory{ AllocateDeviceMemory(vk::MemoryAllocateInfo{ size, memory_type }), device };
+				block->size = size;
+				break;
+			}
+			catch (const vk::OutOfDeviceMemoryError&)
+			{
+				if (size / 2 < std::max({ min_size, slot_size, settings.min_allocation_size })) {
+					throw;
+				}
+			}
+		}
+
+		if (memory_properties.memoryTypes[memory_type].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible) {
+			block->mapped = static_cast<std::byte*>(device.mapMemory(*block->memory, 0, VK_WHOLE_SIZE));
+		}
+
+		block->Initialise();
+		blocks.push_back(std::move(block));
+		return *blocks.back();
+	}
+
+	vk::DeviceMemory MemoryAllocator::AllocateDeviceMemory(const vk::MemoryAllocateInfo& info)
+	{
+		if (max_allocation_count > 0 && device_allocation_count >= max_allocation_count) {
+			throw std::runtime_error("Reached maxMemoryAllocationCount (" + std::to_string(max_allocation_count) + ")");
+		}
+
+		auto memory{ device.allocateMemory(info) };
+		++device_allocation_count;
+		return memory;
+	}
+
+	vk::MappedMemoryRange MemoryAllocator::GetMappedRange(const Allocation& allocation) const
+	{
+		const auto begin{ AlignDown(allocation.offset, non_coherent_atom_size) };
+		const auto end{ AlignUp(allocation.offset + allocation.size, non_coherent_atom_size) };
+		const auto memory_size{ allocation.block ? allocation.block->size : allocation.reserved };
+
+		return vk::MappedMemoryRange{ allocation.memory, begin, end >= memory_size ? VK_WHOLE_SIZE : end - begin };
+	}
+
+	void MemoryAllocator::Flush(const Allocation& allocation) const
+	{
+		const auto flags{ memory_properties.memoryTypes[allocation.memory_type].propertyFlags };
+		if (allocation.mapped && !(flags & vk::MemoryPropertyFlagBits::eHostCoherent)) {
+			device.flushMappedMemoryRanges(GetMappedRange(allocation));
+		}
+	}
+
+	void MemoryAllocator::Invalidate(const Allocation& allocation) const
+	{
+		const auto flags{ memory_properties.memoryTypes[allocation.memory_type].propertyFlags };
+		if (allocation.mapped && !(flags & vk::MemoryPropertyFlagBits::eHostCoherent)) {
+			device.invalidateMappedMemoryRanges(GetMappedRange(allocation));
+		}
+	}
+
+	std::size_t MemoryAllocator::ReleaseEmptyBlocks()
+	{
+		std::scoped_lock lock{ mutex };
+
+		const auto first_empty{ std::stable_partition(std::begin(blocks), std::end(blocks), [](const auto& block) { return block->live_allocations > 0; }) };
+		const auto released{ static_cast<std::size_t>(std::distance(first_empty, std::end(blocks))) };
+		blocks.erase(first_empty, std::end(blocks));
+		device_allocation_count -= static_cast<uint32_t>(released);
+		return released;
+	}
+
+	MemoryAllocator::Stats MemoryAllocator::GetStats() const
+	{
+		std::scoped_lock lock{ mutex };
+
+		Stats stats{};
+		stats.block_count = blocks.size();
+		stats.dedicated_count = dedicated_count;
+		stats.allocation_count = allocation_count;
+		stats.used_bytes = used_bytes;
+		stats.wasted_bytes = allocated_bytes - used_bytes;
+		stats.reserved_bytes = dedicated_bytes;
+		for (const auto& block : blocks)
+		{
+			stats.reserved_bytes += block->size;
+			stats.free_bytes += block->GetFreeBytes();
+			stats.largest_free_range = std::max(stats.largest_free_range, block->GetLargestFreeRange());
+		}
+		stats.fragmentation = stats.free_bytes > 0 ? 1. - static_cast<double>(stats.largest_free_range) / static_cast<double>(stats.free_bytes) : 0.;
+		stats.allocate_us = allocate_us.Summarise();
+		return stats;
+	}
+
+	void MemoryAllocator::Free(Allocation& allocation) noexcept
+	{
+		std::scoped_lock lock{ mutex };
+
+		if (allocation.block)
+		{
+			allocation.block->Free(allocation.offset, allocation.reserved);
+		}
+		else
+		{
+			device.freeMemory(allocation.memory);
+			--device_allocation_count;
+			--dedicated_count;
+			dedicated_bytes -= allocation.reserved;
+		}
+
+		--allocation_count;
+		used_bytes -= allocation.size;
+		allocated_bytes -= allocation.reserved;
+	}
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "LearningVulkan/Bridges/vulkan.hpp"
+#include "LearningVulkan/Profiling/RollingSamples.hpp"
+
+namespace Graphics
+{
+	class MemoryAllocator;
+	struct MemoryBlock;
+
+	enum class AllocationStrategy
+	{
+		Buddy, // general purpose, power of two splits of a block which merge back together when freed
+		Linear, // bump allocation, a block is only reused once everything in it has been freed. For data that is thrown away together
+		Pool, // fixed size slots per size class, for lots of small resources of similar size
+	};
+
+	/// Linear (buffers, linear images) and optimally tiled resources must not share a bufferImageGranularity page, so they never share a block
+	enum class ResourceTiling
+	{
+		Linear,
+		Optimal,
+	};
+
+	struct AllocationDesc
+	{
+		vk::MemoryPropertyFlags required_flags{ vk::MemoryPropertyFlagBits::eDeviceLocal };
+		vk::MemoryPropertyFlags preferred_flags{}; // picks between the memory types that have the required flags
+		AllocationStrategy strategy{ AllocationStrategy::Buddy };
+		bool dedicated{ false }; // own vk::DeviceMemory. Also used for anything over the dedicated threshold or when the driver asks for it
+	};
+
+	/// A range of device memory, handed back to the allocator when destroyed. The allocator must outlive it.
+	class Allocation
+	{
+	public:
+		Allocation() = default;
+		~Allocation();
+
+		Allocation(Allocation&& other) noexcept;
+		Allocation& operator=(Allocation&& other) noexcept;
+		Allocation(const Allocation&) = delete;
+		Allocation& operator=(const Allocation&) = delete;
+
+		[[nodiscard]] explicit operator bool() const noexcept { return allocator != nullptr; }
+
+		[[nodiscard]] vk::DeviceMemory GetMemory() const noexcept { return memory; }
+		[[nodiscard]] vk::DeviceSize GetOffset() const noexcept { return offset; }
+		[[nodiscard]] vk::DeviceSize GetSize() const noexcept { return size; }
+		[[nodiscard]] uint32_t GetMemoryType() const noexcept { return memory_type; }
+		/// Persistently mapped pointer to the start of the allocation, null unless the memory is host visible
+		[[nodiscard]] std::byte* GetMappedData() const noexcept { return mapped; }
+		[[nodiscard]] bool IsDedicated() const noexcept { return block == nullptr && memory; }
+
+		/// Frees the allocation now rather than on destruction
+		void Reset() noexcept;
+
+	private:
+		friend class MemoryAllocator;
+
+		MemoryAllocator* allocator{ nullptr };
+		MemoryBlock* block{ nullptr }; // null for dedicated allocations
+		vk::DeviceMemory memory{};
+		vk::DeviceSize offset{ 0 };
+		vk::DeviceSize size{ 0 }; // what was asked for
+		vk::DeviceSize reserved{ 0 }; // what was taken from the block including padding/rounding
+		std::byte* mapped{ nullptr };
+		uint32_t memory_type{ 0 };
+	};
+
+	/// Sub-allocates buffers and images out of large vk::DeviceMemory blocks per memory type, so we stay well under maxMemoryAllocationCount
+	/// and related resources end up next to each other. Thread safe.
+	class MemoryAllocator
+	{
+	public:
+		struct Settings
+		{
+			vk::DeviceSize block_size{ 64ull << 20 }; // rounded up to a power of two
+			vk::DeviceSize dedicated_threshold{ 16ull << 20 }; // resources at least this big get their own allocation
+			vk::DeviceSize min_allocation_size{ 256 }; // smallest buddy/pool slot
+			std::size_t latency_window{ 4096 }; // number of recent allocations the latency percentiles are over
+		};
+
+		struct Stats
+		{
+			std::size_t block_count{ 0 };
+			std::size_t dedicated_count{ 0 };
+			std::size_t allocation_count{ 0 }; // live sub-allocations and dedicated allocations
+			vk::DeviceSize reserved_bytes{ 0 }; // device memory allocated from the driver
+			vk::DeviceSize used_bytes{ 0 }; // sizes asked for by live allocations
+			vk::DeviceSize wasted_bytes{ 0 }; // alignment padding and rounding up inside live allocations
+			vk::DeviceSize free_bytes{ 0 }; // in blocks, including space only reusable once a linear block empties
+			vk::DeviceSize largest_free_range{ 0 };
+			double fragmentation{ 0. }; // 1 - largest_free_range / free_bytes, i.e. 0 when all free space could satisfy one allocation
+			Profiling::RollingSamples::Summary allocate_us{};
+
+			void Print(std::ostream& out) const;
+		};
+
+		MemoryAllocator(vk::Device& device, const vk::PhysicalDevice& physical_device, Settings settings);
+		~MemoryAllocator();
+
+		MemoryAllocator(const MemoryAllocator&) = delete;
+		MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+		[[nodiscard]] Allocation Allocate(const vk::MemoryRequirements& requirements, ResourceTiling tiling, const AllocationDesc& desc);
+		/// Allocates for and binds the resource, asking the driver whether it wants a dedicated allocation
+		[[nodiscard]] Allocation AllocateForBuffer(vk::Buffer buffer, const AllocationDesc& desc);
+		[[nodiscard]] Allocation AllocateForImage(vk::Image image, vk::ImageTiling tiling, const AllocationDesc& desc);
+
+		/// Needed around host access to memory types that aren't host coherent, no-ops otherwise
+		void Flush(const Allocation& allocation) const;
+		void Invalidate(const Allocation& allocation) const;
+
+		/// Gives blocks with nothing allocated from them back to the driver, returns how many were released
+		std::size_t ReleaseEmptyBlocks();
+
+		[[nodiscard]] Stats GetStats() const;
+
+	private:
+		friend class Allocation;
+
+		struct DedicatedInfo
+		{
+			vk::Buffer buffer{};
+			vk::Image image{};
+			bool requested{ false };
+		};
+
+		[[nodiscard]] Allocation AllocateImpl(const vk::MemoryRequirements& requirements, ResourceTiling tiling, const AllocationDesc& desc, const DedicatedInfo& dedicated);
+		[[nodiscard]] uint32_t FindMemoryType(uint32_t type_bits, const AllocationDesc& desc) const;
+		[[nodiscard]] Allocation AllocateDedicated(vk::DeviceSize size, uint32_t memory_type, const DedicatedInfo& dedicated);
+		[[nodiscard]] MemoryBlock& CreateBlock(uint32_t memory_type, ResourceTiling tiling, AllocationStrategy strategy, vk::DeviceSize slot_size, vk::DeviceSize min_size);
+		[[nodiscard]] vk::DeviceMemory AllocateDeviceMemory(const vk::MemoryAllocateInfo& info);
+		[[nodiscard]] vk::MappedMemoryRange GetMappedRange(const Allocation& allocation) const;
+		void Free(Allocation& allocation) noexcept;
+
+		vk::Device& device;
+		Settings settings;
+		vk::PhysicalDeviceMemoryProperties memory_properties{};
+		vk::DeviceSize buffer_image_granularity{ 1 };
+		vk::DeviceSize non_coherent_atom_size{ 1 };
+		uint32_t max_allocation_count{ 0 };
+
+		mutable std::mutex mutex;
+		std::vector<std::unique_ptr<MemoryBlock>> blocks{};
+		uint32_t device_allocation_count{ 0 }; // blocks + dedicated
+		std::size_t dedicated_count{ 0 };
+		vk::DeviceSize dedicated_bytes{ 0 };
+		std::size_t allocation_count{ 0 };
+		vk::DeviceSize used_bytes{ 0 };
+		vk::DeviceSize allocated_bytes{ 0 }; // reserved by live sub-allocations
+		Profiling::RollingSamples allocate_us;
+	};
+}
@@ -0,0 +1,196 @@
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <span>
+#include <sstream>
+#include <string_view>
+#include <vector>
+
+#include "LearningVulkan/Utility/Hash.hpp"
+
+#include "PipelineCache.hpp"
+
+namespace
+{
+	constexpr uint32_t pipeline_cache_magic{ 0x4350564C }; // "LVPC"
+	constexpr uint32_t pipeline_cache_version{ 1 };
+
+	/// Our own header in front of the driver blob, the driver blob has its own header but drivers are not required to validate it properly.
+	struct PipelineCacheFileHeader
+	{
+		uint32_t magic{};
+		uint32_t version{};
+		uint32_t vendor_id{};
+		uint32_t device_id{};
+		uint32_t driver_version{};
+		uint8_t pipeline_cache_uuid[VK_UUID_SIZE]{};
+		uint32_t reserved{}; // keeps the 64-bit fields aligned without implicit padding (which would end up in the checksum)
+		uint64_t data_size{};
+		uint64_t data_checksum{};
+		uint64_t header_checksum{}; // checksum of everything above with this field zeroed
+	};
+	static_assert(sizeof(PipelineCacheFileHeader) == 64, "PipelineCacheFileHeader must not contain padding");
+
+	[[nodiscard]] PipelineCacheFileHeader MakeHeader(const vk::PhysicalDeviceProperties& properties, std::span<const std::byte> data)
+	{
+		PipelineCacheFileHeader header{};
+		header.magic = pipeline_cache_magic;
+		header.version = pipeline_cache_version;
+		header.vendor_id = properties.vendorID;
+		header.device_id = properties.deviceID;
+		header.driver_version = properties.driverVersion;
+		std::memcpy(header.pipeline_cache_uuid, properties.pipelineCacheUUID.data(), VK_UUID_SIZE);
+		header.data_size = data.size();
+		header.data_checksum = Utility::Fnv1a(data);
+		header.header_checksum = Utility::HashValue(header);
+		return header;
+	}
+
+	/// Returns an empty string if the file contents are usable, otherwise the reason they aren't.
+	[[nodiscard]] std::string_view ValidateCacheFile(const vk::PhysicalDeviceProperties& properties, std::span<const std::byte> file_contents)
+	{
+		if (file_contents.size() < sizeof(PipelineCacheFileHeader)) {
+			return "file too small";
+		}
+
+		PipelineCacheFileHeader header{};
+		std::memcpy(&header, file_contents.data(), sizeof(header));
+		const auto data{ file_contents.subspan(sizeof(header)) };
+
+		if (header.magic != pipeline_cache_magic || header.version != pipeline_cache_version) {
+			return "unrecognised header";
+		}
+
+		auto header_copy{ header };
+		header_copy.header_checksum = 0;
+		if (Utility::HashValue(header_copy) != header.header_checksum) {
+			return "header checksum mismatch";
+		}
+
+		if (header.vendor_id != properties.vendorID
+			|| header.device_id != properties.deviceID
+			|| header.driver_version != properties.driverVersion
+			|| !std::equal(std::begin(header.pipeline_cache_uuid), std::end(header.pipeline_cache_uuid), std::begin(properties.pipelineCacheUUID))) {
+			return "written by a different device or driver";
+		}
+
+		if (header.data_size != data.size() || Utility::Fnv1a(data) != header.data_checksum) {
+			return "data checksum mismatch";
+		}
+
+		// Also check the driver's own header (VkPipelineCacheHeaderVersionOne) in case the blob was produced by something else
+		struct DriverHeader
+		{
+			uint32_t header_size;
+			uint32_t header_version;
+			uint32_t vendor_id;
+			uint32_t device_id;
+			uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+		} driver_header{};
+		if (data.size() < sizeof(driver_header)) {
+			return "driver data too small";
+		}
+		std::memcpy(&driver_header, data.data(), sizeof(driver_header));
+
+		if (driver_header.header_size < sizeof(driver_header)
+			|| driver_header.header_version != static_cast<uint32_t>(vk::PipelineCacheHeaderVersion::eOne)
+			|| driver_header.vendor_id != properties.vendorID
+			|| driver_header.device_id != properties.deviceID
+			|| !std::equal(std::begin(driver_header.pipeline_cache_uuid), std::end(driver_header.pipeline_cache_uuid), std::begin(properties.pipelineCacheUUID))) {
+			return "driver header mismatch";
+		}
+
+		return {};
+	}
+}
+
+namespace Graphics
+{
+	std::filesystem::path GetPipelineCacheFileName(const vk::PhysicalDeviceProperties& properties)
+	{
+		std::ostringstream name;
+		name << std::hex << std::setfill('0')
+			<< "pipeline_cache_"
+			<< std::setw(4) << properties.vendorID << '_'
+			<< std::setw(4) << properties.deviceID << '_'
+			<< std::setw(8) << properties.driverVersion << '_';
+		for (const uint8_t b : properties.pipelineCacheUUID) {
+			name << std::setw(2) << static_cast<uint32_t>(b);
+		}
+		name << ".bin";
+
+		return name.str();
+	}
+
+	vk::UniquePipelineCache LoadPipelineCache(vk::Device& device, const vk::PhysicalDeviceProperties& properties, const std::filesystem::path& path)
+	{
+		std::vector<std::byte> file_contents;
+		if (std::ifstream file{ path, std::ios::binary | std::ios::ate }; file)
+		{
+			file_contents.resize(static_cast<std::size_t>(file.tellg()));
+			file.seekg(0);
+			if (!file.read(reinterpret_cast<char*>(file_contents.data()), static_cast<std::streamsize>(file_contents.size()))) {
+				file_contents.clear();
+			}
+		}
+
+		if (file_contents.empty())
+		{
+			std::cout << "No pipeline cache found at '" << path.string() << "', starting with an empty cache\n";
+			return device.createPipelineCacheUnique(vk::PipelineCacheCreateInfo{});
+		}
+
+		if (const auto problem{ ValidateCacheFile(properties, file_contents) }; !problem.empty())
+		{
+			std::cout << "Ignoring pipeline cache '" << path.string() << "': " << problem << '\n';
+			return device.createPipelineCacheUnique(vk::PipelineCacheCreateInfo{});
+		}
+
+		const auto data{ std::span{ file_contents }.subspan(sizeof(PipelineCacheFileHeader)) };
+		std::cout << "Loaded pipeline cache '" << path.string() << "' (" << data.size() << " bytes)\n";
+
+		return device.createPipelineCacheUnique(vk::PipelineCacheCreateInfo{}
+			.setInitialDataSize(data.size())
+			.setPInitialData(data.data())
+		);
+	}
+
+	void SavePipelineCache(vk::Device& device, vk::PipelineCache cache, const vk::PhysicalDeviceProperties& properties, const std::filesystem::path& path)
+	{
+		const auto data{ device.getPipelineCacheData(cache) };
+		const auto data_bytes{ std::as_bytes(std::span{ data }) };
+		const auto header{ MakeHeader(properties, data_bytes) };
+
+		std::error_code ec{};
+		if (path.has_parent_path()) {
+			std::filesystem::create_directories(path.parent_path(), ec);
+		}
+
+		auto temp_path{ path };
+		temp_path += ".tmp";
+
+		{
+			std::ofstream file{ temp_path, std::ios::binary | std::ios::trunc };
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.write(reinterpret_cast<const char*>(data_bytes.data()), static_cast<std::streamsize>(data_bytes.size()));
+			if (!file)
+			{
+				std::cerr << "Failed to write pipeline cache to '" << temp_path.string() << "'\n";
+				return;
+			}
+		}
+
+		std::filesystem::rename(temp_path, path, ec);
+		if (ec)
+		{
+			std::cerr << "Failed to write pipeline cache to '" << path.string() << "': " << ec.message() << '\n';
+			std::filesystem::remove(temp_path, ec);
+			return;
+		}
+
+		std::cout << "Saved pipeline cache '" << path.string() << "' (" << data.size() << " bytes)\n";
+	}
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <filesystem>
+
+#include "LearningVulkan/Bridges/vulkan.hpp"
+
+namespace Graphics
+{
+	/// File name for the pipeline cache of the given device, keyed on vendor/device id, driver version and pipelineCacheUUID
+	/// so switching GPU or updating the driver doesn't throw away the cache of the other.
+	[[nodiscard]] std::filesystem::path GetPipelineCacheFileName(const vk::PhysicalDeviceProperties& properties);
+
+	/// Creates a pipeline cache seeded from the file written by SavePipelineCache().
+	/// A missing, stale (other device/driver) or corrupt file is ignored and an empty cache is created instead.
+	[[nodiscard]] vk::UniquePipelineCache LoadPipelineCache(vk::Device& device, const vk::PhysicalDeviceProperties& properties, const std::filesystem::path& path);
+
+	/// Writes the cache contents out, via a temporary file so an interrupted write can't leave a half written cache behind.
+	void SavePipelineCache(vk::Device& device, vk::PipelineCache cache, const vk::PhysicalDeviceProperties& properties, const std::filesystem::path& path);
+}
@@ -0,0 +1,266 @@
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "LearningVulkan/Utility/Hash.hpp"
+#include "LearningVulkan/Utility/ThreadPool.hpp"
+
+#include "PipelineVariantCache.hpp"
+
+namespace
+{
+	/// Size first so moving an element from one vector to the next changes the key
+	template<typename T>
+	[[nodiscard]] uint64_t HashVector(const std::vector<T>& values, uint64_t hash)
+	{
+		hash = Utility::HashValue(static_cast<uint64_t>(values.size()), hash);
+		return Utility::Fnv1a(std::as_bytes(std::span{ values }), hash);
+	}
+
+	[[nodiscard]] Graphics::PipelineVariantCache::Variant Build(vk::Device& device, vk::PipelineCache pipeline_cache, const Graphics::GraphicsPipelineDesc& desc, const Graphics::PipelineBatchOptions& options)
+	{
+		auto batch{ Graphics::CreateGraphicsPipelines(device, pipeline_cache, std::span{ &desc, 1 }, options) };
+		return Graphics::PipelineVariantCache::Variant{ std::move(batch.pipelines.front()), std::move(batch.timings) };
+	}
+}
+
+namespace Graphics
+{
+	void PipelineVariantCache::Stats::Print(std::ostream& out) const
+	{
+		out << "Pipeline variants: " << variants << " built, " << pending << " pending, " << failed << " failed, "
+			<< hits << " hits, " << misses << " misses (" << background_builds << " in the background)\n";
+	}
+
+	PipelineVariantCache::PipelineVariantCache(vk::Device& logical_device, vk::PipelineCache cache, const PipelineBatchOptions& batch_options)
+		: device{ logical_device }
+		, pipeline_cache{ cache }
+		, options{ batch_options }
+	{
+	}
+
+	PipelineVariantCache::~PipelineVariantCache()
+	{
+		// The builds write into their futures and use the device, neither of which may go before they are done
+		for (auto& [key, entry] : entries)
+		{
+			if (entry.pending.valid()) {
+				entry.pending.wait();
+			}
+		}
+	}
+
+	uint64_t PipelineVariantCache::GetKey(const GraphicsPipelineDesc& desc)
+	{
+		uint64_t hash{ Utility::fnv1a_offset_basis };
+
+		hash = Utility::HashValue(static_cast<uint64_t>(desc.stages.size()), hash);
+		for (const auto& stage : desc.stages)
+		{
+			hash = Utility::HashValue(static_cast<VkShaderStageFlagBits>(stage.stage), hash);
+			hash = Utility::Fnv1a(std::as_bytes(stage.spirv), hash);
+#ifdef RUNTIME_SHADER_COMPILATION
+			hash = Utility::Fnv1a(stage.glsl, hash);
+#endif
+		}
+
+		// Pipelines are only used with render passes compatible with the one they were made for, so the handle is as good as its description
+		// for as long as the render pass lives. EvictUsing() drops the variants before a new render pass or set layout can reuse the handle
+		hash = Utility::HashValue(static_cast<VkRenderPass>(desc.render_pass), hash);
+		hash = Utility::HashValue(desc.subpass, hash);
+		hash = HashVector(desc.colour_attachment_formats, hash);
+
+		hash = Utility::HashValue(static_cast<VkPrimitiveTopology>(desc.topology), hash);
+		hash = Utility::HashValue(static_cast<VkPolygonMode>(desc.polygon_mode), hash);
+		hash = Utility::HashValue(static_cast<VkCullModeFlags>(desc.cull_mode), hash);
+		hash = Utility::HashValue(static_cast<VkFrontFace>(desc.front_face), hash);
+		hash = Utility::HashValue(desc.alpha_blend, hash);
+
+		hash = HashVector(desc.vertex_bindings, hash);
+		hash = HashVector(desc.vertex_attributes, hash);
+		hash = HashVector(desc.set_layouts, hash);
+		hash = HashVector(desc.push_constant_ranges, hash);
+		return hash;
+	}
+
+	const PipelineVariantCache::Variant& PipelineVariantCache::Get(const GraphicsPipelineDesc& desc)
+	{
+		auto [entry, inserted] = FindOrAdd(desc);
+
+		if (inserted)
+		{
+			++stats.misses;
+			try
+			{
+				entry.variant.emplace(Build(device, pipeline_cache, desc, options));
+				++stats.variants;
+			}
+			catch (...)
+			{
+				entry.failed = true;
+				++stats.failed;
+				throw;
+			}
+			return *entry.variant;
+		}
+
+		if (entry.pending.valid()) {
+			Resolve(entry, true);
+		}
+		else if (entry.variant) {
+			++stats.hits;
+		}
+
+		if (entry.failed) {
+			throw std::runtime_error("Pipeline variant '" + desc.name + "' failed to build");
+		}
+		return *entry.variant;
+	}
+
+	const PipelineVariantCache::Variant* PipelineVariantCache::Request(const GraphicsPipelineDesc& desc, Utility::ThreadPool& thread_pool)
+	{
+		auto [entry, inserted] = FindOrAdd(desc);
+
+		if (inserted)
+		{
+			++stats.misses;
+			++stats.pending;
+			++stats.background_builds;
+
+			// Runs serially on the one worker so it never waits on the pool it is running on
+			auto build_options{ options };
+			build_options.thread_pool = nullptr;
+			entry.pending = thread_pool.Submit([&build_device = device, build_cache = pipeline_cache, desc, build_options]()
+				{
+					return Build(build_device, build_cache, desc, build_options);
+				});
+			return nullptr;
+		}
+
+		if (entry.pending.valid()) {
+			Resolve(entry, false);
+		}
+		else if (entry.variant) {
+			++stats.hits;
+		}
+		return entry.variant ? &*entry.variant : nullptr;
+	}
+
+	bool PipelineVariantCache::IsPending(uint64_t key)
+	{
+		const auto it{ entries.find(key) };
+		if (it == std::end(entries) || !it->second.pending.valid()) {
+			return false;
+		}
+
+		Resolve(it->second, false);
+		return it->second.pending.valid();
+	}
+
+	bool PipelineVariantCache::IsFailed(uint64_t key) const
+	{
+		const auto it{ entries.find(key) };
+		return it != std::end(entries) && it->second.failed;
+	}
+
+	const PipelineVariantCache::Variant* PipelineVariantCache::Find(uint64_t key)
+	{
+		const auto it{ entries.find(key) };
+		if (it == std::end(entries)) {
+			return nullptr;
+		}
+
+		if (it->second.pending.valid()) {
+			Resolve(it->second, false);
+		}
+		return it->second.variant ? &*it->second.variant : nullptr;
+	}
+
+	std::optional<PipelineVariantCache::Variant> PipelineVariantCache::Evict(uint64_t key)
+	{
+		const auto it{ entries.find(key) };
+		if (it == std::end(entries) || it->second.pending.valid()) {
+			return std::nullopt;
+		}
+
+		auto variant{ std::move(it->second.variant) };
+		if (variant) {
+			--stats.variants;
+		}
+		else {
+			--stats.failed;
+		}
+		entries.erase(it);
+		return variant;
+	}
+
+	std::vector<PipelineVariantCache::Variant> PipelineVariantCache::EvictUsing(vk::RenderPass render_pass, vk::DescriptorSetLayout set_layout)
+	{
+		std::vector<Variant> evicted{};
+		for (auto it{ std::begin(entries) }; it != std::end(entries);)
+		{
+			auto& entry{ it->second };
+			const bool uses_render_pass{ render_pass && entry.render_pass == render_pass };
+			const bool uses_set_layout{ set_layout && std::find(std::begin(entry.set_layouts), std::end(entry.set_layouts), set_layout) != std::end(entry.set_layouts) };
+			if (!uses_render_pass && !uses_set_layout)
+			{
+				++it;
+				continue;
+			}
+
+			// A build still running was started with the handle too, and its pipeline has to be retired like the rest
+			if (entry.pending.valid()) {
+				Resolve(entry, true);
+			}
+			if (entry.variant)
+			{
+				evicted.push_back(std::move(*entry.variant));
+				--stats.variants;
+			}
+			else {
+				--stats.failed;
+			}
+			it = entries.erase(it);
+		}
+		return evicted;
+	}
+
+	std::pair<PipelineVariantCache::Entry&, bool> PipelineVariantCache::FindOrAdd(const GraphicsPipelineDesc& desc)
+	{
+		auto [it, inserted] = entries.try_emplace(GetKey(desc));
+		if (inserted)
+		{
+			it->second.render_pass = desc.render_pass;
+			it->second.set_layouts = desc.set_layouts;
+		}
+		return { it->second, inserted };
+	}
+
+	void PipelineVariantCache::Resolve(Entry& entry, bool wait)
+	{
+		assert(entry.pending.valid());
+		if (!wait && entry.pending.wait_for(std::chrono::seconds{ 0 }) != std::future_status::ready) {
+			return;
+		}
+
+		--stats.pending;
+		try
+		{
+			entry.variant.emplace(entry.pending.get());
+			++stats.variants;
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Background pipeline build failed: " << e.what() << '\n';
+			entry.failed = true;
+			++stats.failed;
+		}
+	}
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <iosfwd>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "LearningVulkan/Bridges/vulkan.hpp"
+#include "LearningVulkan/Graphics/GraphicsPipelines.hpp"
+
+namespace Utility
+{
+	class ThreadPool;
+}
+
+namespace Graphics
+{
+	/// Graphics pipelines keyed on a hash of everything that goes into them (shaders, formats/render pass, vertex layout, set layouts,
+	/// push constants, raster and blend state), created the first time a description is asked for. Viewport, scissor and line width are
+	/// dynamic state so a resize never needs a new variant. Variants live until they are evicted or the cache goes, pointers to them
+	/// stay valid until then. Render passes and set layouts are keyed on their handles, so variants made with one have to be evicted
+	/// (EvictUsing()) when it is destroyed, before the driver can hand its handle to a new one.
+	/// Builds can run on a thread pool, in which case the caller draws with some other variant until the new one is ready.
+	/// Only the builds themselves run off the calling thread, the cache is not thread safe.
+	class PipelineVariantCache
+	{
+	public:
+		struct Variant
+		{
+			GraphicsPipeline pipeline{};
+			PipelineBatchTimings timings{};
+		};
+
+		struct Stats
+		{
+			std::size_t variants{ 0 }; // built
+			std::size_t pending{ 0 };
+			std::size_t failed{ 0 };
+			std::size_t hits{ 0 };
+			std::size_t misses{ 0 }; // builds started, on either thread
+			std::size_t background_builds{ 0 };
+
+			void Print(std::ostream& out) const;
+		};
+
+		/// options are used for every build, pipeline_cache is shared by all of them
+		PipelineVariantCache(vk::Device& device, vk::PipelineCache pipeline_cache, const PipelineBatchOptions& options = {});
+		/// Waits for any builds still running
+		~PipelineVariantCache();
+
+		PipelineVariantCache(const PipelineVariantCache&) = delete;
+		PipelineVariantCache& operator=(const PipelineVariantCache&) = delete;
+
+		/// The name is left out, it doesn't change the pipeline
+		[[nodiscard]] static uint64_t GetKey(const GraphicsPipelineDesc& desc);
+
+		/// Builds the variant on the calling thread if there isn't one yet, or waits for the background build. Throws when building fails.
+		[[nodiscard]] const Variant& Get(const GraphicsPipelineDesc& desc);
+		/// Never blocks: the variant when it is ready, otherwise null and a build is started on thread_pool if there wasn't one already.
+		/// Stays null for good when the build failed, which IsFailed() tells apart.
+		[[nodiscard]] const Variant* Request(const GraphicsPipelineDesc& desc, Utility::ThreadPool& thread_pool);
+
+		/// Whether a background build for key is still running, polling it does not block
+		[[nodiscard]] bool IsPending(uint64_t key);
+		[[nodiscard]] bool IsFailed(uint64_t key) const;
+		/// The variant if it has been built, never starts or waits for a build
+		[[nodiscard]] const Variant* Find(uint64_t key);
+		/// Hands a built variant over to the caller, e.g. to be retired once the frames using it are done. Pointers to it go stale.
+		/// Nothing for variants still building
+		[[nodiscard]] std::optional<Variant> Evict(uint64_t key);
+		/// Hands over every variant made for render_pass or with set_layout, waiting for any of them still building. Null handles match
+		/// nothing. Call before destroying either of them, pointers to the variants go stale
+		[[nodiscard]] std::vector<Variant> EvictUsing(vk::RenderPass render_pass, vk::DescriptorSetLayout set_layout = {});
+
+		/// For when the pool the options point at is replaced. Background builds don't use it, each runs serially on a single worker
+		void SetThreadPool(Utility::ThreadPool* thread_pool) noexcept { options.thread_pool = thread_pool; }
+
+		[[nodiscard]] const Stats& GetStats() const noexcept { return stats; }
+
+	private:
+		struct Entry
+		{
+			std::optional<Variant> variant{};
+			std::future<Variant> pending{};
+			bool failed{ false };
+			/// What the key only knows by handle
+			vk::RenderPass render_pass{};
+			std::vector<vk::DescriptorSetLayout> set_layouts{};
+		};
+
+		/// Moves a finished background build into the entry, waiting for it when wait is set
+		void Resolve(Entry& entry, bool wait);
+		/// Looks up the entry for desc, creating it (with the handles it uses) if there isn't one
+		[[nodiscard]] std::pair<Entry&, bool> FindOrAdd(const GraphicsPipelineDesc& desc);
+
+		vk::Device& device;
+		vk::PipelineCache pipeline_cache{};
+		PipelineBatchOptions options{};
+		std::unordered_map<uint64_t, Entry> entries{}; // node based, so variants don't move
+		Stats stats{};
+	};
+}
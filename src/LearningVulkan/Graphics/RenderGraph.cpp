@@ -0,0 +1,613 @@
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <utility>
+
+#include "LearningVulkan/Profiling/Trace.hpp"
+
+#include "RenderGraph.hpp"
+
+namespace
+{
+	struct UsageInfo
+	{
+		vk::PipelineStageFlags stages{};
+		vk::AccessFlags access{};
+		vk::ImageLayout layout{ vk::ImageLayout::eUndefined }; // images only
+		vk::ImageUsageFlags image_usage{}; // what a transient image is created with, none for buffer only usages
+		bool write{ false };
+	};
+
+	[[nodiscard]] UsageInfo GetUsageInfo(Graphics::ResourceUsage usage)
+	{
+		using Graphics::ResourceUsage;
+		using Stage = vk::PipelineStageFlagBits;
+		using Access = vk::AccessFlagBits;
+		using Layout = vk::ImageLayout;
+		using Usage = vk::ImageUsageFlagBits;
+
+		switch (usage)
+		{
+		case ResourceUsage::eColourAttachment: return { Stage::eColorAttachmentOutput, Access::eColorAttachmentRead | Access::eColorAttachmentWrite, Layout::eColorAttachmentOptimal, Usage::eColorAttachment, true };
+		case ResourceUsage::eSampledFragment: return { Stage::eFragmentShader, Access::eShaderRead, Layout::eShaderReadOnlyOptimal, Usage::eSampled, false };
+		case ResourceUsage::eSampledCompute: return { Stage::eComputeShader, Access::eShaderRead, Layout::eShaderReadOnlyOptimal, Usage::eSampled, false };
+		case ResourceUsage::eStorageReadVertex: return { Stage::eVertexShader, Access::eShaderRead, Layout::eGeneral, Usage::eStorage, false };
+		case ResourceUsage::eStorageReadCompute: return { Stage::eComputeShader, Access::eShaderRead, Layout::eGeneral, Usage::eStorage, false };
+		case ResourceUsage::eStorageWriteCompute: return { Stage::eComputeShader, Access::eShaderRead | Access::eShaderWrite, Layout::eGeneral, Usage::eStorage, true };
+		case ResourceUsage::eVertexBuffer: return { Stage::eVertexInput, Access::eVertexAttributeRead, {}, {}, false };
+		case ResourceUsage::eIndexBuffer: return { Stage::eVertexInput, Access::eIndexRead, {}, {}, false };
+		case ResourceUsage::eIndirectBuffer: return { Stage::eDrawIndirect, Access::eIndirectCommandRead, {}, {}, false };
+		case ResourceUsage::eTransferSrc: return { Stage::eTransfer, Access::eTransferRead, Layout::eTransferSrcOptimal, Usage::eTransferSrc, false };
+		case ResourceUsage::eTransferDst: return { Stage::eTransfer, Access::eTransferWrite, Layout::eTransferDstOptimal, Usage::eTransferDst, true };
+		default: throw std::runtime_error("Unknown resource usage");
+		}
+	}
+
+	/// Only writes have to be made available, reads just need ordering
+	[[nodiscard]] vk::AccessFlags GetWriteAccess(vk::AccessFlags access)
+	{
+		return access & (vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite);
+	}
+
+	constexpr vk::ImageSubresourceRange colour_range{ vk::ImageAspectFlagBits::eColor, 0U, VK_REMAINING_MIP_LEVELS, 0U, VK_REMAINING_ARRAY_LAYERS };
+}
+
+namespace Graphics
+{
+	void RenderGraph::Stats::Print(std::ostream& out) const
+	{
+		out << "Render graph: " << pass_count - culled_pass_count << " passes (" << culled_pass_count << " culled), "
+			<< barrier_count << " barriers with " << image_barrier_count << " layout transitions per frame, "
+			<< transient_image_count << " transient images in " << transient_bytes << " bytes (" << unaliased_bytes << " without aliasing)\n";
+	}
+
+	RenderGraph::RenderGraph(vk::Device& logical_device, MemoryAllocator& memory_allocator, const vk::DispatchLoaderDynamic& dispatch_loader)
+		: device{ logical_device }
+		, allocator{ memory_allocator }
+		, dispatch{ dispatch_loader }
+	{
+	}
+
+	RenderGraph::Handle RenderGraph::ImportImage(std::string name, const ImportedImageDesc& desc, bool output)
+	{
+		assert(!compiled);
+		Resource resource{};
+		resource.name = std::move(name);
+		resource.is_image = true;
+		resource.output = output;
+		resource.imported = desc;
+		resources.push_back(std::move(resource));
+		return Handle{ static_cast<uint32_t>(resources.size() - 1) };
+	}
+
+	RenderGraph::Handle RenderGraph::ImportBuffer(std::string name, vk::Buffer buffer, bool output)
+	{
+		assert(!compiled);
+		Resource resource{};
+		resource.name = std::move(name);
+		resource.output = output;
+		resource.buffer = buffer;
+		resources.push_back(std::move(resource));
+		return Handle{ static_cast<uint32_t>(resources.size() - 1) };
+	}
+
+	RenderGraph::Handle RenderGraph::CreateImage(std::string name, const TransientImageDesc& desc)
+	{
+		assert(!compiled);
+		Resource resource{};
+		resource.name = std::move(name);
+		resource.is_image = true;
+		resource.transient = true;
+		resource.transient_desc = desc;
+		resource.extent = desc.extent;
+		resources.push_back(std::move(resource));
+		return Handle{ static_cast<uint32_t>(resources.size() - 1) };
+	}
+
+	void RenderGraph::AddPass(PassDesc desc)
+	{
+		assert(!compiled);
+		assert(desc.record);
+
+		Pass pass{};
+		for (const auto& access : desc.accesses)
+		{
+			assert(access.resource.index < resources.size());
+			const auto info{ GetUsageInfo(access.usage) };
+			assert(resources[access.resource.index].is_image == (info.image_usage != vk::ImageUsageFlags{}));
+			// A read-write storage access may only write, but assuming it reads keeps whatever came before it
+			pass.accesses.push_back(Access{ access.resource.index, access.usage, !info.write || access.usage == ResourceUsage::eStorageWriteCompute, info.write });
+		}
+		for (const auto& attachment : desc.colour_attachments)
+		{
+			assert(attachment.image.index < resources.size() && resources[attachment.image.index].is_image);
+			pass.accesses.push_back(Access{ attachment.image.index, ResourceUsage::eColourAttachment, attachment.load_op == vk::AttachmentLoadOp::eLoad, true });
+		}
+
+		pass.desc = std::move(desc);
+		passes.push_back(std::move(pass));
+	}
+
+	void RenderGraph::SetImage(Handle handle, vk::Image image, vk::ImageView view, vk::Extent2D extent)
+	{
+		auto& resource{ resources.at(handle.index) };
+		assert(resource.is_image && !resource.transient);
+		resource.image = image;
+		resource.view = view;
+		resource.extent = extent;
+	}
+
+	void RenderGraph::SetBuffer(Handle handle, vk::Buffer buffer)
+	{
+		auto& resource{ resources.at(handle.index) };
+		assert(!resource.is_image);
+		resource.buffer = buffer;
+	}
+
+	const RenderGraph::Stats& RenderGraph::Compile()
+	{
+		assert(!compiled);
+		const Profiling::TraceScope trace{ "CompileRenderGraph" };
+
+		stats = Stats{};
+		stats.pass_count = passes.size();
+
+		const auto order{ OrderPasses(CullPasses()) };
+		stats.culled_pass_count = passes.size() - order.size();
+		CreateTransientImages(order);
+		BuildBarriers(order);
+
+		compiled = true;
+		return stats;
+	}
+
+	void RenderGraph::Record(vk::CommandBuffer& cmd, const FrameInfo& frame)
+	{
+		assert(compiled);
+
+		for (const auto& compiled_pass : compiled_passes)
+		{
+			RecordBarriers(cmd, compiled_pass.barriers);
+
+			const auto& pass{ passes[compiled_pass.pass].desc };
+			if (pass.colour_attachments.empty())
+			{
+				pass.record(cmd, *this, frame);
+				continue;
+			}
+
+			rendering_attachments.clear();
+			for (const auto& attachment : pass.colour_attachments)
+			{
+				rendering_attachments.push_back(vk::RenderingAttachmentInfoKHR{}
+					.setImageView(GetImageView(attachment.image))
+					.setImageLayout(vk::ImageLayout::eColorAttachmentOptimal)
+					.setLoadOp(attachment.load_op)
+					.setStoreOp(attachment.store_op)
+					.setClearValue(attachment.clear_colour)
+				);
+			}
+
+			cmd.beginRenderingKHR(vk::RenderingInfoKHR{}
+				.setFlags(pass.secondary_command_buffers ? vk::RenderingFlagBitsKHR::eContentsSecondaryCommandBuffers : vk::RenderingFlagsKHR{})
+				.setRenderArea({ {0, 0}, resources[pass.colour_attachments.front().image.index].extent })
+				.setLayerCount(1U)
+				.setColorAttachments(rendering_attachments),
+				dispatch
+			);
+			pass.record(cmd, *this, frame);
+			cmd.endRenderingKHR(dispatch);
+		}
+
+		RecordBarriers(cmd, final_barriers);
+	}
+
+	vk::Image RenderGraph::GetImage(Handle handle) const
+	{
+		return resources.at(handle.index).image;
+	}
+
+	vk::ImageView RenderGraph::GetImageView(Handle handle) const
+	{
+		return resources.at(handle.index).view;
+	}
+
+	vk::Buffer RenderGraph::GetBuffer(Handle handle) const
+	{
+		return resources.at(handle.index).buffer;
+	}
+
+	std::vector<std::string> RenderGraph::GetPassOrder() const
+	{
+		std::vector<std::string> names{};
+		names.reserve(compiled_passes.size());
+		for (const auto& compiled_pass : compiled_passes) {
+			names.push_back(passes[compiled_pass.pass].desc.name);
+		}
+		return names;
+	}
+
+	std::vector<bool> RenderGraph::CullPasses() const
+	{
+		// Walking backwards, a pass is needed when it writes an output or something a needed pass reads. Earlier writers are never
+		// dropped because of a later write, as a write may only cover part of the resource
+		std::vector<bool> needed(resources.size());
+		std::transform(std::begin(resources), std::end(resources), std::begin(needed), [](const Resource& resource) { return resource.output; });
+
+		std::vector<bool> live(passes.size(), false);
+		for (std::size_t idx{ passes.size() }; idx-- > 0;)
+		{
+			const auto& pass{ passes[idx] };
+			live[idx] = pass.desc.side_effects || std::any_of(std::begin(pass.accesses), std::end(pass.accesses), [&](const Access& access) { return access.write && needed[access.resource]; });
+			if (!live[idx]) {
+				continue;
+			}
+
+			for (const auto& access : pass.accesses)
+			{
+				if (access.read) {
+					needed[access.resource] = true;
+				}
+			}
+		}
+		return live;
+	}
+
+	std::vector<uint32_t> RenderGraph::OrderPasses(const std::vector<bool>& live) const
+	{
+		// Dependencies follow from the declaration order: reads wait on the last write, writes on that and every read since
+		std::vector<std::vector<uint32_t>> dependencies(passes.size());
+		{
+			struct Users
+			{
+				std::optional<uint32_t> writer{};
+				std::vector<uint32_t> readers{};
+			};
+			std::vector<Users> users(resources.size());
+
+			for (uint32_t idx{ 0 }; idx < passes.size(); ++idx)
+			{
+				if (!live[idx]) {
+					continue;
+				}
+
+				for (const auto& access : passes[idx].accesses)
+				{
+					const auto& resource_users{ users[access.resource] };
+					if (resource_users.writer) {
+						dependencies[idx].push_back(*resource_users.writer);
+					}
+					if (access.write) {
+						dependencies[idx].insert(std::end(dependencies[idx]), std::begin(resource_users.readers), std::end(resource_users.readers));
+					}
+				}
+				for (const auto& access : passes[idx].accesses)
+				{
+					auto& resource_users{ users[access.resource] };
+					if (access.write)
+					{
+						resource_users.writer = idx;
+						resource_users.readers.clear();
+					}
+					else {
+						resource_users.readers.push_back(idx);
+					}
+				}
+			}
+		}
+
+		// Of the passes ready to go, the one whose dependencies were recorded longest ago goes next. That keeps dependent passes apart
+		// so the work before a barrier has had a chance to finish, and otherwise keeps the declaration order
+		constexpr std::size_t not_recorded{ std::numeric_limits<std::size_t>::max() };
+		std::vector<std::size_t> position(passes.size(), not_recorded);
+		std::vector<uint32_t> order{};
+		const auto live_count{ static_cast<std::size_t>(std::count(std::begin(live), std::end(live), true)) };
+		while (order.size() < live_count)
+		{
+			std::optional<uint32_t> best{};
+			std::size_t best_latest{ 0 };
+			for (uint32_t idx{ 0 }; idx < passes.size(); ++idx)
+			{
+				if (!live[idx] || position[idx] != not_recorded) {
+					continue;
+				}
+
+				std::size_t latest{ 0 }; // one past the position of the newest dependency
+				bool ready{ true };
+				for (const uint32_t dependency : dependencies[idx])
+				{
+					if (position[dependency] == not_recorded)
+					{
+						ready = false;
+						break;
+					}
+					latest = std::max(latest, position[dependency] + 1);
+				}
+
+				if (ready && (!best || latest < best_latest))
+				{
+					best = idx;
+					best_latest = latest;
+				}
+			}
+
+			assert(best); // dependencies only ever point at earlier passes, so something is always ready
+			position[*best] = order.size();
+			order.push_back(*best);
+		}
+		return order;
+	}
+
+	void RenderGraph::CreateTransientImages(const std::vector<uint32_t>& order)
+	{
+		// Lifetimes are in recorded positions, and the images get the usage of everything that uses them
+		struct Transient
+		{
+			uint32_t resource{ 0 };
+			std::size_t first{ 0 };
+			std::size_t last{ 0 };
+			vk::ImageUsageFlags usage{};
+			vk::MemoryRequirements requirements{};
+		};
+		std::vector<std::optional<Transient>> transients(resources.size());
+		for (std::size_t position{ 0 }; position < order.size(); ++position)
+		{
+			for (const auto& access : passes[order[position]].accesses)
+			{
+				if (!resources[access.resource].transient) {
+					continue;
+				}
+
+				auto& transient{ transients[access.resource] };
+				if (!transient) {
+					transient = Transient{ access.resource, position, position };
+				}
+				transient->last = position;
+				transient->usage |= GetUsageInfo(access.usage).image_usage;
+			}
+		}
+
+		std::vector<Transient> used{};
+		for (auto& transient : transients)
+		{
+			if (!transient) {
+				continue; // only culled passes use it
+			}
+
+			auto& resource{ resources[transient->resource] };
+			resource.owned_image = device.createImageUnique(vk::ImageCreateInfo{}
+				.setImageType(vk::ImageType::e2D)
+				.setFormat(resource.transient_desc.format)
+				.setExtent(vk::Extent3D{ resource.transient_desc.extent.width, resource.transient_desc.extent.height, 1U })
+				.setMipLevels(1U)
+				.setArrayLayers(1U)
+				.setSamples(vk::SampleCountFlagBits::e1)
+				.setTiling(vk::ImageTiling::eOptimal)
+				.setUsage(transient->usage)
+				.setSharingMode(vk::SharingMode::eExclusive)
+				.setInitialLayout(vk::ImageLayout::eUndefined)
+			);
+			resource.image = *resource.owned_image;
+			transient->requirements = device.getImageMemoryRequirements(resource.image);
+			stats.unaliased_bytes += transient->requirements.size;
+			used.push_back(*transient);
+		}
+		stats.transient_image_count = used.size();
+
+		// Biggest first, each into the first slot of memory it fits alongside without overlapping anything else's lifetime.
+		// A slot grows to the biggest image in it
+		struct Slot
+		{
+			vk::MemoryRequirements requirements{};
+			std::vector<std::size_t> images{}; // into used
+		};
+		std::vector<Slot> slots{};
+		std::sort(std::begin(used), std::end(used), [](const Transient& lhs, const Transient& rhs) { return lhs.requirements.size > rhs.requirements.size; });
+		for (std::size_t idx{ 0 }; idx < used.size(); ++idx)
+		{
+			const auto& transient{ used[idx] };
+			const auto fits = [&](const Slot& slot)
+			{
+				return (slot.requirements.memoryTypeBits & transient.requirements.memoryTypeBits) != 0
+					&& std::none_of(std::begin(slot.images), std::end(slot.images), [&](std::size_t other) { return used[other].first <= transient.last && transient.first <= used[other].last; });
+			};
+
+			auto slot{ std::find_if(std::begin(slots), std::end(slots), fits) };
+			if (slot == std::end(slots))
+			{
+				slots.push_back(Slot{ transient.requirements });
+				slot = std::prev(std::end(slots));
+			}
+			slot->requirements.size = std::max(slot->requirements.size, transient.requirements.size);
+			slot->requirements.alignment = std::max(slot->requirements.alignment, transient.requirements.alignment);
+			slot->requirements.memoryTypeBits &= transient.requirements.memoryTypeBits;
+			slot->images.push_back(idx);
+		}
+
+		transient_memory.reserve(slots.size());
+		for (const auto& slot : slots)
+		{
+			transient_memory.push_back(allocator.Allocate(slot.requirements, ResourceTiling::Optimal, AllocationDesc{}));
+			const auto& memory{ transient_memory.back() };
+			stats.transient_bytes += slot.requirements.size;
+
+			for (const std::size_t image : slot.images)
+			{
+				auto& resource{ resources[used[image].resource] };
+				resource.memory_slot = transient_memory.size() - 1;
+				device.bindImageMemory(resource.image, memory.GetMemory(), memory.GetOffset());
+				resource.owned_view = device.createImageViewUnique(vk::ImageViewCreateInfo{ {}, resource.image, vk::ImageViewType::e2D, resource.transient_desc.format, {}, colour_range });
+				resource.view = *resource.owned_view;
+			}
+		}
+	}
+
+	void RenderGraph::BuildBarriers(const std::vector<uint32_t>& order)
+	{
+		// What each resource has been through so far in the frame
+		struct State
+		{
+			bool used{ false };
+			vk::ImageLayout layout{ vk::ImageLayout::eUndefined };
+			vk::PipelineStageFlags write_stages{}; // of the last write (or layout transition)
+			vk::AccessFlags write_access{};
+			vk::PipelineStageFlags read_stages{}; // since the last write
+			vk::PipelineStageFlags visible_stages{}; // the last write has been made visible to these
+			vk::AccessFlags visible_access{};
+		};
+		std::vector<State> states{};
+
+		// Stages and writes of the last image to use each slot of transient memory, which the next one to use it has to wait on
+		struct SlotUse
+		{
+			vk::PipelineStageFlags stages{};
+			vk::AccessFlags write_access{};
+		};
+		std::vector<SlotUse> slot_uses(transient_memory.size());
+
+		const auto add_transition = [&](BarrierBatch& batch, uint32_t resource, State& state, vk::ImageLayout new_layout, vk::PipelineStageFlags dst_stages, vk::AccessFlags dst_access)
+		{
+			const auto src_stages{ state.write_stages | state.read_stages };
+			batch.src_stages |= src_stages ? src_stages : vk::PipelineStageFlags{ vk::PipelineStageFlagBits::eTopOfPipe };
+			batch.dst_stages |= dst_stages;
+			batch.images.push_back(ImageTransition{ resource, state.layout, new_layout, state.write_access, dst_access });
+		};
+
+		// Transient memory is shared by every frame in flight, so the first use of a slot in a frame has to wait on its last use in the
+		// frame before. The passes are gone through twice, the first time only to find what that last use is
+		for (const bool seeding : { true, false })
+		{
+			states.assign(resources.size(), State{});
+			compiled_passes.clear();
+			for (const uint32_t pass : order)
+			{
+				BarrierBatch batch{};
+				for (const auto& access : passes[pass].accesses)
+				{
+					const auto info{ GetUsageInfo(access.usage) };
+					const auto& resource{ resources[access.resource] };
+					auto& state{ states[access.resource] };
+
+					// First use in the frame waits on whatever had the resource before the graph did
+					if (!state.used)
+					{
+						state.used = true;
+						if (resource.transient)
+						{
+							state.read_stages = slot_uses[resource.memory_slot].stages;
+							state.write_access = slot_uses[resource.memory_slot].write_access;
+						}
+						else if (resource.is_image)
+						{
+							state.layout = resource.imported.initial_layout;
+							state.read_stages = resource.imported.initial_stages;
+						}
+					}
+
+					const bool layout_change{ resource.is_image && info.layout != state.layout };
+					if (layout_change)
+					{
+						add_transition(batch, access.resource, state, info.layout, info.stages, info.access);
+						state.layout = info.layout;
+					}
+					else if (access.write)
+					{
+						// Write after read only needs ordering, write after write the earlier write made available too
+						const auto src_stages{ state.write_stages | state.read_stages };
+						if (src_stages)
+						{
+							batch.src_stages |= src_stages;
+							batch.dst_stages |= info.stages;
+							batch.src_access |= state.write_access;
+							if (state.write_access) {
+								batch.dst_access |= info.access;
+							}
+						}
+					}
+					else if (state.write_stages && ((info.stages & ~state.visible_stages) || (info.access & ~state.visible_access)))
+					{
+						// Read after write, once per stage and access
+						batch.src_stages |= state.write_stages;
+						batch.dst_stages |= info.stages;
+						batch.src_access |= state.write_access;
+						batch.dst_access |= info.access;
+						state.visible_stages |= info.stages;
+						state.visible_access |= info.access;
+					}
+
+					if (access.write || layout_change)
+					{
+						// A layout transition counts as a write everything later has to be ordered after, already visible to this access
+						state.write_stages = info.stages;
+						state.write_access = access.write ? GetWriteAccess(info.access) : vk::AccessFlags{};
+						state.read_stages = {};
+						state.visible_stages = access.write ? vk::PipelineStageFlags{} : info.stages;
+						state.visible_access = access.write ? vk::AccessFlags{} : info.access;
+					}
+					if (!access.write) {
+						state.read_stages |= info.stages;
+					}
+
+					if (resource.transient) {
+						slot_uses[resource.memory_slot] = SlotUse{ state.write_stages | state.read_stages, state.write_access };
+					}
+				}
+
+				if (seeding) {
+					continue;
+				}
+				if (!batch.IsEmpty()) {
+					++stats.barrier_count;
+				}
+				stats.image_barrier_count += batch.images.size();
+				compiled_passes.push_back(CompiledPass{ pass, std::move(batch) });
+			}
+		}
+
+		final_barriers = BarrierBatch{};
+		for (uint32_t idx{ 0 }; idx < resources.size(); ++idx)
+		{
+			const auto& resource{ resources[idx] };
+			auto& state{ states[idx] };
+			if (state.used && resource.is_image && !resource.transient && resource.imported.final_layout != vk::ImageLayout::eUndefined && resource.imported.final_layout != state.layout) {
+				add_transition(final_barriers, idx, state, resource.imported.final_layout, resource.imported.final_stages, resource.imported.final_access);
+			}
+		}
+		if (!final_barriers.IsEmpty()) {
+			++stats.barrier_count;
+		}
+		stats.image_barrier_count += final_barriers.images.size();
+	}
+
+	void RenderGraph::RecordBarriers(vk::CommandBuffer& cmd, const BarrierBatch& batch)
+	{
+		if (batch.IsEmpty()) {
+			return;
+		}
+
+		image_barriers.clear();
+		for (const auto& transition : batch.images)
+		{
+			image_barriers.push_back(vk::ImageMemoryBarrier{}
+				.setSrcAccessMask(transition.src_access)
+				.setDstAccessMask(transition.dst_access)
+				.setOldLayout(transition.old_layout)
+				.setNewLayout(transition.new_layout)
+				.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+				.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+				.setImage(resources[transition.resource].image)
+				.setSubresourceRange(colour_range)
+			);
+		}
+
+		// Execution dependencies alone don't need a memory barrier
+		const vk::MemoryBarrier memory_barrier{ batch.src_access, batch.dst_access };
+		const bool has_memory_barrier{ batch.src_access || batch.dst_access };
+		cmd.pipelineBarrier(batch.src_stages, batch.dst_stages, {}, vk::ArrayProxy<const vk::MemoryBarrier>{ has_memory_barrier ? 1U : 0U, &memory_barrier }, {}, image_barriers);
+	}
+}
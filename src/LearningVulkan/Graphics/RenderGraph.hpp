@@ -0,0 +1,219 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "LearningVulkan/Bridges/vulkan.hpp"
+#include "LearningVulkan/Graphics/MemoryAllocator.hpp"
+
+namespace Graphics
+{
+	/// How a pass uses a resource, which decides the stages, access and (for images) layout its barriers are made of
+	enum class ResourceUsage
+	{
+		eColourAttachment,
+		eSampledFragment,
+		eSampledCompute,
+		eStorageReadVertex,
+		eStorageReadCompute,
+		eStorageWriteCompute, // read and write
+		eVertexBuffer,
+		eIndexBuffer,
+		eIndirectBuffer,
+		eTransferSrc,
+		eTransferDst,
+	};
+
+	/// Passes declare the resources they read and write, and compiling the graph works out the rest of the frame: an order for the passes,
+	/// which of them can be left out because nothing uses what they write, the barriers and layout transitions between them (at most one
+	/// vkCmdPipelineBarrier per pass), and shared memory for transient images whose lifetimes don't overlap.
+	/// Compiled once and then recorded every frame. Changing the passes or resources means building a new graph; imported images and
+	/// buffers can be swapped between frames though. Graphics passes render with VK_KHR_dynamic_rendering. Not thread safe.
+	class RenderGraph
+	{
+	public:
+		struct Handle
+		{
+			uint32_t index{ std::numeric_limits<uint32_t>::max() };
+
+			[[nodiscard]] bool IsValid() const noexcept { return index != std::numeric_limits<uint32_t>::max(); }
+		};
+
+		struct ImportedImageDesc
+		{
+			vk::ImageLayout initial_layout{ vk::ImageLayout::eUndefined }; // undefined throws the contents away
+			vk::PipelineStageFlags initial_stages{ vk::PipelineStageFlagBits::eTopOfPipe }; // what the first barrier waits on, e.g. the stage a semaphore is waited on at
+			vk::ImageLayout final_layout{ vk::ImageLayout::eUndefined }; // left as the last pass used it when undefined
+			vk::PipelineStageFlags final_stages{ vk::PipelineStageFlagBits::eBottomOfPipe };
+			vk::AccessFlags final_access{};
+		};
+
+		/// Only lives for the frame, created (and aliased) by the graph with the usage of every pass using it. Shared by the frames in
+		/// flight, the first use in a frame waits on the last use in the frame before
+		struct TransientImageDesc
+		{
+			vk::Format format{ vk::Format::eUndefined };
+			vk::Extent2D extent{};
+		};
+
+		struct ResourceAccess
+		{
+			Handle resource{};
+			ResourceUsage usage{};
+		};
+
+		struct ColourAttachment
+		{
+			Handle image{};
+			vk::AttachmentLoadOp load_op{ vk::AttachmentLoadOp::eClear };
+			vk::AttachmentStoreOp store_op{ vk::AttachmentStoreOp::eStore };
+			vk::ClearColorValue clear_colour{};
+		};
+
+		struct FrameInfo
+		{
+			uint32_t frame_index{ 0 }; // frame in flight
+			uint32_t image_index{ 0 }; // swap chain image
+		};
+
+		using RecordFunction = std::function<void(vk::CommandBuffer& cmd, const RenderGraph& graph, const FrameInfo& frame)>;
+
+		struct PassDesc
+		{
+			std::string name{};
+			std::vector<ResourceAccess> accesses{};
+			/// Makes it a graphics pass, rendering begins on these (at the size of the first) around record. Each counts as an eColourAttachment access
+			std::vector<ColourAttachment> colour_attachments{};
+			bool secondary_command_buffers{ false }; // record only executes secondary command buffers inside the rendering
+			bool side_effects{ false }; // never culled, for passes whose results leave the graph some other way
+			RecordFunction record{};
+		};
+
+		struct Stats
+		{
+			std::size_t pass_count{ 0 };
+			std::size_t culled_pass_count{ 0 };
+			std::size_t barrier_count{ 0 }; // vkCmdPipelineBarrier calls per frame
+			std::size_t image_barrier_count{ 0 }; // layout transitions per frame
+			std::size_t transient_image_count{ 0 };
+			vk::DeviceSize transient_bytes{ 0 };
+			vk::DeviceSize unaliased_bytes{ 0 }; // what the transient images would take with memory of their own
+
+			void Print(std::ostream& out) const;
+		};
+
+		/// dispatch has to have vkCmdBeginRenderingKHR/vkCmdEndRenderingKHR loaded when there are graphics passes, and outlive the graph
+		RenderGraph(vk::Device& device, MemoryAllocator& allocator, const vk::DispatchLoaderDynamic& dispatch);
+
+		RenderGraph(const RenderGraph&) = delete;
+		RenderGraph& operator=(const RenderGraph&) = delete;
+
+		/// Outputs are what the graph is for, a pass is culled unless it (indirectly) contributes to one or has side effects
+		[[nodiscard]] Handle ImportImage(std::string name, const ImportedImageDesc& desc, bool output = true);
+		[[nodiscard]] Handle ImportBuffer(std::string name, vk::Buffer buffer = {}, bool output = false);
+		[[nodiscard]] Handle CreateImage(std::string name, const TransientImageDesc& desc);
+		/// Passes are declared in an order that works, i.e. writers before readers. Compile() is free to move independent ones around
+		void AddPass(PassDesc pass);
+
+		/// For swapping imported resources between frames, e.g. the swap chain image being rendered to
+		void SetImage(Handle handle, vk::Image image, vk::ImageView view, vk::Extent2D extent);
+		void SetBuffer(Handle handle, vk::Buffer buffer);
+
+		/// Orders and culls the passes, works out the barriers and creates the transient images. Once, before the first Record()
+		const Stats& Compile();
+		void Record(vk::CommandBuffer& cmd, const FrameInfo& frame);
+
+		[[nodiscard]] vk::Image GetImage(Handle handle) const;
+		[[nodiscard]] vk::ImageView GetImageView(Handle handle) const;
+		[[nodiscard]] vk::Buffer GetBuffer(Handle handle) const;
+		[[nodiscard]] const Stats& GetStats() const noexcept { return stats; }
+		/// Names of the passes left after culling, in the order they are recorded
+		[[nodiscard]] std::vector<std::string> GetPassOrder() const;
+
+	private:
+		struct Resource
+		{
+			std::string name{};
+			bool is_image{ false };
+			bool transient{ false };
+			bool output{ false };
+			ImportedImageDesc imported{};
+			TransientImageDesc transient_desc{};
+			vk::Image image{};
+			vk::ImageView view{};
+			vk::Extent2D extent{};
+			vk::Buffer buffer{};
+			/// Transient images only
+			vk::UniqueImage owned_image{};
+			vk::UniqueImageView owned_view{};
+			std::size_t memory_slot{ 0 };
+		};
+
+		struct Access
+		{
+			uint32_t resource{ 0 };
+			ResourceUsage usage{};
+			bool read{ false };
+			bool write{ false };
+		};
+
+		struct Pass
+		{
+			PassDesc desc{};
+			std::vector<Access> accesses{}; // desc.accesses and the colour attachments
+		};
+
+		struct ImageTransition
+		{
+			uint32_t resource{ 0 };
+			vk::ImageLayout old_layout{};
+			vk::ImageLayout new_layout{};
+			vk::AccessFlags src_access{};
+			vk::AccessFlags dst_access{};
+		};
+
+		/// One vkCmdPipelineBarrier. Anything without a layout transition goes through the global memory barrier
+		struct BarrierBatch
+		{
+			vk::PipelineStageFlags src_stages{};
+			vk::PipelineStageFlags dst_stages{};
+			vk::AccessFlags src_access{};
+			vk::AccessFlags dst_access{};
+			std::vector<ImageTransition> images{};
+
+			[[nodiscard]] bool IsEmpty() const noexcept { return !dst_stages; }
+		};
+
+		struct CompiledPass
+		{
+			uint32_t pass{ 0 };
+			BarrierBatch barriers{}; // recorded before the pass
+		};
+
+		[[nodiscard]] std::vector<bool> CullPasses() const;
+		[[nodiscard]] std::vector<uint32_t> OrderPasses(const std::vector<bool>& live) const;
+		void CreateTransientImages(const std::vector<uint32_t>& order);
+		void BuildBarriers(const std::vector<uint32_t>& order);
+		void RecordBarriers(vk::CommandBuffer& cmd, const BarrierBatch& batch);
+
+		vk::Device& device;
+		MemoryAllocator& allocator;
+		const vk::DispatchLoaderDynamic& dispatch;
+		/// WARNING: Order of members is important! The transient images must be destroyed before the memory they alias is freed
+		std::vector<Allocation> transient_memory{};
+		std::vector<Resource> resources{};
+		std::vector<Pass> passes{};
+		std::vector<CompiledPass> compiled_passes{};
+		BarrierBatch final_barriers{}; // imported images into their final layouts
+		bool compiled{ false };
+		Stats stats{};
+		/// Scratch space reused every Record()
+		std::vector<vk::ImageMemoryBarrier> image_barriers{};
+		std::vector<vk::RenderingAttachmentInfoKHR> rendering_attachments{};
+	};
+}
@@ -0,0 +1,217 @@
+
+#ifdef RUNTIME_SHADER_COMPILATION
+
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "LearningVulkan/Bridges/vulkan.hpp"
+#include "LearningVulkan/Utility/Hash.hpp"
+
+#include "ShaderCompiler.hpp"
+
+namespace
+{
+	constexpr uint32_t spirv_magic{ 0x07230203 };
+	constexpr uint32_t cache_format_version{ 1 }; // bump to invalidate every existing cache entry
+
+	[[nodiscard]] uint64_t MakeCacheKey(std::string_view src, shaderc_shader_kind kind, const Graphics::ShaderCompileSettings& settings)
+	{
+		// shaderc has no library version query, the SPIR-V version it targets and the SDK headers it shipped with are the best we have
+		unsigned int spirv_version{}, spirv_revision{};
+		shaderc_get_spv_version(&spirv_version, &spirv_revision);
+
+		uint64_t key{ Utility::Fnv1a(src) };
+		key = Utility::HashValue(static_cast<uint64_t>(src.size()), key);
+		key = Utility::HashValue(static_cast<int32_t>(kind), key);
+		key = Utility::HashValue(static_cast<int32_t>(settings.optimization), key);
+		key = Utility::HashValue(settings.generate_debug_info, key);
+		for (const auto& [name, value] : settings.definitions)
+		{
+			key = Utility::Fnv1a(name, key);
+			key = Utility::Fnv1a("=", key);
+			key = Utility::Fnv1a(value, key);
+			key = Utility::Fnv1a(";", key);
+		}
+		key = Utility::HashValue(spirv_version, key);
+		key = Utility::HashValue(spirv_revision, key);
+		key = Utility::HashValue(static_cast<uint32_t>(VK_HEADER_VERSION), key);
+		key = Utility::HashValue(cache_format_version, key);
+		return key;
+	}
+
+	[[nodiscard]] bool IsPlausibleSpirv(std::span<const std::byte> bytes)
+	{
+		if (bytes.empty() || bytes.size() % sizeof(uint32_t) != 0) {
+			return false;
+		}
+
+		uint32_t magic{};
+		std::memcpy(&magic, bytes.data(), sizeof(magic));
+		return magic == spirv_magic;
+	}
+}
+
+namespace Graphics
+{
+	shaderc::SpvCompilationResult CompileShader(shaderc::Compiler& compiler, std::string_view src, shaderc_shader_kind kind, std::string_view name, const ShaderCompileSettings& settings)
+	{
+		shaderc::CompileOptions options{};
+		options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_2);
+		options.SetOptimizationLevel(settings.optimization);
+		if (settings.generate_debug_info) {
+			options.SetGenerateDebugInfo();
+		}
+		for (const auto& [definition, value] : settings.definitions) {
+			options.AddMacroDefinition(definition, value);
+		}
+
+		const std::string name_str{ name };
+		auto result = compiler.CompileGlslToSpv(src.data(), src.size(), kind, name_str.c_str(), options);
+
+		std::cout << "Shader '" << name << "' compiled with '" << result.GetNumErrors() << "' errors and '" << result.GetNumWarnings() << "' warnings." << '\n';
+
+		if (result.GetCompilationStatus() != shaderc_compilation_status::shaderc_compilation_status_success)
+		{
+			std::string_view status_type_msg{};
+			switch (result.GetCompilationStatus())
+			{
+				using enum shaderc_compilation_status;
+			case shaderc_compilation_status_success: status_type_msg = "Success"; break;
+			case shaderc_compilation_status_invalid_stage: status_type_msg = "Invalid Stage"; break;
+			case shaderc_compilation_status_compilation_error: status_type_msg = "Compilation Error"; break;
+			case shaderc_compilation_status_internal_error: status_type_msg = "Unexpected Failure"; break;
+			case shaderc_compilation_status_null_result_object: status_type_msg = "Null result object"; break;
+			case shaderc_compilation_status_invalid_assembly: status_type_msg = "Invalid Assembly"; break;
+			case shaderc_compilation_status_validation_error: status_type_msg = "Validation Error"; break;
+			case shaderc_compilation_status_transformation_error: status_type_msg = "Transformation Error"; break;
+			case shaderc_compilation_status_configuration_error: status_type_msg = "Configuration Error"; break;
+			default: status_type_msg = "Unrecognised error code"; break;
+			}
+
+			std::cerr << "Error compiling shader '" << name << "': " << status_type_msg << ". Message: " << result.GetErrorMessage() << '\n';
+		}
+
+		return result;
+	}
+
+	ShaderCompileCache::ShaderCompileCache(std::filesystem::path cache_directory)
+		: directory{ std::move(cache_directory) }
+	{
+		if (!directory.empty())
+		{
+			std::error_code ec{};
+			std::filesystem::create_directories(directory, ec);
+		}
+	}
+
+	std::span<const uint32_t> ShaderCompileCache::GetOrCompile(shaderc::Compiler& compiler, std::string_view src, shaderc_shader_kind kind, std::string_view name, const ShaderCompileSettings& settings)
+	{
+		const uint64_t key{ MakeCacheKey(src, kind, settings) };
+
+		{
+			std::scoped_lock lock{ mutex };
+
+			if (const auto it = entries.find(key); it != std::end(entries))
+			{
+				++statistics.memory_hits;
+				return it->second->spirv;
+			}
+
+			if (auto entry = LoadFromDisk(key))
+			{
+				++statistics.disk_hits;
+				return entries.emplace(key, std::move(entry)).first->second->spirv;
+			}
+		}
+
+		auto result = CompileShader(compiler, src, kind, name, settings);
+
+		std::scoped_lock lock{ mutex };
+		++statistics.compiles;
+		if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+			return {}; // failures aren't cached, the source is likely about to be fixed
+		}
+
+		// another thread may have compiled the same source in the meantime, entries are never replaced so spans handed out stay valid
+		if (const auto it = entries.find(key); it != std::end(entries)) {
+			return it->second->spirv;
+		}
+
+		auto entry = std::make_unique<Entry>();
+		entry->compilation_result.emplace(std::move(result));
+		entry->spirv = { entry->compilation_result->cbegin(), entry->compilation_result->cend() };
+		WriteToDisk(key, entry->spirv);
+
+		return entries.emplace(key, std::move(entry)).first->second->spirv;
+	}
+
+	ShaderCompileCache::Statistics ShaderCompileCache::GetStatistics() const
+	{
+		std::scoped_lock lock{ mutex };
+		return statistics;
+	}
+
+	std::filesystem::path ShaderCompileCache::GetCachePath(uint64_t key) const
+	{
+		std::ostringstream name;
+		name << std::hex << std::setfill('0') << std::setw(16) << key << ".spv";
+		return directory / name.str();
+	}
+
+	std::unique_ptr<ShaderCompileCache::Entry> ShaderCompileCache::LoadFromDisk(uint64_t key) const
+	{
+		if (directory.empty()) {
+			return nullptr;
+		}
+
+		Utility::MappedFile file{ GetCachePath(key) };
+		if (!file.IsOpen()) {
+			return nullptr;
+		}
+
+		const auto bytes{ file.GetData() };
+		if (!IsPlausibleSpirv(bytes))
+		{
+			std::cout << "Ignoring corrupt shader cache entry '" << GetCachePath(key).string() << "'\n";
+			return nullptr;
+		}
+
+		auto entry = std::make_unique<Entry>();
+		// mapped views are page aligned so reinterpreting as words is fine
+		entry->spirv = { reinterpret_cast<const uint32_t*>(bytes.data()), bytes.size() / sizeof(uint32_t) };
+		entry->mapped_file = std::move(file);
+		return entry;
+	}
+
+	void ShaderCompileCache::WriteToDisk(uint64_t key, std::span<const uint32_t> spirv) const
+	{
+		if (directory.empty()) {
+			return;
+		}
+
+		const auto path{ GetCachePath(key) };
+		auto temp_path{ path };
+		temp_path += ".tmp";
+
+		{
+			std::ofstream file{ temp_path, std::ios::binary | std::ios::trunc };
+			file.write(reinterpret_cast<const char*>(spirv.data()), static_cast<std::streamsize>(spirv.size_bytes()));
+			if (!file)
+			{
+				std::cerr << "Failed to write shader cache entry '" << temp_path.string() << "'\n";
+				return;
+			}
+		}
+
+		std::error_code ec{};
+		std::filesystem::rename(temp_path, path, ec);
+		if (ec) {
+			std::filesystem::remove(temp_path, ec);
+		}
+	}
+}
+
+#endif
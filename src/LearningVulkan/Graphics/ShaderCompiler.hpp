@@ -0,0 +1,76 @@
+#pragma once
+
+#ifdef RUNTIME_SHADER_COMPILATION
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "LearningVulkan/Bridges/shaderc.hpp"
+#include "LearningVulkan/Utility/MappedFile.hpp"
+
+namespace Graphics
+{
+	/// Everything besides the source and stage which affects the SPIR-V produced
+	struct ShaderCompileSettings
+	{
+		shaderc_optimization_level optimization{ shaderc_optimization_level_performance };
+		bool generate_debug_info{ false };
+		std::vector<std::pair<std::string, std::string>> definitions{};
+	};
+
+	/// Compiles GLSL with shaderc, reporting errors/warnings to the console. Check GetCompilationStatus() before using the result.
+	[[nodiscard]] shaderc::SpvCompilationResult CompileShader(shaderc::Compiler& compiler, std::string_view src, shaderc_shader_kind kind, std::string_view name, const ShaderCompileSettings& settings = {});
+
+	/// Content addressed cache in front of CompileShader().
+	/// Results are keyed on a hash of the source, stage, settings and compiler version. Lookups check memory, then the
+	/// on-disk directory (files are memory mapped, not read), and only then invoke shaderc.
+	/// Thread safe, compilation itself happens outside the lock so each thread can use its own compiler concurrently.
+	class ShaderCompileCache
+	{
+	public:
+		/// An empty directory keeps the cache in memory only.
+		explicit ShaderCompileCache(std::filesystem::path directory);
+
+		/// Returns the SPIR-V for the given source, or an empty span if it failed to compile.
+		/// The returned words stay valid for the lifetime of the cache and can be passed straight to vk::ShaderModuleCreateInfo.
+		[[nodiscard]] std::span<const uint32_t> GetOrCompile(shaderc::Compiler& compiler, std::string_view src, shaderc_shader_kind kind, std::string_view name, const ShaderCompileSettings& settings = {});
+
+		struct Statistics
+		{
+			std::size_t memory_hits{ 0 };
+			std::size_t disk_hits{ 0 };
+			std::size_t compiles{ 0 };
+		};
+
+		[[nodiscard]] Statistics GetStatistics() const;
+
+	private:
+		/// Backed by either a mapped cache file or the compilation result itself, no copies are made in either case.
+		struct Entry
+		{
+			Utility::MappedFile mapped_file{};
+			std::optional<shaderc::SpvCompilationResult> compilation_result{};
+			std::span<const uint32_t> spirv{};
+		};
+
+		[[nodiscard]] std::filesystem::path GetCachePath(uint64_t key) const;
+		[[nodiscard]] std::unique_ptr<Entry> LoadFromDisk(uint64_t key) const;
+		void WriteToDisk(uint64_t key, std::span<const uint32_t> spirv) const;
+
+		std::filesystem::path directory;
+		mutable std::mutex mutex;
+		std::unordered_map<uint64_t, std::unique_ptr<Entry>> entries;
+		Statistics statistics{};
+	};
+}
+
+#endif
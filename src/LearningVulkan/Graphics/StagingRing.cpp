@@ -0,0 +1,64 @@
+
+#include <cassert>
+
+#include "StagingRing.hpp"
+
+namespace Graphics
+{
+	StagingRing::StagingRing(vk::Device& device, MemoryAllocator& memory_allocator, vk::DeviceSize ring_capacity)
+		: allocator{ memory_allocator }
+		, capacity{ ring_capacity }
+	{
+		AllocationDesc desc{};
+		desc.required_flags = vk::MemoryPropertyFlagBits::eHostVisible;
+		desc.preferred_flags = vk::MemoryPropertyFlagBits::eHostCoherent;
+		buffer = CreateBuffer(device, allocator, capacity, vk::BufferUsageFlagBits::eTransferSrc, desc);
+		assert(buffer.memory.GetMappedData());
+	}
+
+	std::optional<StagingRing::Region> StagingRing::Allocate(vk::DeviceSize size, vk::DeviceSize alignment)
+	{
+		if (size == 0 || size > capacity) {
+			return std::nullopt;
+		}
+
+		auto begin{ (head + alignment - 1) / alignment * alignment };
+		// Regions never straddle the end of the buffer, skip to the start instead
+		if (begin % capacity + size > capacity) {
+			begin += capacity - begin % capacity;
+		}
+		if (begin + size - tail > capacity) {
+			return std::nullopt;
+		}
+
+		head = begin + size;
+		const auto offset{ begin % capacity };
+		return Region{ *buffer.buffer, offset, std::span{ buffer.memory.GetMappedData() + offset, static_cast<std::size_t>(size) } };
+	}
+
+	void StagingRing::MarkFrame(uint64_t frame_number)
+	{
+		if (marks.empty() || marks.back().head != head) {
+			marks.push_back(FrameMark{ frame_number, head });
+		}
+	}
+
+	void StagingRing::Release(uint64_t completed_frame)
+	{
+		while (!marks.empty() && marks.front().frame <= completed_frame)
+		{
+			tail = marks.front().head;
+			marks.pop_front();
+		}
+	}
+
+	void StagingRing::Flush()
+	{
+		// Flushing the whole allocation is simplest, only non-coherent memory (rare for host visible heaps) does any work here
+		if (flushed != head)
+		{
+			allocator.Flush(buffer.memory);
+			flushed = head;
+		}
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <span>
+
+#include "LearningVulkan/Bridges/vulkan.hpp"
+#include "LearningVulkan/Graphics/Buffer.hpp"
+
+namespace Graphics
+{
+	/// Persistently mapped, host visible buffer handed out front to back and wrapping around.
+	/// Space is fenced by frame number: everything allocated before MarkFrame(N) is reused once Release() is told frame N has completed.
+	class StagingRing
+	{
+	public:
+		struct Region
+		{
+			vk::Buffer buffer{};
+			vk::DeviceSize offset{ 0 }; // into buffer
+			std::span<std::byte> data{}; // mapped
+		};
+
+		StagingRing(vk::Device& device, MemoryAllocator& allocator, vk::DeviceSize capacity);
+
+		/// Contiguous space for size bytes, or nothing when the ring is full until some frame completes.
+		[[nodiscard]] std::optional<Region> Allocate(vk::DeviceSize size, vk::DeviceSize alignment = 16);
+		/// Everything allocated since the last mark belongs to frame_number
+		void MarkFrame(uint64_t frame_number);
+		/// Frees the space of frames up to and including completed_frame
+		void Release(uint64_t completed_frame);
+		/// Makes everything written since the last flush visible to the device, no-op for coherent memory
+		void Flush();
+
+		[[nodiscard]] vk::Buffer GetBuffer() const noexcept { return *buffer.buffer; }
+		[[nodiscard]] vk::DeviceSize GetCapacity() const noexcept { return capacity; }
+		[[nodiscard]] vk::DeviceSize GetUsedBytes() const noexcept { return head - tail; }
+
+	private:
+		struct FrameMark
+		{
+			uint64_t frame{ 0 };
+			vk::DeviceSize head{ 0 };
+		};
+
+		MemoryAllocator& allocator;
+		Buffer buffer{};
+		vk::DeviceSize capacity{ 0 };
+		// head and tail only ever go up, the position in the buffer is modulo capacity
+		vk::DeviceSize head{ 0 };
+		vk::DeviceSize tail{ 0 };
+		vk::DeviceSize flushed{ 0 };
+		std::deque<FrameMark> marks{};
+	};
+}
@@ -0,0 +1,72 @@
+
+#include <algorithm>
+#include <cassert>
+
+#include "UniformRing.hpp"
+
+namespace Graphics
+{
+	UniformRing::UniformRing(vk::Device& device, vk::PhysicalDevice physical_device, MemoryAllocator& memory_allocator, uint32_t frames_in_flight, vk::DeviceSize bytes_per_frame,
+		vk::DeviceSize max_binding_size, vk::ShaderStageFlags stages)
+		: allocator{ memory_allocator }
+	{
+		const auto limits{ physical_device.getProperties().limits };
+		alignment = std::max<vk::DeviceSize>(limits.minUniformBufferOffsetAlignment, 1);
+		binding_size = std::min<vk::DeviceSize>(max_binding_size, limits.maxUniformBufferRange);
+		slice_size = (std::max(bytes_per_frame, binding_size) + alignment - 1) / alignment * alignment;
+
+		// The descriptor's range has to stay inside the buffer at any dynamic offset, so the last slice gets a binding's worth of slack
+		AllocationDesc desc{};
+		desc.required_flags = vk::MemoryPropertyFlagBits::eHostVisible;
+		desc.preferred_flags = vk::MemoryPropertyFlagBits::eHostCoherent;
+		buffer = CreateBuffer(device, allocator, slice_size * frames_in_flight + binding_size, vk::BufferUsageFlagBits::eUniformBuffer, desc);
+		assert(buffer.memory.GetMappedData());
+
+		const vk::DescriptorSetLayoutBinding binding{ 0, vk::DescriptorType::eUniformBufferDynamic, 1, stages };
+		layout = device.createDescriptorSetLayoutUnique(vk::DescriptorSetLayoutCreateInfo{}.setBindings(binding));
+
+		const vk::DescriptorPoolSize pool_size{ vk::DescriptorType::eUniformBufferDynamic, 1 };
+		pool = device.createDescriptorPoolUnique(vk::DescriptorPoolCreateInfo{}
+			.setMaxSets(1)
+			.setPoolSizes(pool_size)
+		);
+		set = device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo{}
+			.setDescriptorPool(*pool)
+			.setSetLayouts(*layout)
+		).front();
+
+		// Written once, only the dynamic offsets change from then on
+		const vk::DescriptorBufferInfo buffer_info{ *buffer.buffer, 0, binding_size };
+		device.updateDescriptorSets(vk::WriteDescriptorSet{}
+			.setDstSet(set)
+			.setDstBinding(0)
+			.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
+			.setBufferInfo(buffer_info), {});
+	}
+
+	void UniformRing::BeginFrame(uint32_t frame_index)
+	{
+		slice_begin = slice_size * frame_index;
+		assert(slice_begin + slice_size + binding_size <= buffer.size);
+		head = slice_begin;
+	}
+
+	std::optional<UniformRing::Region> UniformRing::Allocate(vk::DeviceSize size)
+	{
+		const auto begin{ (head + alignment - 1) / alignment * alignment };
+		if (size == 0 || size > binding_size || begin + size > slice_begin + slice_size) {
+			return std::nullopt;
+		}
+
+		head = begin + size;
+		return Region{ static_cast<uint32_t>(begin), std::span{ buffer.memory.GetMappedData() + begin, static_cast<std::size_t>(size) } };
+	}
+
+	void UniformRing::Flush()
+	{
+		// Whole allocation like the staging ring, only non-coherent memory does any work here
+		if (head != slice_begin) {
+			allocator.Flush(buffer.memory);
+		}
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <type_traits>
+
+#include "LearningVulkan/Bridges/vulkan.hpp"
+#include "LearningVulkan/Graphics/Buffer.hpp"
+
+namespace Graphics
+{
+	/// Persistently mapped uniform buffer with a slice per frame in flight, all of it bound through a single dynamic uniform buffer descriptor.
+	/// Each frame's constants are written into its slice and draws are handed dynamic offsets into it, so no descriptor set is allocated or
+	/// updated per frame. Allocations go front to back through the slice and start over when the frame comes round again.
+	class UniformRing
+	{
+	public:
+		struct Region
+		{
+			uint32_t dynamic_offset{ 0 }; // for vkCmdBindDescriptorSets
+			std::span<std::byte> data{}; // mapped
+		};
+
+		/// max_binding_size is the most a shader reads through the descriptor, i.e. the largest single allocation. Clamped to maxUniformBufferRange.
+		UniformRing(vk::Device& device, vk::PhysicalDevice physical_device, MemoryAllocator& allocator, uint32_t frames_in_flight, vk::DeviceSize bytes_per_frame,
+			vk::DeviceSize max_binding_size = 256, vk::ShaderStageFlags stages = vk::ShaderStageFlagBits::eAllGraphics | vk::ShaderStageFlagBits::eCompute);
+
+		/// Starts handing out the frame's slice from the top again. Only call once the GPU has finished the previous frame that used frame_index.
+		void BeginFrame(uint32_t frame_index);
+
+		/// Space for size bytes in the current frame's slice, nothing when it is full or size is over the binding size
+		[[nodiscard]] std::optional<Region> Allocate(vk::DeviceSize size);
+		/// Copies data into the current frame's slice and returns its dynamic offset
+		template<typename T>
+		[[nodiscard]] std::optional<uint32_t> Push(const T& data)
+		{
+			static_assert(std::is_trivially_copyable_v<T>);
+			const auto region{ Allocate(sizeof(T)) };
+			if (!region) {
+				return std::nullopt;
+			}
+			std::memcpy(region->data.data(), &data, sizeof(T));
+			return region->dynamic_offset;
+		}
+
+		/// Makes the frame's writes visible to the device, no-op for coherent memory. Call before submitting.
+		void Flush();
+
+		[[nodiscard]] vk::DescriptorSetLayout GetLayout() const noexcept { return *layout; }
+		[[nodiscard]] vk::DescriptorSet GetSet() const noexcept { return set; }
+		[[nodiscard]] vk::DeviceSize GetBytesPerFrame() const noexcept { return slice_size; }
+		/// Bytes handed out since BeginFrame(), alignment padding included
+		[[nodiscard]] vk::DeviceSize GetFrameBytes() const noexcept { return head - slice_begin; }
+
+	private:
+		MemoryAllocator& allocator;
+		Buffer buffer{};
+		vk::UniqueDescriptorSetLayout layout{};
+		vk::UniqueDescriptorPool pool{};
+		vk::DescriptorSet set{}; // freed with the pool
+		vk::DeviceSize alignment{ 1 }; // minUniformBufferOffsetAlignment
+		vk::DeviceSize binding_size{ 0 };
+		vk::DeviceSize slice_size{ 0 };
+		vk::DeviceSize slice_begin{ 0 };
+		vk::DeviceSize head{ 0 };
+	};
+}
@@ -0,0 +1,198 @@
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "LearningVulkan/Profiling/GpuProfiler.hpp"
+
+#include "UploadQueue.hpp"
+
+namespace
+{
+	/// Everything that may read a buffer we upload into
+	constexpr vk::PipelineStageFlags consumer_stages{ vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eVertexShader
+		| vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader };
+	constexpr vk::AccessFlags consumer_access{ vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead
+		| vk::AccessFlagBits::eUniformRead | vk::AccessFlagBits::eShaderRead };
+}
+
+namespace Graphics
+{
+	UploadQueue::UploadQueue(vk::Device& logical_device, MemoryAllocator& allocator, vk::Queue queue, uint32_t transfer_family_index, uint32_t graphics_family_index, uint32_t frames_in_flight, vk::DeviceSize staging_size)
+		: device{ logical_device }
+		, transfer_queue{ queue }
+		, transfer_family{ transfer_family_index }
+		, graphics_family{ graphics_family_index }
+		, staging{ logical_device, allocator, staging_size }
+		, graphics_pools{ logical_device, graphics_family_index, frames_in_flight }
+	{
+		if (transfer_family != graphics_family)
+		{
+			transfer_pools = std::make_unique<FrameCommandPools>(device, transfer_family, frames_in_flight);
+
+			const auto timeline_info{ vk::SemaphoreTypeCreateInfo{}.setSemaphoreType(vk::SemaphoreType::eTimeline).setInitialValue(0) };
+			transfer_timeline = device.createSemaphoreUnique(vk::SemaphoreCreateInfo{}.setPNext(&timeline_info));
+		}
+	}
+
+	bool UploadQueue::Upload(vk::Buffer destination, vk::DeviceSize destination_offset, std::span<const std::byte> data)
+	{
+		if (data.empty()) {
+			return true;
+		}
+
+		const auto staging_data{ BeginUpload(destination, destination_offset, data.size()) };
+		if (staging_data.empty()) {
+			return false;
+		}
+
+		std::memcpy(staging_data.data(), data.data(), data.size());
+		return true;
+	}
+
+	std::span<std::byte> UploadQueue::BeginUpload(vk::Buffer destination, vk::DeviceSize destination_offset, vk::DeviceSize size)
+	{
+		if (size > staging.GetCapacity()) {
+			throw std::runtime_error("Upload of " + std::to_string(size) + " bytes is bigger than the whole staging ring");
+		}
+
+		const auto region{ staging.Allocate(size) };
+		if (!region)
+		{
+			++stats.ring_full;
+			return {};
+		}
+
+		copies.push_back(PendingCopy{ destination, vk::BufferCopy{ region->offset, destination_offset, size } });
+
+		++stats.uploads;
+		stats.bytes += size;
+		return region->data;
+	}
+
+	UploadQueue::FrameUploads UploadQueue::Submit(uint32_t frame_index, uint64_t frame_number)
+	{
+		if (copies.empty()) {
+			return {};
+		}
+
+		staging.Flush();
+		staging.MarkFrame(frame_number);
+
+		// One vkCmdCopyBuffer per destination, with all of its regions
+		std::stable_sort(std::begin(copies), std::end(copies), [](const PendingCopy& lhs, const PendingCopy& rhs) { return lhs.destination < rhs.destination; });
+
+		graphics_pools.Reset(frame_index);
+		auto graphics_cmd{ graphics_pools.Allocate(frame_index) };
+		graphics_cmd.begin(vk::CommandBufferBeginInfo{}.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+		FrameUploads uploads{};
+		uploads.command_buffer = graphics_cmd;
+
+		if (!transfer_pools)
+		{
+			// Earlier frames on the same queue may still be reading what we are about to overwrite
+			graphics_cmd.pipelineBarrier(consumer_stages, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, {});
+			RecordCopies(graphics_cmd);
+			graphics_cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, consumer_stages, {},
+				vk::MemoryBarrier{}
+				.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+				.setDstAccessMask(consumer_access),
+				{}, {}
+			);
+		}
+		else
+		{
+			// Exclusive buffers change hands with a matching release on the transfer queue and acquire on the graphics queue
+			std::vector<vk::BufferMemoryBarrier> releases{};
+			std::vector<vk::BufferMemoryBarrier> acquires{};
+			releases.reserve(copies.size());
+			acquires.reserve(copies.size());
+			for (const auto& copy : copies)
+			{
+				const auto barrier{ vk::BufferMemoryBarrier{}
+					.setSrcQueueFamilyIndex(transfer_family)
+					.setDstQueueFamilyIndex(graphics_family)
+					.setBuffer(copy.destination)
+					.setOffset(copy.region.dstOffset)
+					.setSize(copy.region.size)
+				};
+				releases.push_back(vk::BufferMemoryBarrier{ barrier }.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite));
+				acquires.push_back(vk::BufferMemoryBarrier{ barrier }.setDstAccessMask(consumer_access));
+			}
+
+			transfer_pools->Reset(frame_index);
+			auto transfer_cmd{ transfer_pools->Allocate(frame_index) };
+			transfer_cmd.begin(vk::CommandBufferBeginInfo{}.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+			if (profiler) {
+				profiler->RecordBegin(transfer_cmd, frame_index);
+			}
+			RecordCopies(transfer_cmd);
+			transfer_cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, releases, {});
+			if (profiler) {
+				profiler->RecordEnd(transfer_cmd, frame_index);
+			}
+			transfer_cmd.end();
+
+			++transfer_value;
+			const auto timeline_info{ vk::TimelineSemaphoreSubmitInfo{}.setSignalSemaphoreValues(transfer_value) };
+			transfer_queue.submit(vk::SubmitInfo{}
+				.setCommandBuffers(transfer_cmd)
+				.setSignalSemaphores(*transfer_timeline)
+				.setPNext(&timeline_info)
+			);
+			if (profiler) {
+				profiler->OnSubmitted(frame_index);
+			}
+
+			// The semaphore wait covers the consumer stages, the acquire starts from the same stages so the two chain together
+			graphics_cmd.pipelineBarrier(consumer_stages, consumer_stages, {}, {}, acquires, {});
+
+			uploads.wait_semaphore = *transfer_timeline;
+			uploads.wait_value = transfer_value;
+			uploads.wait_stages = consumer_stages;
+		}
+
+		graphics_cmd.end();
+		copies.clear();
+		return uploads;
+	}
+
+	bool UploadQueue::IsComplete(const FrameUploads& uploads) const
+	{
+		return !uploads.wait_semaphore || device.getSemaphoreCounterValue(uploads.wait_semaphore) >= uploads.wait_value;
+	}
+
+	void UploadQueue::RecordCopies(vk::CommandBuffer& cmd)
+	{
+		// Regions of one copy must not overlap, so when the same range was uploaded twice the copy is split there with a barrier in between,
+		// which keeps the later upload on top.
+		std::vector<vk::BufferCopy> regions{};
+		const auto overlaps = [&regions](const vk::BufferCopy& region)
+		{
+			return std::any_of(std::begin(regions), std::end(regions), [&region](const vk::BufferCopy& other)
+				{
+					return region.dstOffset < other.dstOffset + other.size && other.dstOffset < region.dstOffset + region.size;
+				});
+		};
+
+		for (auto it{ std::begin(copies) }; it != std::end(copies); )
+		{
+			const auto destination{ it->destination };
+			regions.clear();
+			for (; it != std::end(copies) && it->destination == destination; ++it)
+			{
+				if (overlaps(it->region))
+				{
+					cmd.copyBuffer(staging.GetBuffer(), destination, regions);
+					cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {},
+						vk::MemoryBarrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eTransferWrite }, {}, {});
+					regions.clear();
+				}
+				regions.push_back(it->region);
+			}
+			cmd.copyBuffer(staging.GetBuffer(), destination, regions);
+		}
+	}
+}
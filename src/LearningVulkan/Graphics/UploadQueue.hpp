@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "LearningVulkan/Bridges/vulkan.hpp"
+#include "LearningVulkan/Graphics/FrameCommandPools.hpp"
+#include "LearningVulkan/Graphics/StagingRing.hpp"
+
+namespace Profiling
+{
+	class GpuProfiler;
+}
+
+namespace Graphics
+{
+	/// Streams data into device local buffers. Upload() copies into the staging ring straight away and queues a buffer copy,
+	/// Submit() then puts every copy queued since the last frame into one command buffer so each frame has a single transfer submission.
+	/// With a transfer queue of its own family the copies run there, overlapping the graphics queue, and ownership of the written ranges
+	/// is handed over to the graphics family with release/acquire barriers.
+	class UploadQueue
+	{
+	public:
+		struct Stats
+		{
+			std::size_t uploads{ 0 };
+			vk::DeviceSize bytes{ 0 };
+			std::size_t ring_full{ 0 }; // uploads refused because the staging ring was full
+		};
+
+		/// What the frame's graphics submission needs to include for the uploads to be visible to it
+		struct FrameUploads
+		{
+			vk::CommandBuffer command_buffer{}; // goes ahead of the frame's commands: the copies themselves, or the acquire barriers when they ran on the transfer queue
+			vk::Semaphore wait_semaphore{}; // timeline signalled by the transfer submission, null when there was none
+			uint64_t wait_value{ 0 };
+			vk::PipelineStageFlags wait_stages{};
+		};
+
+		/// transfer_queue may be the graphics queue itself, in which case everything is recorded for the graphics queue.
+		UploadQueue(vk::Device& device, MemoryAllocator& allocator, vk::Queue transfer_queue, uint32_t transfer_family, uint32_t graphics_family, uint32_t frames_in_flight, vk::DeviceSize staging_size);
+
+		/// Returns false without queuing anything when the staging ring has no room until an earlier frame completes, the caller should try again next frame.
+		/// On a separate transfer queue nothing orders the copy after earlier frames, so the destination range must not be read by frames still in flight.
+		[[nodiscard]] bool Upload(vk::Buffer destination, vk::DeviceSize destination_offset, std::span<const std::byte> data);
+		template<typename T>
+		[[nodiscard]] bool Upload(vk::Buffer destination, vk::DeviceSize destination_offset, std::span<const T> data)
+		{
+			return Upload(destination, destination_offset, std::as_bytes(data));
+		}
+		/// Like Upload() but hands out the staging memory to be filled in place, saving a copy for data generated every frame.
+		/// It must be written before the next Submit(). Empty when the ring is full.
+		[[nodiscard]] std::span<std::byte> BeginUpload(vk::Buffer destination, vk::DeviceSize destination_offset, vk::DeviceSize size);
+
+		[[nodiscard]] bool HasPendingCopies() const noexcept { return !copies.empty(); }
+		[[nodiscard]] bool UsesTransferQueue() const noexcept { return static_cast<bool>(transfer_pools); }
+
+		/// Records all pending copies, submitting them to the transfer queue if there is a separate one. The staging space is reused once
+		/// frame_number has completed, so the returned command buffer and wait must be part of that frame's submission. Empty if nothing was pending.
+		/// Copies are made visible to any later vertex/index/indirect/shader read on the graphics queue.
+		[[nodiscard]] FrameUploads Submit(uint32_t frame_index, uint64_t frame_number);
+		/// Whether the transfer queue has finished the copies behind uploads, which is always the case when there was no transfer submission.
+		/// Checked right before the graphics submission it tells whether that submission will have to wait on the copies.
+		[[nodiscard]] bool IsComplete(const FrameUploads& uploads) const;
+		/// Call at the start of each frame
+		void Collect(uint64_t completed_frame) { staging.Release(completed_frame); }
+
+		/// Brackets transfer queue submissions with the profiler's timestamps, slot is the frame index. Only used with a separate transfer queue.
+		void SetProfiler(Profiling::GpuProfiler* transfer_profiler) noexcept { profiler = transfer_profiler; }
+
+		[[nodiscard]] const Stats& GetStats() const noexcept { return stats; }
+
+	private:
+		struct PendingCopy
+		{
+			vk::Buffer destination{};
+			vk::BufferCopy region{};
+		};
+
+		void RecordCopies(vk::CommandBuffer& cmd);
+
+		vk::Device& device;
+		vk::Queue transfer_queue;
+		uint32_t transfer_family;
+		uint32_t graphics_family;
+		StagingRing staging;
+		FrameCommandPools graphics_pools;
+		std::unique_ptr<FrameCommandPools> transfer_pools{}; // only with a separate transfer family
+		vk::UniqueSemaphore transfer_timeline{};
+		uint64_t transfer_value{ 0 };
+		Profiling::GpuProfiler* profiler{ nullptr };
+		std::vector<PendingCopy> copies{};
+		Stats stats{};
+	};
+}
@@ -0,0 +1,265 @@
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "Benchmark.hpp"
+
+namespace
+{
+	void WriteJsonString(std::ostream& out, std::string_view str)
+	{
+		out << '"';
+		for (const char c : str)
+		{
+			switch (c)
+			{
+			case '"': out << "\\\""; break;
+			case '\\': out << "\\\\"; break;
+			case '\n': out << "\\n"; break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20) {
+					out << ' ';
+				}
+				else {
+					out << c;
+				}
+			}
+		}
+		out << '"';
+	}
+
+	constexpr std::string_view metric_names[]{ "frame_ms", "fence_wait_ms", "acquire_ms", "submit_ms", "present_ms", "upload_ms" };
+
+	[[nodiscard]] auto GetMetrics(const Profiling::Benchmark::Report& report)
+	{
+		return std::array{ &report.frame_ms, &report.fence_wait_ms, &report.acquire_ms, &report.submit_ms, &report.present_ms, &report.upload_ms };
+	}
+}
+
+namespace Profiling
+{
+	Benchmark::Benchmark(BenchmarkInfo benchmark_info, std::size_t measured_frames)
+		: info{ std::move(benchmark_info) }
+		, frame_ms{ measured_frames }
+		, fence_wait_ms{ measured_frames }
+		, acquire_ms{ measured_frames }
+		, submit_ms{ measured_frames }
+		, present_ms{ measured_frames }
+		, upload_ms{ measured_frames }
+		, transfer_overlap_ms{ measured_frames }
+	{
+	}
+
+	void Benchmark::Start()
+	{
+		start_time = Clock::now();
+		stop_time = start_time;
+	}
+
+	void Benchmark::Stop()
+	{
+		stop_time = Clock::now();
+	}
+
+	void Benchmark::AddFrame(const FrameTimings& timings)
+	{
+		frame_ms.Add(timings.frame_ms);
+		fence_wait_ms.Add(timings.fence_wait_ms);
+		acquire_ms.Add(timings.acquire_ms);
+		submit_ms.Add(timings.submit_ms);
+		present_ms.Add(timings.present_ms);
+		upload_ms.Add(timings.upload_ms);
+		uniform_bytes += timings.uniform_bytes;
+		if (timings.transfer_submitted)
+		{
+			++transfer_frames;
+			if (timings.transfer_ready) {
+				++transfer_ready_frames;
+			}
+		}
+		if (timings.transfer_overlap_ms) {
+			transfer_overlap_ms.Add(*timings.transfer_overlap_ms);
+		}
+	}
+
+	Benchmark::Report Benchmark::GetReport() const
+	{
+		Report report{};
+		report.info = info;
+		report.frame_count = frame_ms.GetCount();
+		report.wall_ms = std::chrono::duration<double, std::milli>{ stop_time - start_time }.count();
+		report.frames_per_second = report.wall_ms > 0. ? static_cast<double>(report.frame_count) * 1000. / report.wall_ms : 0.;
+		report.frame_ms = frame_ms.Summarise();
+		report.fence_wait_ms = fence_wait_ms.Summarise();
+		report.acquire_ms = acquire_ms.Summarise();
+		report.submit_ms = submit_ms.Summarise();
+		report.present_ms = present_ms.Summarise();
+		report.upload_ms = upload_ms.Summarise();
+		report.transfer_overlap_ms = transfer_overlap_ms.Summarise();
+
+		const double instances_per_frame{ static_cast<double>(info.draw_count) * static_cast<double>(info.instance_count) };
+		report.vertices_per_second = report.frames_per_second * instances_per_frame * static_cast<double>(info.vertices_per_instance);
+		report.upload_ns_per_instance = instances_per_frame > 0. ? report.upload_ms.p50 * 1'000'000. / instances_per_frame : 0.;
+		report.uniform_bytes_per_frame = report.frame_count > 0 ? static_cast<double>(uniform_bytes) / static_cast<double>(report.frame_count) : 0.;
+		report.transfer_frames = transfer_frames;
+		report.transfer_ready_percent = transfer_frames > 0 ? 100. * static_cast<double>(transfer_ready_frames) / static_cast<double>(transfer_frames) : 0.;
+		return report;
+	}
+
+	void Benchmark::PrintReport(std::ostream& out, const Report& report)
+	{
+		out << "Benchmark: " << report.frame_count << " frames (after " << report.info.warmup_frames << " warm-up) at "
+			<< report.info.width << 'x' << report.info.height << ", " << report.info.draw_count << " draws of " << report.info.instance_count << " instances"
+			<< ", recorded " << (report.info.recording_threads > 0 ? "on " + std::to_string(report.info.recording_threads) + " threads" : std::string{ "inline" })
+			<< (report.info.gpu_culling ? ", GPU culled" : "")
+			<< (report.info.bindless ? ", bindless" : "")
+			<< (report.info.dynamic_rendering ? ", dynamic rendering" : "");
+		if (report.info.render_scale != 1.f) {
+			out << ", render scale " << report.info.render_scale;
+		}
+		out << (report.info.headless ? ", headless" : "") << " on " << report.info.device_name << '\n';
+		out << "  " << report.wall_ms << "ms wall, " << report.frames_per_second << " frames/s, " << report.vertices_per_second / 1'000'000. << "M vertices/s, "
+			<< report.upload_ns_per_instance << "ns upload per instance, " << report.uniform_bytes_per_frame << " uniform bytes per frame\n";
+
+		const auto metrics{ GetMetrics(report) };
+		for (std::size_t i{ 0 }; i < metrics.size(); ++i)
+		{
+			const auto& summary{ *metrics[i] };
+			out << "  " << metric_names[i] << ": p50 " << summary.p50 << ", p95 " << summary.p95 << ", p99 " << summary.p99
+				<< " (min " << summary.min << ", mean " << summary.mean << ", max " << summary.max << ")\n";
+		}
+
+		if (report.transfer_frames > 0) {
+			out << "  transfer queue: " << report.transfer_frames << " frames uploaded, " << report.transfer_ready_percent << "% finished before the graphics submission\n";
+		}
+		if (const auto& overlap{ report.transfer_overlap_ms }; overlap.count > 0)
+		{
+			out << "  transfer_overlap_ms: p50 " << overlap.p50 << ", p95 " << overlap.p95 << ", p99 " << overlap.p99
+				<< " (min " << overlap.min << ", mean " << overlap.mean << ", max " << overlap.max << ")\n";
+		}
+	}
+
+	void Benchmark::WriteJson(std::ostream& out, const Report& report)
+	{
+		out << "{\"device\":"; WriteJsonString(out, report.info.device_name);
+		out << ",\"driver_version\":" << report.info.driver_version
+			<< ",\"api_version\":" << report.info.api_version
+			<< ",\"headless\":" << (report.info.headless ? "true" : "false")
+			<< ",\"width\":" << report.info.width
+			<< ",\"height\":" << report.info.height
+			<< ",\"instances\":" << report.info.instance_count
+			<< ",\"draws\":" << report.info.draw_count
+			<< ",\"recording_threads\":" << report.info.recording_threads
+			<< ",\"gpu_culling\":" << (report.info.gpu_culling ? "true" : "false")
+			<< ",\"bindless\":" << (report.info.bindless ? "true" : "false")
+			<< ",\"dynamic_rendering\":" << (report.info.dynamic_rendering ? "true" : "false")
+			<< ",\"render_scale\":" << report.info.render_scale
+			<< ",\"warmup_frames\":" << report.info.warmup_frames
+			<< ",\"frames\":" << report.frame_count
+			<< ",\"wall_ms\":" << report.wall_ms
+			<< ",\"frames_per_second\":" << report.frames_per_second
+			<< ",\"vertices_per_second\":" << report.vertices_per_second
+			<< ",\"upload_ns_per_instance\":" << report.upload_ns_per_instance
+			<< ",\"uniform_bytes_per_frame\":" << report.uniform_bytes_per_frame
+			<< ",\"transfer_frames\":" << report.transfer_frames
+			<< ",\"transfer_ready_percent\":" << report.transfer_ready_percent;
+
+		const auto metrics{ GetMetrics(report) };
+		for (std::size_t i{ 0 }; i < metrics.size(); ++i)
+		{
+			out << ",\"" << metric_names[i] << "\":";
+			Profiling::WriteJson(out, *metrics[i]);
+		}
+		if (report.transfer_overlap_ms.count > 0) {
+			out << ",\"transfer_overlap_ms\":"; Profiling::WriteJson(out, report.transfer_overlap_ms);
+		}
+		out << '}';
+	}
+
+	void Benchmark::WriteCsvHeader(std::ostream& out)
+	{
+		out << "device,driver_version,api_version,headless,width,height,instances,draws,recording_threads,gpu_culling,bindless,dynamic_rendering,render_scale,warmup_frames,frames,wall_ms,frames_per_second,vertices_per_second,upload_ns_per_instance,uniform_bytes_per_frame,transfer_frames,transfer_ready_percent,transfer_overlap_ms_p50,transfer_overlap_ms_mean";
+		for (const auto name : metric_names) {
+			out << ',' << name << "_p50," << name << "_p95," << name << "_p99," << name << "_mean," << name << "_max";
+		}
+		out << '\n';
+	}
+
+	void Benchmark::WriteCsvRow(std::ostream& out, const Report& report)
+	{
+		std::string device_name{ report.info.device_name };
+		std::replace(std::begin(device_name), std::end(device_name), ',', ' ');
+
+		out << device_name << ','
+			<< report.info.driver_version << ','
+			<< report.info.api_version << ','
+			<< (report.info.headless ? 1 : 0) << ','
+			<< report.info.width << ','
+			<< report.info.height << ','
+			<< report.info.instance_count << ','
+			<< report.info.draw_count << ','
+			<< report.info.recording_threads << ','
+			<< (report.info.gpu_culling ? 1 : 0) << ','
+			<< (report.info.bindless ? 1 : 0) << ','
+			<< (report.info.dynamic_rendering ? 1 : 0) << ','
+			<< report.info.render_scale << ','
+			<< report.info.warmup_frames << ','
+			<< report.frame_count << ','
+			<< report.wall_ms << ','
+			<< report.frames_per_second << ','
+			<< report.vertices_per_second << ','
+			<< report.upload_ns_per_instance << ','
+			<< report.uniform_bytes_per_frame << ','
+			<< report.transfer_frames << ','
+			<< report.transfer_ready_percent << ','
+			<< report.transfer_overlap_ms.p50 << ','
+			<< report.transfer_overlap_ms.mean;
+		for (const auto* summary : GetMetrics(report)) {
+			out << ',' << summary->p50 << ',' << summary->p95 << ',' << summary->p99 << ',' << summary->mean << ',' << summary->max;
+		}
+		out << '\n';
+	}
+
+	bool Benchmark::WriteReportFile(const std::filesystem::path& path, std::span<const Report> reports)
+	{
+		std::error_code ec{};
+		if (path.has_parent_path()) {
+			std::filesystem::create_directories(path.parent_path(), ec);
+		}
+
+		if (path.extension() == ".csv")
+		{
+			const bool write_header{ !std::filesystem::exists(path, ec) || std::filesystem::file_size(path, ec) == 0 };
+			std::ofstream file{ path, std::ios::out | std::ios::app };
+			if (write_header) {
+				WriteCsvHeader(file);
+			}
+			for (const auto& report : reports) {
+				WriteCsvRow(file, report);
+			}
+			return static_cast<bool>(file);
+		}
+
+		std::ofstream file{ path, std::ios::out | std::ios::trunc };
+		if (reports.size() == 1) {
+			WriteJson(file, reports.front());
+		}
+		else
+		{
+			file << '[';
+			for (std::size_t idx{ 0 }; idx < reports.size(); ++idx)
+			{
+				file << (idx > 0 ? ",\n" : "\n");
+				WriteJson(file, reports[idx]);
+			}
+			file << "\n]";
+		}
+		file << '\n';
+		return static_cast<bool>(file);
+	}
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iosfwd>
+#include <optional>
+#include <span>
+#include <string>
+
+#include "RollingSamples.hpp"
+
+namespace Profiling
+{
+	/// CPU side timings of a single frame, zero for the parts a frame didn't do (e.g. acquire/present when headless)
+	struct FrameTimings
+	{
+		double frame_ms{ 0. };
+		double fence_wait_ms{ 0. }; // time blocked waiting for the GPU to finish earlier frames
+		double acquire_ms{ 0. };
+		double submit_ms{ 0. };
+		double present_ms{ 0. };
+		double upload_ms{ 0. }; // generating and queuing per-frame data such as instance attributes
+		uint64_t uniform_bytes{ 0 }; // written to the uniform ring
+		bool transfer_submitted{ false }; // uploads went to the dedicated transfer queue
+		bool transfer_ready{ false }; // and had finished by the graphics submission, so it didn't have to wait on them
+		std::optional<double> transfer_overlap_ms{}; // how long an earlier frame's uploads ran alongside graphics work, with --profile and VK_EXT_calibrated_timestamps
+	};
+
+	/// Describes what was benchmarked, written alongside the results so runs can be compared
+	struct BenchmarkInfo
+	{
+		std::string device_name{};
+		uint32_t driver_version{ 0 };
+		uint32_t api_version{ 0 };
+		bool headless{ false };
+		uint32_t width{ 0 };
+		uint32_t height{ 0 };
+		uint32_t instance_count{ 1 };
+		uint32_t draw_count{ 1 };
+		uint32_t vertices_per_instance{ 0 };
+		std::size_t recording_threads{ 0 }; // threads recording secondary command buffers, 0 when recorded inline on the main thread
+		bool gpu_culling{ false }; // draws built by a compute pass rather than recorded one by one
+		bool bindless{ false }; // instances read through the bindless descriptor heap rather than vertex attributes
+		bool dynamic_rendering{ false }; // VK_KHR_dynamic_rendering rather than a render pass and framebuffers
+		float render_scale{ 1.f }; // drawn at this fraction of width x height and blitted over
+		std::size_t warmup_frames{ 0 };
+	};
+
+	/// Collects every frame of a fixed length run and writes a report with percentiles and throughput.
+	class Benchmark
+	{
+	public:
+		Benchmark(BenchmarkInfo info, std::size_t measured_frames);
+
+		/// Brackets the measured frames, Stop() should come after waiting for the GPU to go idle so throughput includes the last frames.
+		void Start();
+		void Stop();
+
+		void AddFrame(const FrameTimings& timings);
+
+		struct Report
+		{
+			BenchmarkInfo info{};
+			std::size_t frame_count{ 0 };
+			double wall_ms{ 0. };
+			double frames_per_second{ 0. };
+			double vertices_per_second{ 0. };
+			double upload_ns_per_instance{ 0. }; // median upload_ms spread over every instance drawn in a frame
+			double uniform_bytes_per_frame{ 0. }; // mean
+			std::size_t transfer_frames{ 0 }; // frames that submitted uploads to the dedicated transfer queue
+			double transfer_ready_percent{ 0. }; // of those, how many had finished by the graphics submission
+			RollingSamples::Summary frame_ms{};
+			RollingSamples::Summary fence_wait_ms{};
+			RollingSamples::Summary acquire_ms{};
+			RollingSamples::Summary submit_ms{};
+			RollingSamples::Summary present_ms{};
+			RollingSamples::Summary upload_ms{};
+			RollingSamples::Summary transfer_overlap_ms{}; // no samples unless measured
+		};
+
+		[[nodiscard]] Report GetReport() const;
+
+		static void PrintReport(std::ostream& out, const Report& report);
+		static void WriteJson(std::ostream& out, const Report& report);
+		/// Header line for WriteCsvRow()
+		static void WriteCsvHeader(std::ostream& out);
+		/// One line per run so results from several commits can be collected in a single file
+		static void WriteCsvRow(std::ostream& out, const Report& report);
+
+		/// Writes CSV when the path has a .csv extension (appending a row per report, with a header if the file is new) and JSON otherwise,
+		/// an array if there is more than one report. Returns false if the file couldn't be written.
+		static bool WriteReportFile(const std::filesystem::path& path, std::span<const Report> reports);
+
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		BenchmarkInfo info;
+		Clock::time_point start_time{};
+		Clock::time_point stop_time{};
+		RollingSamples frame_ms;
+		RollingSamples fence_wait_ms;
+		RollingSamples acquire_ms;
+		RollingSamples submit_ms;
+		RollingSamples present_ms;
+		RollingSamples upload_ms;
+		RollingSamples transfer_overlap_ms;
+		uint64_t uniform_bytes{ 0 }; // total over every frame added
+		std::size_t transfer_frames{ 0 };
+		std::size_t transfer_ready_frames{ 0 };
+	};
+}
@@ -0,0 +1,125 @@
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "LearningVulkan/Bridges/glm.hpp"
+#include "LearningVulkan/Graphics/CpuCulling.hpp"
+#include "LearningVulkan/Utility/ThreadPool.hpp"
+
+#include "CullingBenchmark.hpp"
+
+namespace
+{
+	constexpr std::array lod_thresholds{ 64.f, 16.f, 4.f }; // pixels of projected radius, so four LODs
+
+	/// Objects scattered through a cube around a camera looking down -z, so about a tenth of them end up in view
+	[[nodiscard]] Graphics::ObjectBounds CreateScene(std::size_t object_count)
+	{
+		std::mt19937 random{ 1234 }; // same scene every run
+		std::uniform_real_distribution<float> position{ -500.f, 500.f };
+		std::uniform_real_distribution<float> size{ .5f, 5.f };
+		std::uniform_real_distribution<float> fraction{ .1f, 1.f };
+
+		Graphics::ObjectBounds bounds{};
+		bounds.Resize(object_count);
+		for (std::size_t idx{ 0 }; idx < object_count; ++idx)
+		{
+			bounds.centre_x[idx] = position(random);
+			bounds.centre_y[idx] = position(random);
+			bounds.centre_z[idx] = position(random);
+
+			// the box fits inside the sphere, which is what LOD selection uses
+			const float radius{ size(random) };
+			const float max_extent{ radius / std::sqrt(3.f) };
+			bounds.radius[idx] = radius;
+			bounds.extent_x[idx] = max_extent * fraction(random);
+			bounds.extent_y[idx] = max_extent * fraction(random);
+			bounds.extent_z[idx] = max_extent * fraction(random);
+		}
+		return bounds;
+	}
+
+	[[nodiscard]] std::size_t CountMismatches(const std::vector<uint8_t>& lods, const std::vector<uint8_t>& reference)
+	{
+		std::size_t mismatches{ 0 };
+		for (std::size_t idx{ 0 }; idx < lods.size(); ++idx) {
+			mismatches += lods[idx] != reference[idx] ? 1 : 0;
+		}
+		return mismatches;
+	}
+}
+
+namespace Profiling
+{
+	void RunCullingBenchmark(std::ostream& out, const CullingBenchmarkSettings& settings)
+	{
+		// Rates are per object, and the first kernel's results are the reference the others are compared with
+		const std::size_t object_count{ std::max<std::size_t>(settings.object_count, 1) };
+		const auto bounds{ CreateScene(object_count) };
+
+		constexpr float viewport_height{ 1080.f };
+		auto projection{ glm::perspective(glm::radians(60.f), 16.f / 9.f, .1f, 1000.f) };
+		projection[1][1] *= -1.f; // Vulkan's y points down
+		const auto view{ glm::lookAt(glm::vec3{ 0.f, 0.f, 0.f }, glm::vec3{ 0.f, 0.f, -1.f }, glm::vec3{ 0.f, 1.f, 0.f }) };
+
+		out << "CPU culling: " << object_count << " objects, " << lod_thresholds.size() + 1 << " LODs, fastest of " << settings.repetitions
+			<< " runs, " << Graphics::GetName(Graphics::GetBestCullKernel()) << " is the best kernel here\n";
+
+		for (const auto shape : { Graphics::CullShape::eSphere, Graphics::CullShape::eAabb })
+		{
+			const auto params{ Graphics::CullParams::FromCamera(view, projection, viewport_height, lod_thresholds, shape) };
+			const char* shape_name{ shape == Graphics::CullShape::eSphere ? "spheres" : "boxes" };
+
+			std::vector<uint8_t> reference{};
+			double scalar_ms{ 0. };
+
+			for (const auto kernel : { Graphics::CullKernel::eScalar, Graphics::CullKernel::eSse, Graphics::CullKernel::eAvx2, Graphics::CullKernel::eNeon })
+			{
+				if (!Graphics::IsSupported(kernel)) {
+					continue;
+				}
+
+				for (const bool threaded : { false, true })
+				{
+					if (threaded && !settings.thread_pool) {
+						continue;
+					}
+
+					Graphics::CullOptions options{};
+					options.kernel = kernel;
+					options.thread_pool = threaded ? settings.thread_pool : nullptr;
+
+					std::vector<uint8_t> lods(object_count);
+					std::size_t visible{ 0 };
+					double best_ms{ std::numeric_limits<double>::max() };
+					for (std::size_t run{ 0 }; run < std::max<std::size_t>(settings.repetitions, 1); ++run)
+					{
+						const auto begin{ std::chrono::steady_clock::now() };
+						visible = Graphics::CullObjects(bounds, params, lods, options);
+						best_ms = std::min(best_ms, std::chrono::duration<double, std::milli>{ std::chrono::steady_clock::now() - begin }.count());
+					}
+
+					// single threaded scalar always runs first
+					if (reference.empty())
+					{
+						reference = lods;
+						scalar_ms = best_ms;
+					}
+
+					const std::size_t threads{ threaded ? settings.thread_pool->GetThreadCount() + 1 : 1 };
+					out << "  " << shape_name << ", " << Graphics::GetName(kernel) << " on " << threads << (threads == 1 ? " thread: " : " threads: ")
+						<< (best_ms > 0. ? static_cast<double>(object_count) / best_ms / 1'000. : 0.) << "M objects/s (" << best_ms << "ms, "
+						<< (best_ms > 0. ? scalar_ms / best_ms : 0.) << "x scalar), "
+						<< visible << " visible, " << CountMismatches(lods, reference) << " mismatches\n";
+				}
+			}
+		}
+	}
+}
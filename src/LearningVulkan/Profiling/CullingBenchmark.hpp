@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <iosfwd>
+
+namespace Utility
+{
+	class ThreadPool;
+}
+
+namespace Profiling
+{
+	struct CullingBenchmarkSettings
+	{
+		std::size_t object_count{ 1'000'000 }; // at least 1
+		std::size_t repetitions{ 20 }; // the fastest one is reported
+		Utility::ThreadPool* thread_pool{ nullptr }; // also runs every kernel spread over the pool when set
+	};
+
+	/// Culls a fixed random scene with every CPU culling kernel the machine supports, for spheres and boxes, and prints objects/second.
+	/// Results are compared with the scalar kernel, any object they disagree on is reported as a mismatch.
+	void RunCullingBenchmark(std::ostream& out, const CullingBenchmarkSettings& settings);
+}
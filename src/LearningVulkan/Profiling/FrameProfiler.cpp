@@ -0,0 +1,186 @@
+
+#include <iostream>
+#include <string_view>
+#include <utility>
+
+#include "FrameProfiler.hpp"
+
+namespace
+{
+	void PrintSummary(std::ostream& out, std::string_view name, const Profiling::RollingSamples::Summary& summary)
+	{
+		out << "  " << name << ": ";
+		if (summary.count == 0)
+		{
+			out << "no samples\n";
+			return;
+		}
+
+		out << "p50 " << summary.p50 << "ms, p95 " << summary.p95 << "ms, p99 " << summary.p99 << "ms"
+			<< " (min " << summary.min << ", mean " << summary.mean << ", max " << summary.max << ", " << summary.count << " samples)\n";
+	}
+}
+
+namespace Profiling
+{
+	FrameProfiler::FrameProfiler(Settings profiler_settings)
+		: settings{ std::move(profiler_settings) }
+		, gpu_ms{ settings.window_size }
+		, cpu_submit_ms{ settings.window_size }
+		, frame_interval_ms{ settings.window_size }
+		, transfer_ms{ settings.window_size }
+		, transfer_overlap_ms{ settings.window_size }
+	{
+		if (!settings.json_path.empty())
+		{
+			json_file.open(settings.json_path, std::ios::out | std::ios::app);
+			if (!json_file) {
+				std::cerr << "Failed to open profiler output '" << settings.json_path.string() << "'\n";
+			}
+		}
+	}
+
+	void FrameProfiler::BeginFrame()
+	{
+		const auto now{ Clock::now() };
+		if (last_frame_begin) {
+			frame_interval_ms.Add(std::chrono::duration<double, std::milli>{ now - *last_frame_begin }.count());
+		}
+		last_frame_begin = now;
+		++frame_count;
+	}
+
+	void FrameProfiler::AddCpuSubmitTime(double ms)
+	{
+		cpu_submit_ms.Add(ms);
+	}
+
+	void FrameProfiler::AddGpuTime(double ms)
+	{
+		gpu_ms.Add(ms);
+	}
+
+	void FrameProfiler::AddTransferTime(double ms)
+	{
+		transfer_ms.Add(ms);
+	}
+
+	void FrameProfiler::AddTransferOverlap(double ms)
+	{
+		transfer_overlap_ms.Add(ms);
+	}
+
+	void FrameProfiler::AddTransferSubmit(bool ready)
+	{
+		++transfer_frames;
+		if (ready) {
+			++transfer_ready_frames;
+		}
+	}
+
+	void FrameProfiler::SetPipelineStatistics(const PipelineStatistics& statistics)
+	{
+		pipeline_statistics = statistics;
+	}
+
+	void FrameProfiler::SetUniformBytes(uint64_t bytes)
+	{
+		uniform_bytes = bytes;
+	}
+
+	FrameProfiler::Report FrameProfiler::GetReport() const
+	{
+		Report report{};
+		report.frame_count = frame_count;
+		report.gpu_ms = gpu_ms.Summarise();
+		report.cpu_submit_ms = cpu_submit_ms.Summarise();
+		report.frame_interval_ms = frame_interval_ms.Summarise();
+		report.transfer_ms = transfer_ms.Summarise();
+		report.transfer_overlap_ms = transfer_overlap_ms.Summarise();
+		report.transfer_frames = transfer_frames;
+		report.transfer_ready_frames = transfer_ready_frames;
+		report.pipeline_statistics = pipeline_statistics;
+		report.uniform_bytes = uniform_bytes;
+		return report;
+	}
+
+	void FrameProfiler::Update()
+	{
+		const auto now{ Clock::now() };
+		if (now - last_dump < settings.dump_interval) {
+			return;
+		}
+		last_dump = now;
+
+		const auto report{ GetReport() };
+		if (settings.print_to_stdout) {
+			PrintReport(std::cout, report);
+		}
+		if (json_file)
+		{
+			WriteJson(json_file, report);
+			json_file << '\n';
+			json_file.flush();
+		}
+	}
+
+	void FrameProfiler::PrintReport(std::ostream& out, const Report& report)
+	{
+		out << "Frame profile after " << report.frame_count << " frames:\n";
+		PrintSummary(out, "GPU time", report.gpu_ms);
+		PrintSummary(out, "CPU submit", report.cpu_submit_ms);
+		PrintSummary(out, "Frame interval", report.frame_interval_ms);
+		if (report.transfer_ms.count > 0) {
+			PrintSummary(out, "Transfer queue", report.transfer_ms);
+		}
+		if (report.transfer_overlap_ms.count > 0) {
+			PrintSummary(out, "Transfer overlapping graphics", report.transfer_overlap_ms);
+		}
+		if (report.transfer_frames > 0)
+		{
+			out << "  Uploads finished before the graphics submission: " << report.transfer_ready_frames << " of " << report.transfer_frames << " frames ("
+				<< 100. * static_cast<double>(report.transfer_ready_frames) / static_cast<double>(report.transfer_frames) << "%)\n";
+		}
+		if (const auto& stats = report.pipeline_statistics)
+		{
+			out << "  Pipeline statistics: " << stats->input_assembly_vertices << " vertices, " << stats->input_assembly_primitives << " primitives, "
+				<< stats->vertex_shader_invocations << " VS invocations, " << stats->clipping_invocations << " clipping invocations, "
+				<< stats->clipping_primitives << " clipped primitives, " << stats->fragment_shader_invocations << " FS invocations\n";
+		}
+		if (report.uniform_bytes) {
+			out << "  Uniform ring: " << *report.uniform_bytes << " bytes written last frame\n";
+		}
+	}
+
+	void FrameProfiler::WriteJson(std::ostream& out, const Report& report)
+	{
+		out << "{\"frames\":" << report.frame_count;
+		out << ",\"gpu_ms\":"; Profiling::WriteJson(out, report.gpu_ms);
+		out << ",\"cpu_submit_ms\":"; Profiling::WriteJson(out, report.cpu_submit_ms);
+		out << ",\"frame_interval_ms\":"; Profiling::WriteJson(out, report.frame_interval_ms);
+		if (report.transfer_ms.count > 0) {
+			out << ",\"transfer_ms\":"; Profiling::WriteJson(out, report.transfer_ms);
+		}
+		if (report.transfer_overlap_ms.count > 0) {
+			out << ",\"transfer_overlap_ms\":"; Profiling::WriteJson(out, report.transfer_overlap_ms);
+		}
+		if (report.transfer_frames > 0) {
+			out << ",\"transfer_frames\":" << report.transfer_frames << ",\"transfer_ready_frames\":" << report.transfer_ready_frames;
+		}
+		if (const auto& stats = report.pipeline_statistics)
+		{
+			out << ",\"pipeline_statistics\":{"
+				<< "\"input_assembly_vertices\":" << stats->input_assembly_vertices
+				<< ",\"input_assembly_primitives\":" << stats->input_assembly_primitives
+				<< ",\"vertex_shader_invocations\":" << stats->vertex_shader_invocations
+				<< ",\"clipping_invocations\":" << stats->clipping_invocations
+				<< ",\"clipping_primitives\":" << stats->clipping_primitives
+				<< ",\"fragment_shader_invocations\":" << stats->fragment_shader_invocations
+				<< '}';
+		}
+		if (report.uniform_bytes) {
+			out << ",\"uniform_bytes\":" << *report.uniform_bytes;
+		}
+		out << '}';
+	}
+}
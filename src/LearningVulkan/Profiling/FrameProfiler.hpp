@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iosfwd>
+#include <optional>
+
+#include "RollingSamples.hpp"
+
+namespace Profiling
+{
+	/// Subset of the counters from a VK_QUERY_TYPE_PIPELINE_STATISTICS query we care about
+	struct PipelineStatistics
+	{
+		uint64_t input_assembly_vertices{ 0 };
+		uint64_t input_assembly_primitives{ 0 };
+		uint64_t vertex_shader_invocations{ 0 };
+		uint64_t clipping_invocations{ 0 };
+		uint64_t clipping_primitives{ 0 };
+		uint64_t fragment_shader_invocations{ 0 };
+	};
+
+	/// Collects per-frame timings into rolling windows and periodically dumps percentiles to stdout and/or a JSON lines file.
+	class FrameProfiler
+	{
+	public:
+		struct Settings
+		{
+			std::chrono::duration<double> dump_interval{ 1. };
+			bool print_to_stdout{ true };
+			std::filesystem::path json_path{}; // one JSON object per dump is appended here when not empty
+			std::size_t window_size{ 1024 }; // number of frames the percentiles are taken over
+		};
+
+		struct Report
+		{
+			uint64_t frame_count{ 0 };
+			RollingSamples::Summary gpu_ms{};
+			RollingSamples::Summary cpu_submit_ms{};
+			RollingSamples::Summary frame_interval_ms{};
+			RollingSamples::Summary transfer_ms{}; // uploads on the dedicated transfer queue, no samples without one
+			RollingSamples::Summary transfer_overlap_ms{}; // of transfer_ms, how much ran alongside graphics work. Needs VK_EXT_calibrated_timestamps
+			uint64_t transfer_frames{ 0 }; // frames whose uploads went to the dedicated transfer queue
+			uint64_t transfer_ready_frames{ 0 }; // of those, the ones whose copies had finished by the graphics submission, which then had nothing to wait for
+			std::optional<PipelineStatistics> pipeline_statistics{}; // most recent frame's
+			std::optional<uint64_t> uniform_bytes{}; // written to the uniform ring by the most recent frame
+		};
+
+		explicit FrameProfiler(Settings settings);
+
+		/// Call at the very start of each frame, the time between calls is the frame interval.
+		void BeginFrame();
+		void AddCpuSubmitTime(double ms);
+		void AddGpuTime(double ms);
+		void AddTransferTime(double ms);
+		void AddTransferOverlap(double ms);
+		/// Call for every frame that submitted uploads to the transfer queue, ready is whether they had finished when the graphics work was submitted
+		void AddTransferSubmit(bool ready);
+		void SetPipelineStatistics(const PipelineStatistics& statistics);
+		void SetUniformBytes(uint64_t bytes);
+
+		[[nodiscard]] Report GetReport() const;
+
+		/// Dumps a report if the dump interval has passed since the last one.
+		void Update();
+
+		static void PrintReport(std::ostream& out, const Report& report);
+		static void WriteJson(std::ostream& out, const Report& report);
+
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		Settings settings;
+		std::ofstream json_file{};
+		uint64_t frame_count{ 0 };
+		std::optional<Clock::time_point> last_frame_begin{};
+		Clock::time_point last_dump{ Clock::now() };
+		RollingSamples gpu_ms;
+		RollingSamples cpu_submit_ms;
+		RollingSamples frame_interval_ms;
+		RollingSamples transfer_ms;
+		RollingSamples transfer_overlap_ms;
+		uint64_t transfer_frames{ 0 };
+		uint64_t transfer_ready_frames{ 0 };
+		std::optional<PipelineStatistics> pipeline_statistics{};
+		std::optional<uint64_t> uniform_bytes{};
+	};
+}
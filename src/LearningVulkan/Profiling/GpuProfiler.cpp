@@ -0,0 +1,178 @@
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <iostream>
+
+#include "GpuProfiler.hpp"
+
+namespace
+{
+	constexpr vk::QueryPipelineStatisticFlags statistic_flags{
+		vk::QueryPipelineStatisticFlagBits::eInputAssemblyVertices
+		| vk::QueryPipelineStatisticFlagBits::eInputAssemblyPrimitives
+		| vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations
+		| vk::QueryPipelineStatisticFlagBits::eClippingInvocations
+		| vk::QueryPipelineStatisticFlagBits::eClippingPrimitives
+		| vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations
+	};
+	constexpr uint32_t statistic_count{ 6 }; // number of bits in statistic_flags, results come back in bit order
+}
+
+namespace Profiling
+{
+	GpuProfiler::GpuProfiler(vk::Device& logical_device, const vk::PhysicalDevice& physical_device, uint32_t queue_family_index, uint32_t slot_count, bool enable_pipeline_statistics, bool host_query_reset)
+		: device{ logical_device }
+		, pending(slot_count, false)
+	{
+		const auto properties{ physical_device.getProperties() };
+		const auto queue_families{ physical_device.getQueueFamilyProperties() };
+		const bool family_exists{ queue_family_index < queue_families.size() };
+		const uint32_t valid_bits{ family_exists ? queue_families[queue_family_index].timestampValidBits : 0u };
+		reset_on_host = family_exists && !(queue_families[queue_family_index].queueFlags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute));
+
+		timestamps_supported = valid_bits > 0 && properties.limits.timestampPeriod > 0.f && (!reset_on_host || host_query_reset);
+		if (!timestamps_supported)
+		{
+			std::cout << "GPU timestamps are not supported on this queue, GPU times will not be reported\n";
+		}
+		else
+		{
+			timestamp_period_ns = static_cast<double>(properties.limits.timestampPeriod);
+			timestamp_mask = valid_bits >= 64 ? ~0ULL : ((1ULL << valid_bits) - 1);
+
+			timestamp_pool = device.createQueryPoolUnique(vk::QueryPoolCreateInfo{}
+				.setQueryType(vk::QueryType::eTimestamp)
+				.setQueryCount(slot_count * 2)
+			);
+		}
+
+		if (enable_pipeline_statistics)
+		{
+			statistics_pool = device.createQueryPoolUnique(vk::QueryPoolCreateInfo{}
+				.setQueryType(vk::QueryType::ePipelineStatistics)
+				.setQueryCount(slot_count)
+				.setPipelineStatistics(statistic_flags)
+			);
+		}
+	}
+
+	vk::QueryPipelineStatisticFlags GpuProfiler::GetPipelineStatisticFlags() const noexcept
+	{
+		return statistics_pool ? statistic_flags : vk::QueryPipelineStatisticFlags{};
+	}
+
+	void GpuProfiler::RecordBegin(vk::CommandBuffer& cmd, uint32_t slot)
+	{
+		assert(slot < pending.size());
+
+		if (timestamp_pool)
+		{
+			// the slot's previous submission has finished by the time it gets recorded again, so resetting it from here is fine
+			if (reset_on_host) {
+				device.resetQueryPool(*timestamp_pool, slot * 2, 2);
+			}
+			else {
+				cmd.resetQueryPool(*timestamp_pool, slot * 2, 2);
+			}
+			cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *timestamp_pool, slot * 2);
+		}
+		if (statistics_pool)
+		{
+			cmd.resetQueryPool(*statistics_pool, slot, 1);
+			cmd.beginQuery(*statistics_pool, slot, {});
+		}
+	}
+
+	void GpuProfiler::RecordEnd(vk::CommandBuffer& cmd, uint32_t slot)
+	{
+		assert(slot < pending.size());
+
+		if (statistics_pool) {
+			cmd.endQuery(*statistics_pool, slot);
+		}
+		if (timestamp_pool) {
+			cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *timestamp_pool, slot * 2 + 1);
+		}
+	}
+
+	void GpuProfiler::OnSubmitted(uint32_t slot)
+	{
+		assert(slot < pending.size());
+		pending[slot] = true;
+	}
+
+	GpuProfiler::Results GpuProfiler::Collect(uint32_t slot)
+	{
+		assert(slot < pending.size());
+
+		Results results{};
+		if (!pending[slot]) {
+			return results;
+		}
+
+		bool all_available{ true };
+
+		// Using the raw pointer overload as it returns eNotReady rather than throwing, no wait flag so this never blocks
+		if (timestamp_pool)
+		{
+			std::array<uint64_t, 2> timestamps{};
+			const auto result{ device.getQueryPoolResults(*timestamp_pool, slot * 2, 2, sizeof(timestamps), timestamps.data(), sizeof(uint64_t), vk::QueryResultFlagBits::e64) };
+			if (result == vk::Result::eSuccess)
+			{
+				const uint64_t begin{ timestamps[0] & timestamp_mask };
+				const uint64_t end{ timestamps[1] & timestamp_mask };
+				const uint64_t ticks{ (end - begin) & timestamp_mask }; // masking handles the counter wrapping between the two
+				results.gpu_ms = static_cast<double>(ticks) * timestamp_period_ns / 1'000'000.;
+				results.timestamps = TimestampRange{ begin, end };
+			}
+			else
+			{
+				all_available = false;
+			}
+		}
+
+		if (statistics_pool)
+		{
+			std::array<uint64_t, statistic_count> counters{};
+			const auto result{ device.getQueryPoolResults(*statistics_pool, slot, 1, sizeof(counters), counters.data(), sizeof(counters), vk::QueryResultFlagBits::e64) };
+			if (result == vk::Result::eSuccess)
+			{
+				results.pipeline_statistics = PipelineStatistics{
+					.input_assembly_vertices = counters[0],
+					.input_assembly_primitives = counters[1],
+					.vertex_shader_invocations = counters[2],
+					.clipping_invocations = counters[3],
+					.clipping_primitives = counters[4],
+					.fragment_shader_invocations = counters[5],
+				};
+			}
+			else
+			{
+				all_available = false;
+			}
+		}
+
+		// Keep trying on later calls until everything has come back
+		if (all_available) {
+			pending[slot] = false;
+		}
+
+		return results;
+	}
+
+	double GpuProfiler::GetOverlapMs(const TimestampRange& range, const GpuProfiler& other, const TimestampRange& other_range) const
+	{
+		// Everything is taken relative to range.begin, with the bits both queues have in common, so the counters wrapping in between is handled
+		const uint64_t mask{ timestamp_mask & other.timestamp_mask };
+		const auto offset = [&](uint64_t ticks)
+		{
+			const uint64_t delta{ (ticks - range.begin) & mask };
+			return delta > mask / 2 ? static_cast<int64_t>(delta - mask - 1) : static_cast<int64_t>(delta);
+		};
+
+		const int64_t begin{ std::max<int64_t>(0, offset(other_range.begin)) };
+		const int64_t end{ std::min(offset(range.end), offset(other_range.end)) };
+		return end > begin ? static_cast<double>(end - begin) * timestamp_period_ns / 1'000'000. : 0.;
+	}
+}
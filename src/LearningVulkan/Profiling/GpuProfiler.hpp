@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "LearningVulkan/Bridges/vulkan.hpp"
+
+#include "FrameProfiler.hpp"
+
+namespace Profiling
+{
+	/// Brackets the work recorded into a command buffer with timestamps and (if supported) a pipeline statistics query.
+	/// Each slot has its own queries so results are read back a few frames later without ever stalling on the GPU.
+	class GpuProfiler
+	{
+	public:
+		/// Begin and end of a submission in timestamp ticks, masked to the queue's valid bits
+		struct TimestampRange
+		{
+			uint64_t begin{ 0 };
+			uint64_t end{ 0 };
+		};
+
+		struct Results
+		{
+			std::optional<double> gpu_ms{};
+			std::optional<TimestampRange> timestamps{}; // what gpu_ms was taken from, for comparing against other queues
+			std::optional<PipelineStatistics> pipeline_statistics{};
+		};
+
+		/// Queues without graphics or compute (i.e. transfer only) can't reset queries in a command buffer, those need host_query_reset (a Vulkan 1.2 feature)
+		/// enabled on the device, otherwise no timestamps are taken on them.
+		GpuProfiler(vk::Device& device, const vk::PhysicalDevice& physical_device, uint32_t queue_family_index, uint32_t slot_count, bool enable_pipeline_statistics, bool host_query_reset = false);
+
+		[[nodiscard]] bool IsSupported() const noexcept { return timestamps_supported; }
+		[[nodiscard]] bool HasPipelineStatistics() const noexcept { return static_cast<bool>(statistics_pool); }
+		/// For the inheritance info of secondary command buffers executed while the statistics query is active, empty without pipeline statistics
+		[[nodiscard]] vk::QueryPipelineStatisticFlags GetPipelineStatisticFlags() const noexcept;
+
+		/// Record before anything else in the command buffer (outside of a render pass).
+		void RecordBegin(vk::CommandBuffer& cmd, uint32_t slot);
+		/// Record after everything else in the command buffer (outside of a render pass).
+		void RecordEnd(vk::CommandBuffer& cmd, uint32_t slot);
+
+		/// Marks a slot's queries as in flight, Collect() ignores slots that were never submitted.
+		void OnSubmitted(uint32_t slot);
+
+		/// Reads back the results of the last submission of the slot without waiting, returns nothing that isn't available yet.
+		[[nodiscard]] Results Collect(uint32_t slot);
+
+		/// Milliseconds during which range and other_range (taken by other, on another queue) were both running.
+		/// Only meaningful when both queues' timestamps are in the same time domain, which VK_EXT_calibrated_timestamps' device domain guarantees.
+		[[nodiscard]] double GetOverlapMs(const TimestampRange& range, const GpuProfiler& other, const TimestampRange& other_range) const;
+
+	private:
+		vk::Device& device;
+		bool timestamps_supported{ false };
+		double timestamp_period_ns{ 1. };
+		uint64_t timestamp_mask{ ~0ULL };
+		bool reset_on_host{ false };
+
+		vk::UniqueQueryPool timestamp_pool{}; // 2 queries per slot
+		vk::UniqueQueryPool statistics_pool{}; // 1 query per slot, null when unsupported
+		std::vector<bool> pending{};
+	};
+}
@@ -0,0 +1,72 @@
+
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+#include <numeric>
+
+#include "RollingSamples.hpp"
+
+namespace Profiling
+{
+	RollingSamples::RollingSamples(std::size_t window_size)
+		: capacity{ std::max<std::size_t>(window_size, 1) }
+	{
+		samples.reserve(capacity);
+	}
+
+	void RollingSamples::Add(double value)
+	{
+		if (samples.size() < capacity)
+		{
+			samples.push_back(value);
+			return;
+		}
+
+		samples[next] = value;
+		next = (next + 1) % capacity;
+	}
+
+	void RollingSamples::Clear() noexcept
+	{
+		samples.clear();
+		next = 0;
+	}
+
+	RollingSamples::Summary RollingSamples::Summarise() const
+	{
+		Summary summary{};
+		summary.count = samples.size();
+		if (samples.empty()) {
+			return summary;
+		}
+
+		std::vector<double> sorted{ samples };
+		std::sort(std::begin(sorted), std::end(sorted));
+
+		const auto percentile = [&sorted](double p)
+		{
+			const auto rank{ static_cast<std::size_t>(std::ceil(p * static_cast<double>(sorted.size()))) };
+			return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+		};
+
+		summary.min = sorted.front();
+		summary.max = sorted.back();
+		summary.mean = std::accumulate(std::begin(sorted), std::end(sorted), 0.) / static_cast<double>(sorted.size());
+		summary.p50 = percentile(0.50);
+		summary.p95 = percentile(0.95);
+		summary.p99 = percentile(0.99);
+		return summary;
+	}
+
+	void WriteJson(std::ostream& out, const RollingSamples::Summary& summary)
+	{
+		out << "{\"count\":" << summary.count
+			<< ",\"min\":" << summary.min
+			<< ",\"mean\":" << summary.mean
+			<< ",\"p50\":" << summary.p50
+			<< ",\"p95\":" << summary.p95
+			<< ",\"p99\":" << summary.p99
+			<< ",\"max\":" << summary.max
+			<< '}';
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <iosfwd>
+#include <vector>
+
+namespace Profiling
+{
+	/// Keeps the most recent N samples of a value and answers percentile queries over them.
+	class RollingSamples
+	{
+	public:
+		explicit RollingSamples(std::size_t capacity = 1024);
+
+		void Add(double value);
+		void Clear() noexcept;
+
+		[[nodiscard]] std::size_t GetCount() const noexcept { return samples.size(); }
+
+		struct Summary
+		{
+			std::size_t count{ 0 };
+			double min{ 0. };
+			double mean{ 0. };
+			double p50{ 0. };
+			double p95{ 0. };
+			double p99{ 0. };
+			double max{ 0. };
+		};
+
+		/// Percentiles are nearest-rank over the samples currently in the window.
+		[[nodiscard]] Summary Summarise() const;
+
+	private:
+		std::vector<double> samples;
+		std::size_t capacity;
+		std::size_t next{ 0 }; // slot to overwrite once the window is full
+	};
+
+	/// Writes the summary as a JSON object, e.g. {"count":10,"min":1.2,...}
+	void WriteJson(std::ostream& out, const RollingSamples::Summary& summary);
+}
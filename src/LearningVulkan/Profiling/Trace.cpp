@@ -0,0 +1,175 @@
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "Trace.hpp"
+
+namespace
+{
+	using Profiling::TraceClock;
+
+	struct Event
+	{
+		const char* name{ nullptr };
+		TraceClock::duration begin{}; // since the trace started
+		TraceClock::duration duration{};
+	};
+
+	/// Written only by its own thread. Outlives the thread, so a pool that has been replaced still shows up in the trace
+	struct ThreadBuffer
+	{
+		uint32_t thread_id{ 0 }; // in order of first event, what the viewer groups by
+		std::string name{};
+		std::vector<Event> events{}; // ring
+		std::atomic<uint64_t> written{ 0 };
+	};
+
+	struct TraceState
+	{
+		std::atomic<bool> enabled{ false };
+		std::size_t events_per_thread{ 0 };
+		TraceClock::time_point origin{};
+		std::mutex mutex{}; // new threads registering, names, writing out
+		std::vector<std::unique_ptr<ThreadBuffer>> buffers{};
+	};
+
+	[[nodiscard]] TraceState& GetState()
+	{
+		static TraceState state{};
+		return state;
+	}
+
+	[[nodiscard]] ThreadBuffer& GetThreadBuffer()
+	{
+		thread_local ThreadBuffer* buffer{ nullptr };
+		if (!buffer)
+		{
+			auto& state{ GetState() };
+			const std::lock_guard lock{ state.mutex };
+			auto& added{ state.buffers.emplace_back(std::make_unique<ThreadBuffer>()) };
+			added->thread_id = static_cast<uint32_t>(state.buffers.size());
+			added->events.resize(state.events_per_thread);
+			buffer = added.get();
+		}
+		return *buffer;
+	}
+
+	[[nodiscard]] double ToMicroseconds(TraceClock::duration duration)
+	{
+		return std::chrono::duration<double, std::micro>{ duration }.count();
+	}
+}
+
+namespace Profiling
+{
+	void StartTrace(std::size_t events_per_thread)
+	{
+		auto& state{ GetState() };
+		assert(!state.enabled.load() && events_per_thread > 0);
+
+		state.events_per_thread = events_per_thread;
+		state.origin = TraceClock::now();
+		state.enabled.store(true, std::memory_order_release);
+	}
+
+	bool IsTracing() noexcept
+	{
+		return GetState().enabled.load(std::memory_order_relaxed);
+	}
+
+	void SetTraceThreadName(std::string name)
+	{
+		if (!IsTracing()) {
+			return;
+		}
+
+		auto& buffer{ GetThreadBuffer() };
+		const std::lock_guard lock{ GetState().mutex };
+		buffer.name = std::move(name);
+	}
+
+	void RecordTraceEvent(const char* name, TraceClock::time_point begin, TraceClock::time_point end) noexcept
+	{
+		if (!IsTracing()) {
+			return;
+		}
+
+		// Only this thread writes the ring, the release lets WriteTrace() see the event once it sees the count
+		auto& buffer{ GetThreadBuffer() };
+		const auto index{ buffer.written.load(std::memory_order_relaxed) };
+		const auto origin{ GetState().origin };
+		buffer.events[index % buffer.events.size()] = Event{ name, begin - origin, end - begin };
+		buffer.written.store(index + 1, std::memory_order_release);
+	}
+
+	bool WriteTrace(const std::filesystem::path& path)
+	{
+		auto& state{ GetState() };
+		const std::lock_guard lock{ state.mutex };
+
+		std::error_code ec{};
+		if (path.has_parent_path()) {
+			std::filesystem::create_directories(path.parent_path(), ec);
+		}
+
+		std::ofstream file{ path, std::ios::out | std::ios::trunc };
+		file << std::fixed << std::setprecision(3);
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		file << "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\",\"args\":{\"name\":\"LearningVulkan\"}}";
+
+		for (const auto& buffer : state.buffers)
+		{
+			file << ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread_id << ",\"name\":\"thread_name\",\"args\":{\"name\":\"";
+			if (buffer->name.empty()) {
+				file << "thread " << buffer->thread_id;
+			}
+			else {
+				file << buffer->name;
+			}
+			file << "\"}}";
+
+			// Oldest first, which is where the ring is about to write next once it has wrapped
+			const auto written{ buffer->written.load(std::memory_order_acquire) };
+			const auto capacity{ static_cast<uint64_t>(buffer->events.size()) };
+			const auto first{ written > capacity ? written - capacity : 0 };
+			if (first > 0) {
+				std::cerr << "Trace: " << first << " events of thread " << buffer->thread_id << " were overwritten, only the most recent " << capacity << " are written\n";
+			}
+
+			for (auto index{ first }; index < written; ++index)
+			{
+				const auto& event{ buffer->events[static_cast<std::size_t>(index % capacity)] };
+				file << ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->thread_id << ",\"name\":\"" << event.name
+					<< "\",\"ts\":" << ToMicroseconds(event.begin) << ",\"dur\":" << ToMicroseconds(event.duration) << '}';
+			}
+		}
+
+		file << "\n]}\n";
+		return static_cast<bool>(file);
+	}
+
+	TraceScope::TraceScope(const char* scope_name) noexcept
+	{
+		if (IsTracing())
+		{
+			name = scope_name;
+			begin = TraceClock::now();
+		}
+	}
+
+	TraceScope::~TraceScope()
+	{
+		if (name) {
+			RecordTraceEvent(name, begin, TraceClock::now());
+		}
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <string>
+
+namespace Profiling
+{
+	using TraceClock = std::chrono::steady_clock;
+
+	/// Starts a process wide timeline of named scopes, written out as Chrome trace event JSON for chrome://tracing or ui.perfetto.dev.
+	/// Every thread records into a ring buffer of its own, so an event is two clock reads and a store without any locking. Once a
+	/// thread's ring is full its oldest events are overwritten. Before this is called a scope costs one relaxed atomic load.
+	/// Timestamps are relative to this call. events_per_thread is the size of each thread's ring
+	void StartTrace(std::size_t events_per_thread = std::size_t{ 1 } << 16);
+	[[nodiscard]] bool IsTracing() noexcept;
+
+	/// Shown for the calling thread instead of its number. Plain text, it is written out without escaping
+	void SetTraceThreadName(std::string name);
+
+	/// name has to outlive the trace (i.e. be a string literal) and is written out without escaping
+	void RecordTraceEvent(const char* name, TraceClock::time_point begin, TraceClock::time_point end) noexcept;
+
+	/// Only call while no other thread is recording, e.g. with the thread pool idle. False if the file couldn't be written
+	[[nodiscard]] bool WriteTrace(const std::filesystem::path& path);
+
+	/// Records the time from construction to destruction as an event, if tracing had been started by the time it was constructed
+	class TraceScope
+	{
+	public:
+		explicit TraceScope(const char* scope_name) noexcept;
+		~TraceScope();
+
+		TraceScope(const TraceScope&) = delete;
+		TraceScope& operator=(const TraceScope&) = delete;
+
+	private:
+		const char* name{ nullptr }; // null when not tracing
+		TraceClock::time_point begin{};
+	};
+}
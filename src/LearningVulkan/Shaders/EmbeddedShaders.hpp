@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+/// SPIR-V compiled from the GLSL in this directory at build time (see shaders.props), so no shader compiler is needed at runtime.
+/// The *.inc files are glslc output in "-mfmt=num" format and live in the intermediate directory.
+namespace Shaders
+{
+	inline constexpr uint32_t triangle_vert[]
+	{
+#include "Shaders/triangle.vert.inc"
+	};
+
+	inline constexpr uint32_t triangle_frag[]
+	{
+#include "Shaders/triangle.frag.inc"
+	};
+
+	inline constexpr uint32_t triangle_bindless_vert[]
+	{
+#include "Shaders/triangle_bindless.vert.inc"
+	};
+
+	inline constexpr uint32_t cull_instances_comp[]
+	{
+#include "Shaders/cull_instances.comp.inc"
+	};
+
+	inline constexpr uint32_t compact_draws_comp[]
+	{
+#include "Shaders/compact_draws.comp.inc"
+	};
+}
@@ -0,0 +1,42 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+// per instance
+layout(location = 2) in vec2 instanceOffset;
+layout(location = 3) in vec2 instanceScaleRotation; // radians
+layout(location = 4) in vec4 instanceColor;
+
+// Per frame, from the uniform ring. World to clip space, the GPU culling pass derives its frustum from the same transform
+layout(std140, set = 0, binding = 0) uniform Frame
+{
+	vec2 scale;
+	vec2 translation;
+} frame;
+
+// Per draw, must match the start of DrawConstants in TriangleApp.cpp
+layout(push_constant) uniform Draw
+{
+	uint index; // 0xFFFFFFFF for indirect draws
+	uint instances_per_draw;
+} draw;
+
+// Consecutive draws get slightly different tints so the batches can be told apart
+const vec3 draw_tints[4] = vec3[](vec3(1.0, 1.0, 1.0), vec3(1.0, 0.85, 0.85), vec3(0.85, 1.0, 0.85), vec3(0.85, 0.85, 1.0));
+
+layout(location = 0) out vec3 fragColor;
+
+void main()
+{
+	const float c = cos(instanceScaleRotation.y);
+	const float s = sin(instanceScaleRotation.y);
+	const vec2 position = mat2(c, s, -s, c) * inPosition * instanceScaleRotation.x + instanceOffset;
+
+	// Indirect draws start at instance draw * instances_per_draw, like recorded ones, so both end up with the same tint
+	const uint draw_index = draw.index != 0xFFFFFFFFu ? draw.index : uint(gl_InstanceIndex) / draw.instances_per_draw;
+
+	gl_Position = vec4(position * frame.scale + frame.translation, 0.0, 1.0);
+	fragColor = inColor * instanceColor.rgb * draw_tints[draw_index % 4];
+}
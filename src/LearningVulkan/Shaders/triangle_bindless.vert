@@ -0,0 +1,55 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
+
+// triangle.vert pulling the per instance attributes out of the bindless heap instead of vertex attributes
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+struct Instance
+{
+	vec2 offset;
+	uint scale_rotation; // two halfs, radians
+	uint colour; // RGBA8 unorm
+};
+
+// Same per frame constants as triangle.vert
+layout(std140, set = 0, binding = 0) uniform Frame
+{
+	vec2 scale;
+	vec2 translation;
+} frame;
+
+// The heap is set 1, its binding 1 is the storage buffer array, see BindlessHeap.hpp
+layout(std430, set = 1, binding = 1) readonly buffer Instances { Instance instances[]; } heap_buffers[];
+
+// Must match DrawConstants in TriangleApp.cpp
+layout(push_constant) uniform Draw
+{
+	uint index; // 0xFFFFFFFF for indirect draws
+	uint instances_per_draw;
+	uint instance_buffer; // slot in the heap
+	uint instance_first; // first instance of the frame's copy
+} draw;
+
+// Same as triangle.vert
+const vec3 draw_tints[4] = vec3[](vec3(1.0, 1.0, 1.0), vec3(1.0, 0.85, 0.85), vec3(0.85, 1.0, 0.85), vec3(0.85, 0.85, 1.0));
+
+layout(location = 0) out vec3 fragColor;
+
+void main()
+{
+	// The slot is the same for the whole draw, so no nonuniformEXT needed
+	const Instance instance = heap_buffers[draw.instance_buffer].instances[draw.instance_first + gl_InstanceIndex];
+	const vec2 scale_rotation = unpackHalf2x16(instance.scale_rotation);
+
+	const float c = cos(scale_rotation.y);
+	const float s = sin(scale_rotation.y);
+	const vec2 position = mat2(c, s, -s, c) * inPosition * scale_rotation.x + instance.offset;
+
+	const uint draw_index = draw.index != 0xFFFFFFFFu ? draw.index : uint(gl_InstanceIndex) / draw.instances_per_draw;
+
+	gl_Position = vec4(position * frame.scale + frame.translation, 0.0, 1.0);
+	fragColor = inColor * unpackUnorm4x8(instance.colour).rgb * draw_tints[draw_index % 4];
+}
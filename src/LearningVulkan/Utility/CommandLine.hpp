@@ -0,0 +1,56 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <optional>
+#include <span>
+#include <string_view>
+
+namespace CommandLine
+{
+	/// Returns true if the exact flag (e.g. "--headless") appears anywhere in the arguments.
+	[[nodiscard]] inline bool HasFlag(std::span<const std::string_view> args, std::string_view flag)
+	{
+		return std::find(std::begin(args), std::end(args), flag) != std::end(args);
+	}
+
+	/// Looks up the value of an option given as either "--name value" or "--name=value".
+	[[nodiscard]] inline std::optional<std::string_view> GetValue(std::span<const std::string_view> args, std::string_view name)
+	{
+		for (std::size_t idx{ 0 }; idx < args.size(); ++idx)
+		{
+			const std::string_view arg{ args[idx] };
+			if (arg == name)
+			{
+				if (idx + 1 < args.size()) {
+					return args[idx + 1];
+				}
+				return std::nullopt;
+			}
+
+			if (arg.size() > name.size() && arg.starts_with(name) && arg[name.size()] == '=') {
+				return arg.substr(name.size() + 1);
+			}
+		}
+
+		return std::nullopt;
+	}
+
+	/// Numeric version of GetValue(), values which fail to parse are treated as missing.
+	template<typename T>
+	[[nodiscard]] std::optional<T> GetNumber(std::span<const std::string_view> args, std::string_view name)
+	{
+		const auto value{ GetValue(args, name) };
+		if (!value) {
+			return std::nullopt;
+		}
+
+		T result{};
+		const auto [ptr, ec] = std::from_chars(value->data(), value->data() + value->size(), result);
+		if (ec != std::errc{} || ptr != value->data() + value->size()) {
+			return std::nullopt;
+		}
+
+		return result;
+	}
+}
@@ -0,0 +1,100 @@
+
+#include <array>
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#include "LearningVulkan/Bridges/Windows.hpp"
+#elif defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "FileWatcher.hpp"
+
+namespace Utility
+{
+	FileWatcher::FileWatcher(std::filesystem::path watched_directory, std::vector<std::string> file_names)
+		: directory{ std::move(watched_directory) }
+	{
+		// Set up before the write times are taken, so nothing written in between is missed
+#ifdef _WIN32
+		const HANDLE handle = FindFirstChangeNotificationW(directory.c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+		notification = handle != INVALID_HANDLE_VALUE ? handle : nullptr;
+#elif defined(__linux__)
+		inotify_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotify_fd >= 0 && ::inotify_add_watch(inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+		{
+			::close(inotify_fd);
+			inotify_fd = -1;
+		}
+#endif
+
+		files.reserve(file_names.size());
+		for (auto& name : file_names)
+		{
+			const auto write_time{ GetWriteTime(name) };
+			files.push_back(File{ std::move(name), write_time });
+		}
+	}
+
+	FileWatcher::~FileWatcher()
+	{
+#ifdef _WIN32
+		if (notification) {
+			FindCloseChangeNotification(notification);
+		}
+#elif defined(__linux__)
+		if (inotify_fd >= 0) {
+			::close(inotify_fd);
+		}
+#endif
+	}
+
+	std::vector<std::string> FileWatcher::Poll()
+	{
+		// Nothing happened in the directory, no need to look at the files. Without a way of asking, always look
+#ifdef _WIN32
+		if (notification)
+		{
+			if (WaitForSingleObject(notification, 0) != WAIT_OBJECT_0) {
+				return {};
+			}
+			FindNextChangeNotification(notification);
+		}
+#elif defined(__linux__)
+		if (inotify_fd >= 0)
+		{
+			// Only drains the events, which files they were for is left to the write times
+			alignas(inotify_event) std::array<char, 4096> events{};
+			bool any_event{ false };
+			while (::read(inotify_fd, events.data(), events.size()) > 0) {
+				any_event = true;
+			}
+			if (!any_event) {
+				return {};
+			}
+		}
+#endif
+
+		std::vector<std::string> changed;
+		for (auto& file : files)
+		{
+			const auto write_time{ GetWriteTime(file.name) };
+			if (write_time != file.write_time)
+			{
+				file.write_time = write_time;
+				changed.push_back(file.name);
+			}
+		}
+		return changed;
+	}
+
+	std::filesystem::file_time_type FileWatcher::GetWriteTime(const std::string& name) const
+	{
+		// Missing (e.g. halfway through being replaced) reads as the oldest time there is, so the file counts as changed once it is back
+		std::error_code error{};
+		const auto write_time{ std::filesystem::last_write_time(directory / name, error) };
+		return error ? std::filesystem::file_time_type::min() : write_time;
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace Utility
+{
+	/// Tells which of a set of files in one directory have been written to since the last Poll(), without ever blocking.
+	/// The OS is asked whether anything in the directory changed (inotify on Linux, a change notification handle on Windows) so
+	/// polling every frame costs a single syscall, and only then are the files' write times compared. Elsewhere the write times are
+	/// compared on every Poll(). Editors that save by writing a new file and renaming it over the old one are caught too.
+	class FileWatcher
+	{
+	public:
+		/// file_names are relative to directory. Files that don't exist yet are reported once they appear
+		FileWatcher(std::filesystem::path directory, std::vector<std::string> file_names);
+		~FileWatcher();
+
+		FileWatcher(const FileWatcher&) = delete;
+		FileWatcher& operator=(const FileWatcher&) = delete;
+
+		/// Names of the files changed since the last call (or construction), in the order they were given
+		[[nodiscard]] std::vector<std::string> Poll();
+
+	private:
+		struct File
+		{
+			std::string name{};
+			std::filesystem::file_time_type write_time{};
+		};
+
+		[[nodiscard]] std::filesystem::file_time_type GetWriteTime(const std::string& name) const;
+
+		std::filesystem::path directory{};
+		std::vector<File> files{};
+#ifdef _WIN32
+		void* notification{ nullptr }; // HANDLE, null if the directory couldn't be watched
+#elif defined(__linux__)
+		int inotify_fd{ -1 };
+#endif
+	};
+}
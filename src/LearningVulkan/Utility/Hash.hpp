@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <type_traits>
+
+namespace Utility
+{
+	/// 64-bit FNV-1a, not cryptographic but cheap and stable across runs/platforms which is all we need for cache keys and checksums.
+	constexpr uint64_t fnv1a_offset_basis{ 14695981039346656037ULL };
+	constexpr uint64_t fnv1a_prime{ 1099511628211ULL };
+
+	[[nodiscard]] constexpr uint64_t Fnv1a(std::span<const std::byte> bytes, uint64_t hash = fnv1a_offset_basis) noexcept
+	{
+		for (const std::byte b : bytes)
+		{
+			hash ^= static_cast<uint64_t>(b);
+			hash *= fnv1a_prime;
+		}
+		return hash;
+	}
+
+	[[nodiscard]] constexpr uint64_t Fnv1a(std::string_view str, uint64_t hash = fnv1a_offset_basis) noexcept
+	{
+		for (const char c : str)
+		{
+			hash ^= static_cast<uint64_t>(static_cast<unsigned char>(c));
+			hash *= fnv1a_prime;
+		}
+		return hash;
+	}
+
+	/// Hashes the object representation, so only use with types that have no padding.
+	template<typename T>
+		requires std::is_trivially_copyable_v<T>
+	[[nodiscard]] uint64_t HashValue(const T& value, uint64_t hash = fnv1a_offset_basis) noexcept
+	{
+		return Fnv1a(std::as_bytes(std::span{ &value, 1 }), hash);
+	}
+}
@@ -0,0 +1,96 @@
+
+#include <utility>
+
+#ifdef _WIN32
+#include "LearningVulkan/Bridges/Windows.hpp"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "MappedFile.hpp"
+
+namespace Utility
+{
+	MappedFile::MappedFile(const std::filesystem::path& path)
+	{
+#ifdef _WIN32
+		const HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			return;
+		}
+
+		LARGE_INTEGER file_size{};
+		if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+		{
+			// the view keeps the mapping alive, so neither handle is needed once it exists
+			if (const HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr); mapping != nullptr)
+			{
+				if (const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0); view != nullptr)
+				{
+					data = static_cast<const std::byte*>(view);
+					size = static_cast<std::size_t>(file_size.QuadPart);
+				}
+				CloseHandle(mapping);
+			}
+		}
+		CloseHandle(file);
+#else
+		const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			return;
+		}
+
+		struct stat file_stat{};
+		if (::fstat(fd, &file_stat) == 0 && file_stat.st_size > 0)
+		{
+			// the mapping holds its own reference to the file, so the descriptor can be closed straight away
+			if (void* view = ::mmap(nullptr, static_cast<std::size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0); view != MAP_FAILED)
+			{
+				data = static_cast<const std::byte*>(view);
+				size = static_cast<std::size_t>(file_stat.st_size);
+			}
+		}
+		::close(fd);
+#endif
+	}
+
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+	MappedFile::MappedFile(MappedFile&& other) noexcept
+		: data{ std::exchange(other.data, nullptr) }
+		, size{ std::exchange(other.size, 0) }
+	{
+	}
+
+	MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Close();
+			data = std::exchange(other.data, nullptr);
+			size = std::exchange(other.size, 0);
+		}
+		return *this;
+	}
+
+	void MappedFile::Close() noexcept
+	{
+		if (data == nullptr) {
+			return;
+		}
+
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+#else
+		::munmap(const_cast<std::byte*>(data), size);
+#endif
+		data = nullptr;
+		size = 0;
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+namespace Utility
+{
+	/// Read-only view of an entire file mapped into memory.
+	/// Pages are only read in as they are touched and nothing is copied, which makes it cheap to hand file contents straight to an API.
+	class MappedFile
+	{
+	public:
+		MappedFile() noexcept = default;
+		/// Leaves the object closed (IsOpen() == false) if the file doesn't exist, is empty or can't be mapped.
+		explicit MappedFile(const std::filesystem::path& path);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile(MappedFile&& other) noexcept;
+		MappedFile& operator=(MappedFile&& other) noexcept;
+
+		[[nodiscard]] bool IsOpen() const noexcept { return data != nullptr; }
+		[[nodiscard]] std::span<const std::byte> GetData() const noexcept { return { data, size }; }
+
+	private:
+		void Close() noexcept;
+
+		const std::byte* data{ nullptr };
+		std::size_t size{ 0 };
+	};
+}
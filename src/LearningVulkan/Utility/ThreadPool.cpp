@@ -0,0 +1,139 @@
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+#include "ThreadPool.hpp"
+
+namespace
+{
+	thread_local const Utility::ThreadPool* current_pool{ nullptr };
+	thread_local std::size_t current_thread_index{ 0 };
+}
+
+namespace Utility
+{
+	ThreadPool::ThreadPool(std::size_t thread_count)
+	{
+		if (thread_count == 0) {
+			thread_count = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+		}
+
+		workers.reserve(thread_count);
+		for (std::size_t idx{ 0 }; idx < thread_count; ++idx) {
+			workers.emplace_back(&ThreadPool::WorkerLoop, this, idx);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::scoped_lock lock{ mutex };
+			stopping = true;
+		}
+		condition.notify_all();
+
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+
+	void ThreadPool::Enqueue(std::function<void()> task)
+	{
+		{
+			std::scoped_lock lock{ mutex };
+			tasks.push_back(std::move(task));
+		}
+		condition.notify_one();
+	}
+
+	void ThreadPool::WorkerLoop(std::size_t index)
+	{
+		current_pool = this;
+		current_thread_index = index;
+
+		while (true)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock lock{ mutex };
+				condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+				if (tasks.empty()) {
+					return; // only reachable when stopping
+				}
+				task = std::move(tasks.front());
+				tasks.pop_front();
+			}
+
+			task();
+		}
+	}
+
+	std::size_t ThreadPool::GetCurrentThreadIndex() const noexcept
+	{
+		return (current_pool == this) ? current_thread_index : workers.size();
+	}
+
+	void ThreadPool::ParallelFor(std::size_t count, const std::function<void(std::size_t)>& body)
+	{
+		if (count == 0) {
+			return;
+		}
+
+		// Helpers only touch the body while registered as active, and only register before claiming work.
+		// So once every index is claimed and no helper is active, no helper can call body again, even ones still sitting in the queue.
+		// This also means we never wait on a queued task, which would deadlock when called from a worker.
+		struct State
+		{
+			std::atomic<std::size_t> next{ 0 };
+			std::atomic<std::size_t> active{ 0 };
+			std::mutex mutex;
+			std::condition_variable finished;
+			std::exception_ptr exception{};
+		};
+		auto state = std::make_shared<State>();
+		const auto* body_ptr = &body;
+
+		const auto run = [count](State& s, const std::function<void(std::size_t)>* fn)
+		{
+			for (std::size_t idx = s.next.fetch_add(1); idx < count; idx = s.next.fetch_add(1))
+			{
+				try
+				{
+					(*fn)(idx);
+				}
+				catch (...)
+				{
+					std::scoped_lock lock{ s.mutex };
+					if (!s.exception) {
+						s.exception = std::current_exception();
+					}
+				}
+			}
+		};
+
+		const std::size_t helper_count{ std::min(count - 1, workers.size()) };
+		for (std::size_t idx{ 0 }; idx < helper_count; ++idx)
+		{
+			Enqueue([state, body_ptr, run]()
+				{
+					state->active.fetch_add(1);
+					run(*state, body_ptr);
+					{
+						std::scoped_lock lock{ state->mutex };
+						state->active.fetch_sub(1);
+					}
+					state->finished.notify_all();
+				});
+		}
+
+		run(*state, body_ptr);
+
+		std::unique_lock lock{ state->mutex };
+		state->finished.wait(lock, [&]() { return state->active.load() == 0; });
+
+		if (state->exception) {
+			std::rethrow_exception(state->exception);
+		}
+	}
+}
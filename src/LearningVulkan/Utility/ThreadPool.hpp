@@ -0,0 +1,60 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace Utility
+{
+	/// Fixed set of worker threads pulling tasks off a shared FIFO queue.
+	class ThreadPool
+	{
+	public:
+		/// thread_count of 0 picks one worker per hardware thread.
+		explicit ThreadPool(std::size_t thread_count = 0);
+		/// Finishes any queued tasks before joining the workers.
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		template<typename F>
+		[[nodiscard]] std::future<std::invoke_result_t<std::decay_t<F>>> Submit(F&& task)
+		{
+			using Result = std::invoke_result_t<std::decay_t<F>>;
+
+			// std::function needs to be copyable, packaged_task isn't
+			auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+			auto future = packaged->get_future();
+			Enqueue([packaged]() { (*packaged)(); });
+			return future;
+		}
+
+		/// Calls body(i) for every i in [0, count) spread over the workers and the calling thread, returning once all calls are done.
+		/// Safe to call from inside a task. The first exception thrown by body is rethrown here.
+		void ParallelFor(std::size_t count, const std::function<void(std::size_t)>& body);
+
+		[[nodiscard]] std::size_t GetThreadCount() const noexcept { return workers.size(); }
+
+		/// Index of the worker running the caller, in [0, GetThreadCount()), or GetThreadCount() for threads outside this pool.
+		/// Handy for indexing per-thread resources sized GetThreadCount() + 1.
+		[[nodiscard]] std::size_t GetCurrentThreadIndex() const noexcept;
+
+	private:
+		void Enqueue(std::function<void()> task);
+		void WorkerLoop(std::size_t index);
+
+		std::vector<std::thread> workers;
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::deque<std::function<void()>> tasks;
+		bool stopping{ false };
+	};
+}
@@ -10,7 +10,8 @@
 
 int main([[maybe_unused]] const int argc, [[maybe_unused]] const char** argv)
 {
-	std::vector<std::string_view> command_line_args(static_cast<std::size_t>(argc));
+	std::vector<std::string_view> command_line_args;
+	command_line_args.reserve(static_cast<std::size_t>(argc));
 	for (int i = 0; i < argc; i++) {
 		command_line_args.emplace_back(argv[i]);
 	}